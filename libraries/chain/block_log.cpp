@@ -3,10 +3,24 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/chain/block_log.hpp>
+#include <eosio/chain/chunked_block_log.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <mutex>
+#include <thread>
 #include <fc/io/raw.hpp>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define LOG_READ  (std::ios::in | std::ios::binary)
 #define LOG_WRITE (std::ios::out | std::ios::binary | std::ios::app)
 
@@ -19,10 +33,42 @@ namespace eosio { namespace chain {
     * Version 1: complete block log from genesis
     * Version 2: adds optional partial block log, cannot be used for replay without snapshot
     *            this is in the form of an first_block_num that is written immediately after the version
+    * Version 3: blocks are compressed in chunks, the number of blocks per chunk and the codec are written
+    *            immediately after the totem
     */
-   const uint32_t block_log::max_supported_version = 2;
+   const uint32_t block_log::max_supported_version = 3;
 
    namespace detail {
+      namespace bip = boost::interprocess;
+
+      /// read only mapping of a file which only grows, remapped once a read goes past its end
+      class mapped_file {
+         public:
+            void reset( const fc::path& p ) {
+               std::lock_guard<std::mutex> g( mtx );
+               path = p;
+               region.reset();
+            }
+
+            /// returns a region covering at least [0, end), or null if the file is not that long yet
+            std::shared_ptr<const bip::mapped_region> map( uint64_t end ) {
+               std::lock_guard<std::mutex> g( mtx );
+               if( !region || region->get_size() < end ) {
+                  region.reset();
+                  if( end == 0 || fc::file_size( path ) < end )
+                     return {};
+                  bip::file_mapping file( path.generic_string().c_str(), bip::read_only );
+                  region = std::make_shared<const bip::mapped_region>( file, bip::read_only );
+               }
+               return region;
+            }
+
+         private:
+            std::mutex                                 mtx;
+            fc::path                                   path;
+            std::shared_ptr<const bip::mapped_region>  region;
+      };
+
       class block_log_impl {
          public:
             signed_block_ptr         head;
@@ -37,6 +83,44 @@ namespace eosio { namespace chain {
             uint32_t                 version = 0;
             uint32_t                 first_block_num = 0;
 
+            mapped_file              block_mapping;
+            mapped_file              index_mapping;
+
+            /// set for a version 3 log, which then owns the files
+            std::unique_ptr<chunked_block_log> chunks;
+
+            /// what the mapped readers may see: the head and the size of the log up to and including its position
+            std::mutex               committed_mutex;
+            uint32_t                 committed_head_num = 0;
+            uint64_t                 committed_log_size = 0;
+
+            void commit( uint32_t head_num, uint64_t log_size ) {
+               std::lock_guard<std::mutex> g( committed_mutex );
+               committed_head_num = head_num;
+               committed_log_size = log_size;
+            }
+
+            struct queued_block {
+               signed_block_ptr  block;
+               std::vector<char> packed;
+            };
+
+            /// blocks appended but not written yet, the appender thread writes them in group commits
+            block_log::append_options  append_opts;
+            std::thread                appender;
+            std::mutex                 queue_mutex;
+            std::condition_variable    queue_cv;
+            std::deque<queued_block>   queue;
+            bool                       writing = false;
+            bool                       stopping = false;
+            std::exception_ptr         append_error;
+
+            void write_blocks( uint32_t first_num, const std::vector<std::vector<char>>& blocks );
+            void run_appender();
+            void wait_for_appender();
+            void stop_appender();
+            signed_block_ptr find_queued( uint32_t block_num );
+
             inline void check_block_read() {
                if (block_write) {
                   block_stream.close();
@@ -87,12 +171,16 @@ namespace eosio { namespace chain {
 
    block_log::~block_log() {
       if (my) {
-         flush();
+         try {
+            flush();
+         } FC_LOG_AND_DROP();
+         my->stop_appender();
          my.reset();
       }
    }
 
    void block_log::open(const fc::path& data_dir) {
+      my->chunks.reset();
       if (my->block_stream.is_open())
          my->block_stream.close();
       if (my->index_stream.is_open())
@@ -102,6 +190,9 @@ namespace eosio { namespace chain {
          fc::create_directories(data_dir);
       my->block_file = data_dir / "blocks.log";
       my->index_file = data_dir / "blocks.index";
+      my->block_mapping.reset( my->block_file );
+      my->index_mapping.reset( my->index_file );
+      my->commit( 0, 0 );
 
       //ilog("Opening block log at ${path}", ("path", my->block_file.generic_string()));
       my->block_stream.open(my->block_file.generic_string().c_str(), LOG_WRITE);
@@ -151,6 +242,28 @@ namespace eosio { namespace chain {
             my->first_block_num = 1;
          }
 
+         if (my->version > 2) {
+            genesis_state gs;
+            fc::raw::unpack(my->block_stream, gs);
+            uint64_t totem = 0;
+            uint32_t chunk_blocks = 0;
+            uint8_t  codec = 0;
+            my->block_stream.read( (char*)&totem, sizeof(totem) );
+            my->block_stream.read( (char*)&chunk_blocks, sizeof(chunk_blocks) );
+            my->block_stream.read( (char*)&codec, sizeof(codec) );
+            EOS_ASSERT( totem == npos, block_log_exception, "Block log is malformed, the totem was not found after the genesis" );
+            const uint64_t data_pos = my->block_stream.tellg();
+
+            my->block_stream.close();
+            my->index_stream.close();
+            my->chunks.reset( new chunked_block_log( my->block_file, my->index_file, data_pos, my->first_block_num,
+                                                     chunk_blocks, chunked_block_log::codec(codec) ) );
+            my->head = read_head();
+            if (my->head)
+               my->head_id = my->head->id();
+            return;
+         }
+
          my->head = read_head();
          my->head_id = my->head->id();
 
@@ -178,6 +291,10 @@ namespace eosio { namespace chain {
             ilog("Index is empty");
             construct_index();
          }
+
+         flush();
+         if (my->head)
+            my->commit( my->head->block_num(), log_size );
       } else if (index_size) {
          ilog("Index is nonempty, remove and recreate it");
          my->index_stream.close();
@@ -187,44 +304,210 @@ namespace eosio { namespace chain {
       }
    }
 
+   /**
+    * Writes consecutive packed blocks starting at first_num. All the block data goes to the log before
+    * any position goes to the index, so a crash leaves at worst an incomplete index which open()
+    * reconstructs, or an incomplete last block which repair_log drops.
+    */
+   void detail::block_log_impl::write_blocks( uint32_t first_num, const std::vector<std::vector<char>>& blocks ) {
+      check_block_write();
+      check_index_write();
+
+      EOS_ASSERT(index_stream.tellp() == sizeof(uint64_t) * (first_num - first_block_num),
+                block_log_append_fail,
+                "Append to index file occuring at wrong position.",
+                ("position", (uint64_t) index_stream.tellp())
+                ("expected", (first_num - first_block_num) * sizeof(uint64_t)));
+
+      std::vector<uint64_t> positions;
+      positions.reserve( blocks.size() );
+      uint64_t pos = block_stream.tellp();
+      for( const auto& data : blocks ) {
+         positions.push_back( pos );
+         block_stream.write(data.data(), data.size());
+         block_stream.write((char*)&pos, sizeof(pos));
+         pos += data.size() + sizeof(pos);
+      }
+      block_stream.flush();
+      for( auto p : positions )
+         index_stream.write((char*)&p, sizeof(p));
+      index_stream.flush();
+
+#ifndef _WIN32
+      if( append_opts.fsync ) {
+         for( const auto& f : { block_file, index_file } ) {
+            int fd = ::open( f.generic_string().c_str(), O_RDONLY );
+            EOS_ASSERT( fd >= 0, block_log_append_fail, "Unable to open ${f} to sync it", ("f", f) );
+            const int r = ::fsync( fd );
+            ::close( fd );
+            EOS_ASSERT( r == 0, block_log_append_fail, "Unable to sync ${f}", ("f", f) );
+         }
+      }
+#endif
+
+      commit( first_num + blocks.size() - 1, pos );
+   }
+
+   void detail::block_log_impl::run_appender() {
+      std::unique_lock<std::mutex> g( queue_mutex );
+      while( true ) {
+         queue_cv.wait( g, [&]() { return stopping || !queue.empty(); } );
+         if( queue.empty() )
+            return;
+
+         // everything queued so far is one group commit, the blocks stay queued for readers until written
+         std::vector<std::vector<char>> batch;
+         batch.reserve( queue.size() );
+         for( auto& q : queue )
+            batch.emplace_back( std::move(q.packed) );
+         const uint32_t first_num = queue.front().block->block_num();
+         writing = true;
+         g.unlock();
+
+         std::exception_ptr error;
+         try {
+            write_blocks( first_num, batch );
+         } catch( const fc::exception& e ) {
+            elog( "Block log appender failed: ${e}", ("e", e.to_detail_string()) );
+            error = std::current_exception();
+         } catch( const std::exception& e ) {
+            elog( "Block log appender failed: ${e}", ("e", e.what()) );
+            error = std::current_exception();
+         }
+
+         g.lock();
+         writing = false;
+         queue.erase( queue.begin(), queue.begin() + batch.size() );
+         if( error ) {
+            append_error = error;
+            queue.clear();
+            stopping = true;
+         }
+         queue_cv.notify_all();
+      }
+   }
+
+   void detail::block_log_impl::wait_for_appender() {
+      std::unique_lock<std::mutex> g( queue_mutex );
+      queue_cv.wait( g, [&]() { return queue.empty() && !writing; } );
+      if( append_error )
+         std::rethrow_exception( append_error );
+   }
+
+   void detail::block_log_impl::stop_appender() {
+      if( !appender.joinable() )
+         return;
+      {
+         std::lock_guard<std::mutex> g( queue_mutex );
+         stopping = true;
+      }
+      queue_cv.notify_all();
+      appender.join();
+      stopping = false;
+   }
+
+   signed_block_ptr detail::block_log_impl::find_queued( uint32_t block_num ) {
+      std::lock_guard<std::mutex> g( queue_mutex );
+      if( queue.empty() )
+         return {};
+      const uint32_t first_num = queue.front().block->block_num();
+      if( block_num < first_num || block_num - first_num >= queue.size() )
+         return {};
+      return queue[block_num - first_num].block;
+   }
+
+   void block_log::set_append_options( const append_options& opts ) {
+      flush();
+      my->stop_appender();
+      my->append_opts = opts;
+      if( opts.queue_size > 0 ) {
+         auto impl = my.get();
+         my->appender = std::thread( [impl]() { impl->run_appender(); } );
+      }
+   }
+
    uint64_t block_log::append(const signed_block_ptr& b) {
       try {
          EOS_ASSERT( my->genesis_written_to_block_log, block_log_append_fail, "Cannot append to block log until the genesis is first written" );
 
-         my->check_block_write();
-         my->check_index_write();
+         if (my->chunks) {
+            append(b, fc::raw::pack(*b));
+            return npos;
+         }
 
+         flush();
+         my->check_block_write();
          uint64_t pos = my->block_stream.tellp();
-         EOS_ASSERT(my->index_stream.tellp() == sizeof(uint64_t) * (b->block_num() - my->first_block_num),
-                   block_log_append_fail,
-                   "Append to index file occuring at wrong position.",
-                   ("position", (uint64_t) my->index_stream.tellp())
-                   ("expected", (b->block_num() - my->first_block_num) * sizeof(uint64_t)));
-         auto data = fc::raw::pack(*b);
-         my->block_stream.write(data.data(), data.size());
-         my->block_stream.write((char*)&pos, sizeof(pos));
-         my->index_stream.write((char*)&pos, sizeof(pos));
+         std::vector<std::vector<char>> blocks;
+         blocks.emplace_back( fc::raw::pack(*b) );
+         my->write_blocks( b->block_num(), blocks );
          my->head = b;
          my->head_id = b->id();
 
-         flush();
-
          return pos;
       }
       FC_LOG_AND_RETHROW()
    }
 
+   void block_log::append(const signed_block_ptr& b, std::vector<char>&& packed_block) {
+      try {
+         EOS_ASSERT( my->genesis_written_to_block_log, block_log_append_fail, "Cannot append to block log until the genesis is first written" );
+         const uint32_t expected_num = my->head ? my->head->block_num() + 1 : my->first_block_num;
+         EOS_ASSERT( b->block_num() == expected_num, block_log_append_fail,
+                     "Append to block log occuring at wrong block number.", ("block_num", b->block_num())("expected", expected_num) );
+
+         if( packed_block.empty() )
+            packed_block = fc::raw::pack(*b);
+
+         if( my->chunks ) {
+            my->chunks->append( b->block_num(), std::move(packed_block) );
+         } else if( !my->appender.joinable() ) {
+            std::vector<std::vector<char>> blocks;
+            blocks.emplace_back( std::move(packed_block) );
+            my->write_blocks( b->block_num(), blocks );
+         } else {
+            std::unique_lock<std::mutex> g( my->queue_mutex );
+            my->queue_cv.wait( g, [&]() { return my->queue.size() < my->append_opts.queue_size || my->append_error; } );
+            if( my->append_error )
+               std::rethrow_exception( my->append_error );
+            my->queue.push_back( { b, std::move(packed_block) } );
+            my->queue_cv.notify_all();
+         }
+         my->head = b;
+         my->head_id = b->id();
+      }
+      FC_LOG_AND_RETHROW()
+   }
+
+   uint32_t block_log::last_written_block_num()const {
+      if (my->chunks)
+         return my->chunks->last_written_block_num();
+      std::lock_guard<std::mutex> g( my->committed_mutex );
+      return my->committed_head_num;
+   }
+
    void block_log::flush() {
+      my->wait_for_appender();
+      if (my->chunks) {
+         my->chunks->flush();
+         return;
+      }
       my->block_stream.flush();
       my->index_stream.flush();
    }
 
-   void block_log::reset( const genesis_state& gs, const signed_block_ptr& first_block, uint32_t first_block_num ) {
+   void block_log::reset( const genesis_state& gs, const signed_block_ptr& first_block, uint32_t first_block_num,
+                          uint32_t chunk_blocks ) {
+      my->wait_for_appender();
+      my->chunks.reset();
       if (my->block_stream.is_open())
          my->block_stream.close();
       if (my->index_stream.is_open())
          my->index_stream.close();
 
+      my->commit( 0, 0 );
+      my->block_mapping.reset( my->block_file );
+      my->index_mapping.reset( my->index_file );
       fc::remove_all(my->block_file);
       fc::remove_all(my->index_file);
 
@@ -245,6 +528,30 @@ namespace eosio { namespace chain {
       auto totem = npos;
       my->block_stream.write((char*)&totem, sizeof(totem));
 
+      if (chunk_blocks) {
+         const auto codec = chunked_block_log::codec::zlib;
+         my->block_stream.write((char*)&chunk_blocks, sizeof(chunk_blocks));
+         my->block_stream.write((char*)&codec, sizeof(codec));
+         const uint64_t data_pos = my->block_stream.tellp();
+         my->block_stream.close();
+         my->index_stream.close();
+
+         my->block_stream.open(my->block_file.generic_string().c_str(), std::ios::in | std::ios::out | std::ios::binary );
+         my->version = 3;
+         my->block_stream.seekp( 0 );
+         my->block_stream.write( (char*)&my->version, sizeof(my->version) );
+         my->block_stream.close();
+
+         my->head.reset();
+         my->head_id = block_id_type();
+         my->chunks.reset( new chunked_block_log( my->block_file, my->index_file, data_pos, first_block_num,
+                                                  chunk_blocks, codec ) );
+         if (first_block) {
+            append(first_block, std::vector<char>());
+         }
+         return;
+      }
+
       if (first_block) {
          append(first_block);
       }
@@ -254,8 +561,7 @@ namespace eosio { namespace chain {
       my->block_stream.close();
       my->block_stream.open(my->block_file.generic_string().c_str(), std::ios::in | std::ios::out | std::ios::binary ); // Bypass append-only writing just once
 
-      static_assert( block_log::max_supported_version > 0, "a version number of zero is not supported" );
-      my->version = block_log::max_supported_version;
+      my->version = 2;
       my->block_stream.seekp( 0 );
       my->block_stream.write( (char*)&my->version, sizeof(my->version) );
       my->block_stream.seekp( pos );
@@ -266,6 +572,8 @@ namespace eosio { namespace chain {
    }
 
    std::pair<signed_block_ptr, uint64_t> block_log::read_block(uint64_t pos)const {
+      EOS_ASSERT( !my->chunks, block_log_exception, "Blocks of a chunked block log have no position" );
+      my->wait_for_appender(); // the streams belong to the appender while it writes
       my->check_block_read();
 
       my->block_stream.seekg(pos);
@@ -278,18 +586,69 @@ namespace eosio { namespace chain {
 
    signed_block_ptr block_log::read_block_by_num(uint32_t block_num)const {
       try {
-         signed_block_ptr b;
-         uint64_t pos = get_block_pos(block_num);
-         if (pos != npos) {
-            b = read_block(pos).first;
-            EOS_ASSERT(b->block_num() == block_num, reversible_blocks_exception,
-                      "Wrong block was read from block log.", ("returned", b->block_num())("expected", block_num));
+         // queued blocks are checked first, a block leaves the queue only after it is readable from the mapping
+         signed_block_ptr b = my->find_queued(block_num);
+         if (b)
+            return b;
+         auto mapped = read_mapped_block_by_num(block_num);
+         if (mapped) {
+            b = std::make_shared<signed_block>();
+            fc::datastream<const char*> ds(mapped.data, mapped.size);
+            fc::raw::unpack(ds, *b);
          }
          return b;
       } FC_LOG_AND_RETHROW()
    }
 
+   block_log::mapped_block block_log::read_mapped_block_by_num(uint32_t block_num)const {
+      try {
+         if (my->chunks)
+            return my->chunks->read_block(block_num);
+
+         uint32_t head_num;
+         uint64_t log_size;
+         {
+            std::lock_guard<std::mutex> g( my->committed_mutex );
+            head_num = my->committed_head_num;
+            log_size = my->committed_log_size;
+         }
+         if (block_num < my->first_block_num || block_num > head_num)
+            return {};
+
+         // a block ends where the next one starts, the head ends at the log size, both less the trailing position
+         const uint64_t index_offset = sizeof(uint64_t) * (block_num - my->first_block_num);
+         const uint64_t index_entries = block_num < head_num ? 2 : 1;
+         auto index = my->index_mapping.map( index_offset + sizeof(uint64_t) * index_entries );
+         auto log = my->block_mapping.map( log_size );
+         EOS_ASSERT( index && log, block_log_exception, "Block log or its index is shorter than the committed head ${n}", ("n", head_num) );
+
+         const char* entries = static_cast<const char*>(index->get_address()) + index_offset;
+         uint64_t pos;
+         uint64_t end = log_size;
+         memcpy( &pos, entries, sizeof(pos) );
+         if (index_entries > 1)
+            memcpy( &end, entries + sizeof(pos), sizeof(end) );
+         EOS_ASSERT( pos + sizeof(uint64_t) < end && end <= log_size, block_log_exception,
+                     "Block log index entry of block ${n} is out of bounds", ("n", block_num)("pos", pos)("end", end) );
+
+         mapped_block result;
+         result.data = static_cast<const char*>(log->get_address()) + pos;
+         result.size = end - pos - sizeof(uint64_t);
+         result.mapping = log;
+
+         block_header header;
+         fc::datastream<const char*> ds(result.data, result.size);
+         fc::raw::unpack(ds, header);
+         EOS_ASSERT(header.block_num() == block_num, reversible_blocks_exception,
+                   "Wrong block was read from block log.", ("returned", header.block_num())("expected", block_num));
+         return result;
+      } FC_LOG_AND_RETHROW()
+   }
+
    uint64_t block_log::get_block_pos(uint32_t block_num) const {
+      if (my->chunks)
+         return npos;
+      my->wait_for_appender();
       my->check_index_read();
       if (!(my->head && block_num <= block_header::num_from_id(my->head_id) && block_num >= my->first_block_num))
          return npos;
@@ -300,6 +659,9 @@ namespace eosio { namespace chain {
    }
 
    signed_block_ptr block_log::read_head()const {
+      if (my->chunks)
+         return read_block_by_num(my->chunks->head_block_num());
+      my->wait_for_appender();
       my->check_block_read();
 
       uint64_t pos;
@@ -410,6 +772,8 @@ namespace eosio { namespace chain {
       EOS_ASSERT( version >= min_supported_version && version <= max_supported_version, block_log_unsupported_version,
                  "Unsupported version of block log. Block log version is ${version} while code supports version(s) [${min},${max}]",
                  ("version", version)("min", block_log::min_supported_version)("max", block_log::max_supported_version) );
+      EOS_ASSERT( version < 3, block_log_unsupported_version,
+                  "A chunked block log cannot be repaired, decompress it with haya-blocklog first" );
 
       new_block_stream.write( (char*)&version, sizeof(version) );
 
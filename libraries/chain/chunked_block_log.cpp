@@ -0,0 +1,327 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/chunked_block_log.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <cstring>
+#include <limits>
+
+namespace bio = boost::iostreams;
+
+namespace eosio { namespace chain {
+
+   namespace {
+      std::vector<char> compress( chunked_block_log::codec c, const std::vector<char>& in ) {
+         if( c == chunked_block_log::codec::none )
+            return in;
+         std::vector<char> out;
+         bio::filtering_ostream comp;
+         comp.push( bio::zlib_compressor( bio::zlib::default_compression ) );
+         comp.push( bio::back_inserter( out ) );
+         bio::write( comp, in.data(), in.size() );
+         bio::close( comp );
+         return out;
+      }
+
+      std::vector<char> decompress( chunked_block_log::codec c, std::vector<char>&& in, size_t raw_size ) {
+         if( c == chunked_block_log::codec::none )
+            return std::move(in);
+         std::vector<char> out;
+         out.reserve( raw_size );
+         bio::filtering_ostream decomp;
+         decomp.push( bio::zlib_decompressor() );
+         decomp.push( bio::back_inserter( out ) );
+         bio::write( decomp, in.data(), in.size() );
+         bio::close( decomp );
+         return out;
+      }
+
+      const uint32_t* chunk_offsets( const std::vector<char>& data ) {
+         return reinterpret_cast<const uint32_t*>( data.data() );
+      }
+   }
+
+   chunked_block_log::chunked_block_log( const fc::path& block_file, const fc::path& index_file, uint64_t data_pos,
+                                         uint32_t first_block_num, uint32_t chunk_blocks, codec c )
+   :_block_file(block_file)
+   ,_index_file(index_file)
+   ,_data_pos(data_pos)
+   ,_first_block_num(first_block_num)
+   ,_chunk_blocks(chunk_blocks)
+   ,_codec(c)
+   {
+      EOS_ASSERT( chunk_blocks > 0, block_log_exception, "Chunks of a block log must hold at least one block" );
+      EOS_ASSERT( c == codec::none || c == codec::zlib, block_log_exception, "Unknown block log codec ${c}", ("c", uint32_t(c)) );
+      _written_head_num = _first_block_num - 1;
+
+      if( !fc::exists( _index_file ) )
+         std::ofstream( _index_file.generic_string().c_str(), std::ios::out | std::ios::binary );
+      open_files();
+
+      _log.seekg( 0, std::ios::end );
+      uint64_t log_size = _log.tellg();
+      if( log_size <= _data_pos )
+         return;
+
+      uint64_t last_pos = 0;
+      chunk_header header;
+      if( log_size >= _data_pos + sizeof(header) + sizeof(last_pos) ) {
+         _log.seekg( log_size - sizeof(last_pos) );
+         _log.read( (char*)&last_pos, sizeof(last_pos) );
+      }
+      if( last_pos < _data_pos || !read_header( last_pos, log_size, header )
+          || last_pos + sizeof(header) + header.compressed_size + sizeof(last_pos) != log_size ) {
+         // a chunk was being written when the log was last closed, the blocks in it are still in the reversible database
+         wlog( "Block log ends inside of a chunk, truncating it..." );
+         log_size = rebuild_index( log_size );
+         _log.close();
+         _index.close();
+         boost::filesystem::resize_file( _block_file.generic_string(), log_size );
+         open_files();
+         if( log_size <= _data_pos )
+            return;
+         _log.seekg( log_size - sizeof(last_pos) );
+         _log.read( (char*)&last_pos, sizeof(last_pos) );
+         EOS_ASSERT( read_header( last_pos, log_size, header ), block_log_exception, "Last chunk of the block log is malformed" );
+      }
+
+      const uint32_t chunks = (header.first_block_num - _first_block_num) / _chunk_blocks + 1;
+      uint64_t indexed_pos = 0;
+      _index.seekg( 0, std::ios::end );
+      if( uint64_t(_index.tellg()) == chunks * sizeof(uint64_t) ) {
+         _index.seekg( (chunks - 1) * sizeof(uint64_t) );
+         _index.read( (char*)&indexed_pos, sizeof(indexed_pos) );
+      }
+      if( indexed_pos != last_pos ) {
+         ilog( "Reconstructing block log chunk index..." );
+         EOS_ASSERT( rebuild_index( log_size ) == log_size, block_log_exception, "Block log chunks do not match the chunk index" );
+      }
+
+      if( header.block_count == _chunk_blocks ) {
+         _written_head_num = header.first_block_num + header.block_count - 1;
+         return;
+      }
+
+      // the shorter last chunk stays on disk, it is superseded by the chunk written once appends fill it or on close
+      auto last = read_chunk( last_pos );
+      const auto* offsets = chunk_offsets( last->data );
+      for( uint32_t i = 0; i < last->block_count; ++i )
+         _pending.emplace_back( last->data.data() + offsets[i], last->data.data() + offsets[i + 1] );
+      _pending_on_disk = last->block_count;
+      _written_head_num = header.first_block_num - 1;
+   }
+
+   chunked_block_log::~chunked_block_log() {
+      try {
+         close();
+      } FC_LOG_AND_DROP();
+   }
+
+   void chunked_block_log::open_files() {
+      _log.exceptions( std::fstream::failbit | std::fstream::badbit );
+      _index.exceptions( std::fstream::failbit | std::fstream::badbit );
+      _log.open( _block_file.generic_string().c_str(), std::ios::in | std::ios::out | std::ios::binary );
+      _index.open( _index_file.generic_string().c_str(), std::ios::in | std::ios::out | std::ios::binary );
+   }
+
+   bool chunked_block_log::read_header( uint64_t pos, uint64_t log_size, chunk_header& header )const {
+      if( pos + sizeof(header) + sizeof(pos) > log_size )
+         return false;
+      _log.seekg( pos );
+      _log.read( (char*)&header, sizeof(header) );
+      if( header.first_block_num < _first_block_num || (header.first_block_num - _first_block_num) % _chunk_blocks != 0
+          || header.block_count == 0 || header.block_count > _chunk_blocks
+          || pos + sizeof(header) + header.compressed_size + sizeof(pos) > log_size )
+         return false;
+      uint64_t trailing_pos;
+      _log.seekg( pos + sizeof(header) + header.compressed_size );
+      _log.read( (char*)&trailing_pos, sizeof(trailing_pos) );
+      return trailing_pos == pos;
+   }
+
+   uint64_t chunked_block_log::rebuild_index( uint64_t log_size ) {
+      _index.close();
+      boost::filesystem::resize_file( _index_file.generic_string(), 0 );
+      _index.open( _index_file.generic_string().c_str(), std::ios::in | std::ios::out | std::ios::binary );
+
+      uint64_t next_chunk = 0;
+      uint64_t pos = _data_pos;
+      chunk_header header;
+      while( read_header( pos, log_size, header ) ) {
+         // a chunk rewritten with more blocks supersedes the one of the same number before it
+         const uint64_t chunk_num = (header.first_block_num - _first_block_num) / _chunk_blocks;
+         EOS_ASSERT( chunk_num == next_chunk || chunk_num + 1 == next_chunk, block_log_exception,
+                     "Block log chunk at ${pos} is out of order", ("pos", pos) );
+         _index.seekp( chunk_num * sizeof(pos) );
+         _index.write( (char*)&pos, sizeof(pos) );
+         next_chunk = chunk_num + 1;
+         pos += sizeof(header) + header.compressed_size + sizeof(pos);
+      }
+      _index.flush();
+      return pos;
+   }
+
+   void chunked_block_log::append( uint32_t block_num, std::vector<char>&& packed_block ) {
+      std::lock_guard<std::mutex> g( _mtx );
+      EOS_ASSERT( !_closed, block_log_append_fail, "Cannot append to a closed block log" );
+      const uint32_t expected = _written_head_num + _pending.size() + 1;
+      EOS_ASSERT( block_num == expected, block_log_append_fail,
+                  "Append to block log occuring at wrong block number.", ("block_num", block_num)("expected", expected) );
+
+      _pending.emplace_back( std::move(packed_block) );
+      if( _pending.size() == _chunk_blocks ) {
+         write_chunk( _written_head_num + 1, _pending );
+         _pending.clear();
+         _pending_on_disk = 0;
+      }
+   }
+
+   void chunked_block_log::write_chunk( uint32_t first_num, const std::vector<std::vector<char>>& blocks ) {
+      std::vector<uint32_t> offsets;
+      offsets.reserve( blocks.size() + 1 );
+      uint64_t offset = (blocks.size() + 1) * sizeof(uint32_t);
+      for( const auto& b : blocks ) {
+         offsets.push_back( offset );
+         offset += b.size();
+      }
+      EOS_ASSERT( offset <= std::numeric_limits<uint32_t>::max(), block_log_append_fail, "Block log chunk is too large" );
+      offsets.push_back( offset );
+
+      std::vector<char> raw( offset );
+      memcpy( raw.data(), offsets.data(), offsets.size() * sizeof(uint32_t) );
+      for( size_t i = 0; i < blocks.size(); ++i )
+         memcpy( raw.data() + offsets[i], blocks[i].data(), blocks[i].size() );
+      const auto compressed = compress( _codec, raw );
+
+      chunk_header header;
+      header.first_block_num = first_num;
+      header.block_count = blocks.size();
+      header.raw_size = raw.size();
+      header.compressed_size = compressed.size();
+
+      // a shorter chunk of the same blocks written on close stays in the log, the index is pointed past it
+      _log.seekp( 0, std::ios::end );
+      _index.seekp( 0, std::ios::end );
+      const uint64_t pos = _log.tellp();
+      const uint64_t index_pos = sizeof(uint64_t) * ((first_num - _first_block_num) / _chunk_blocks);
+      const uint64_t index_size = _index.tellp();
+      EOS_ASSERT( index_size == index_pos || (_pending_on_disk && index_size == index_pos + sizeof(uint64_t)),
+                  block_log_append_fail, "Append to chunk index occuring at wrong position." );
+      _log.write( (char*)&header, sizeof(header) );
+      _log.write( compressed.data(), compressed.size() );
+      _log.write( (char*)&pos, sizeof(pos) );
+      _log.flush();
+      _index.seekp( index_pos );
+      _index.write( (char*)&pos, sizeof(pos) );
+      _index.flush();
+
+      _written_head_num = first_num + blocks.size() - 1;
+   }
+
+   void chunked_block_log::flush() {
+      std::lock_guard<std::mutex> g( _mtx );
+      _log.flush();
+      _index.flush();
+   }
+
+   void chunked_block_log::close() {
+      std::lock_guard<std::mutex> g( _mtx );
+      if( _closed )
+         return;
+      _closed = true;
+      if( _pending.size() > _pending_on_disk ) {
+         write_chunk( _written_head_num + 1, _pending );
+         _pending.clear();
+      }
+   }
+
+   chunked_block_log::raw_chunk_ptr chunked_block_log::read_chunk( uint64_t pos )const {
+      chunk_header header;
+      _log.seekg( pos );
+      _log.read( (char*)&header, sizeof(header) );
+      std::vector<char> compressed( header.compressed_size );
+      _log.read( compressed.data(), compressed.size() );
+
+      auto chunk = std::make_shared<raw_chunk>();
+      chunk->first_block_num = header.first_block_num;
+      chunk->block_count = header.block_count;
+      chunk->data = decompress( _codec, std::move(compressed), header.raw_size );
+      EOS_ASSERT( chunk->data.size() == header.raw_size && chunk->data.size() >= (header.block_count + 1) * sizeof(uint32_t)
+                  && chunk_offsets( chunk->data )[header.block_count] == header.raw_size,
+                  block_log_exception, "Block log chunk at ${pos} is corrupted", ("pos", pos) );
+      return chunk;
+   }
+
+   chunked_block_log::raw_chunk_ptr chunked_block_log::load_chunk( uint32_t chunk_num )const {
+      auto itr = _cache_index.find( chunk_num );
+      if( itr != _cache_index.end() ) {
+         _cache.splice( _cache.begin(), _cache, itr->second );
+         return itr->second->second;
+      }
+
+      uint64_t pos;
+      _index.seekg( chunk_num * sizeof(uint64_t) );
+      _index.read( (char*)&pos, sizeof(pos) );
+      auto chunk = read_chunk( pos );
+
+      _cache.emplace_front( chunk_num, chunk );
+      _cache_index[chunk_num] = _cache.begin();
+      while( _cache.size() > _cached_chunks ) {
+         _cache_index.erase( _cache.back().first );
+         _cache.pop_back();
+      }
+      return chunk;
+   }
+
+   block_log::mapped_block chunked_block_log::read_block( uint32_t block_num )const {
+      std::lock_guard<std::mutex> g( _mtx );
+      if( block_num < _first_block_num || block_num > _written_head_num + _pending.size() )
+         return {};
+
+      block_log::mapped_block result;
+      if( block_num > _written_head_num ) {
+         auto copy = std::make_shared<std::vector<char>>( _pending[block_num - _written_head_num - 1] );
+         result.data = copy->data();
+         result.size = copy->size();
+         result.mapping = copy;
+         return result;
+      }
+
+      auto chunk = load_chunk( (block_num - _first_block_num) / _chunk_blocks );
+      const auto i = block_num - chunk->first_block_num;
+      EOS_ASSERT( i < chunk->block_count, block_log_exception, "Block ${n} is not in its chunk", ("n", block_num) );
+      const auto* offsets = chunk_offsets( chunk->data );
+      result.data = chunk->data.data() + offsets[i];
+      result.size = offsets[i + 1] - offsets[i];
+      result.mapping = chunk;
+      return result;
+   }
+
+   uint32_t chunked_block_log::head_block_num()const {
+      std::lock_guard<std::mutex> g( _mtx );
+      return _written_head_num + _pending.size();
+   }
+
+   uint32_t chunked_block_log::last_written_block_num()const {
+      std::lock_guard<std::mutex> g( _mtx );
+      return _written_head_num;
+   }
+
+   void chunked_block_log::set_cached_chunks( size_t n ) {
+      std::lock_guard<std::mutex> g( _mtx );
+      _cached_chunks = n;
+      while( _cache.size() > _cached_chunks ) {
+         _cache_index.erase( _cache.back().first );
+         _cache.pop_back();
+      }
+   }
+
+} } /// eosio::chain
@@ -18,12 +18,15 @@
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/chain_snapshot.hpp>
 #include <eosio/chain/thread_utils.hpp>
+#include <eosio/chain/sha256_batch.hpp>
 
 #include <chainbase/chainbase.hpp>
 #include <fc/io/json.hpp>
 #include <fc/scoped_exit.hpp>
 #include <fc/variant_object.hpp>
 
+#include <deque>
+
 namespace eosio { namespace chain {
 
 using resource_limits::resource_limits_manager;
@@ -112,6 +115,20 @@ struct pending_state {
    }
 };
 
+/// a block unpacked and prepared on the thread pool ahead of being applied
+struct prepared_block {
+   signed_block_ptr                  block;
+   block_id_type                     id;
+   vector<transaction_metadata_ptr>  trxs; ///< metadata of the packed transactions, keys recovered if auth is checked
+};
+
+/// a block whose header state was derived before its previous block was pushed, its signee is verified on the thread pool
+struct lookahead_block {
+   block_state_ptr                   state;
+   std::future<block_state_ptr>      verified;
+   vector<transaction_metadata_ptr>  trxs;
+};
+
 struct controller_impl {
    controller&                    self;
    chainbase::database            db;
@@ -132,6 +149,8 @@ struct controller_impl {
    optional<fc::microseconds>     subjective_cpu_leeway;
    bool                           trusted_producer_light_validation = false;
    uint32_t                       snapshot_head_block = 0;
+   optional<prepared_block>       prepared; ///< consumed by apply_block of the same block
+   map<block_id_type, lookahead_block> lookahead_blocks; ///< see prefetch_block_state
    boost::asio::thread_pool       thread_pool;
 
    typedef pair<scope_name,action_name>                   handler_key;
@@ -178,7 +197,7 @@ struct controller_impl {
         cfg.reversible_cache_size ),
     blog( cfg.blocks_dir ),
     fork_db( cfg.state_dir ),
-    wasmif( cfg.wasm_runtime ),
+    wasmif( cfg.wasm_runtime, cfg.wasm_cache_dir ),
     resource_limits( db ),
     authorization( s, db ),
     conf( cfg ),
@@ -205,6 +224,9 @@ struct controller_impl {
 
    SET_APP_HANDLER( eosio, eosio, canceldelay );
 
+   wasmif.set_cache_limits( cfg.wasm_cache_max_modules, cfg.wasm_cache_max_size );
+   blog.set_append_options( { cfg.block_log_queue_size, cfg.block_log_fsync } );
+
    fork_db.irreversible.connect( [&]( auto b ) {
                                  on_irreversible(b);
                                  });
@@ -264,16 +286,30 @@ struct controller_impl {
       db.commit( s->block_num );
 
       if( append_to_blog ) {
-         blog.append(s->block);
+         // reuse the bytes packed for the reversible database when they are of this very block
+         vector<char> packed;
+         if( const auto* obj = reversible_blocks.find<reversible_block_object,by_num>( s->block_num ) ) {
+            fc::datastream<const char*> ds( obj->packedblock.data(), obj->packedblock.size() );
+            block_header header;
+            fc::raw::unpack( ds, header );
+            if( header.id() == s->id )
+               packed.assign( obj->packedblock.begin(), obj->packedblock.end() );
+         }
+         blog.append( s->block, std::move(packed) );
       }
 
+      // blocks stay in the reversible database until the appender has written them, so after a crash
+      // a replay finds the ones which were still queued there
+      const auto prune_to = std::min( s->block_num, std::max( blog.last_written_block_num(), blog.first_block_num() - 1 ) );
       const auto& ubi = reversible_blocks.get_index<reversible_block_index,by_num>();
       auto objitr = ubi.begin();
-      while( objitr != ubi.end() && objitr->blocknum <= s->block_num ) {
+      while( objitr != ubi.end() && objitr->blocknum <= prune_to ) {
          reversible_blocks.remove( *objitr );
          objitr = ubi.begin();
       }
 
+      wasmif.current_lib( s->block_num );
+
       // the "head" block when a snapshot is loaded is virtual and has no block data, all of its effects
       // should already have been loaded from the snapshot so, it cannot be applied
       if (s->block) {
@@ -307,11 +343,37 @@ struct controller_impl {
             ("s", start_block_num)("n", blog_head->block_num()) );
 
       auto start = fc::time_point::now();
-      while( auto next = blog.read_block_by_num( head->block_num + 1 ) ) {
-         replay_push_block( next, controller::block_status::irreversible );
-         if( next->block_num() % 500 == 0 ) {
-            ilog( "${n} of ${head}", ("n", next->block_num())("head", blog_head->block_num()) );
-            if( shutdown() ) break;
+      {
+         // blocks are read and prepared on the thread pool up to replay_lookahead_blocks ahead of the one applied
+         std::deque<std::future<prepared_block>> lookahead;
+         auto wait_lookahead = fc::make_scoped_exit( [&lookahead, this]() {
+            for( auto& f : lookahead )
+               f.wait();
+            prepared.reset();
+         } );
+         const uint32_t max_lookahead = std::max<uint32_t>( conf.replay_lookahead_blocks, 1 );
+         const uint32_t last_num = blog_head->block_num();
+         uint32_t next_num = start_block_num;
+
+         while( true ) {
+            while( lookahead.size() < max_lookahead && next_num <= last_num )
+               lookahead.emplace_back( prepare_replay_block( next_num++ ) );
+            if( lookahead.empty() )
+               break;
+
+            prepared_block next = lookahead.front().get();
+            lookahead.pop_front();
+            if( !next.block )
+               break;
+
+            const auto block_num = next.block->block_num();
+            auto b = next.block;
+            prepared.emplace( std::move(next) );
+            replay_push_block( b, controller::block_status::irreversible );
+            if( block_num % 500 == 0 ) {
+               ilog( "${n} of ${head}", ("n", block_num)("head", last_num) );
+               if( shutdown() ) break;
+            }
          }
       }
       ilog( "${n} blocks replayed", ("n", head->block_num - start_block_num) );
@@ -336,6 +398,33 @@ struct controller_impl {
       replay_head_time.reset();
    }
 
+   /// reads and unpacks a block of the block log on the thread pool, an empty block if it is not in the log
+   std::future<prepared_block> prepare_replay_block( uint32_t block_num ) {
+      const bool recover_keys = conf.force_all_checks;
+      return async_thread_pool( thread_pool, [this, block_num, recover_keys]() {
+         prepared_block rb;
+         auto mapped = blog.read_mapped_block_by_num( block_num );
+         if( !mapped )
+            return rb;
+         rb.block = std::make_shared<signed_block>();
+         fc::datastream<const char*> ds( mapped.data, mapped.size );
+         fc::raw::unpack( ds, *rb.block );
+         rb.id = rb.block->id();
+
+         compile_setcode_contracts( rb.block );
+         rb.trxs.reserve( rb.block->transactions.size() );
+         for( const auto& receipt : rb.block->transactions ) {
+            if( receipt.trx.contains<packed_transaction>() ) {
+               auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( receipt.trx.get<packed_transaction>() ) );
+               if( recover_keys )
+                  mtrx->recover_keys( chain_id );
+               rb.trxs.emplace_back( std::move(mtrx) );
+            }
+         }
+         return rb;
+      } );
+   }
+
    void init(std::function<bool()> shutdown, const snapshot_reader_ptr& snapshot) {
 
       bool report_integrity_hash = !!snapshot;
@@ -689,7 +778,7 @@ struct controller_impl {
                apply_block( (*ritr)->block, (*ritr)->validated ? controller::block_status::validated : controller::block_status::complete );
                head = *ritr;
                fork_db.mark_in_current_chain( *ritr, true );
-               (*ritr)->validated = true;
+               fork_db.set_validity( *ritr, true );
             }
             catch (const fc::exception& e) { except = e; }
             if (except) {
@@ -1256,15 +1345,20 @@ struct controller_impl {
          start_block( b->timestamp, b->confirmed, s , producer_block_id);
 
          std::vector<transaction_metadata_ptr> packed_transactions;
-         packed_transactions.reserve( b->transactions.size() );
-         for( const auto& receipt : b->transactions ) {
-            if( receipt.trx.contains<packed_transaction>()) {
-               auto& pt = receipt.trx.get<packed_transaction>();
-               auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( pt ) );
-               if( !self.skip_auth_check() ) {
-                  transaction_metadata::start_recover_keys( mtrx, thread_pool, chain_id, microseconds::maximum() );
+         if( prepared && prepared->id == producer_block_id ) {
+            packed_transactions = std::move( prepared->trxs );
+            prepared.reset();
+         } else {
+            packed_transactions.reserve( b->transactions.size() );
+            for( const auto& receipt : b->transactions ) {
+               if( receipt.trx.contains<packed_transaction>()) {
+                  auto& pt = receipt.trx.get<packed_transaction>();
+                  auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( pt ) );
+                  if( !self.skip_auth_check() ) {
+                     transaction_metadata::start_recover_keys( mtrx, thread_pool, chain_id, microseconds::maximum() );
+                  }
+                  packed_transactions.emplace_back( std::move( mtrx ) );
                }
-               packed_transactions.emplace_back( std::move( mtrx ) );
             }
          }
 
@@ -1340,12 +1434,121 @@ struct controller_impl {
       auto prev = fork_db.get_block( b->previous );
       EOS_ASSERT( prev, unlinkable_block_exception, "unlinkable block ${id}", ("id", id)("previous", b->previous) );
 
-      return async_thread_pool( thread_pool, [b, prev]() {
+      auto itr = lookahead_blocks.find( id );
+      if( itr != lookahead_blocks.end() ) {
+         auto lb = std::move( itr->second );
+         lookahead_blocks.erase( itr );
+         prepared.emplace( prepared_block{ lb.state->block, id, std::move( lb.trxs ) } );
+         return std::move( lb.verified );
+      }
+
+      return async_thread_pool( thread_pool, [b, prev, this]() {
+         compile_setcode_contracts( b );
          const bool skip_validate_signee = false;
          return std::make_shared<block_state>( *prev, move( b ), skip_validate_signee );
       } );
    }
 
+   /**
+    * Derives the header state of a block whose previous block is either in the fork database or was prefetched
+    * itself, then verifies its signee and recovers the keys of its transactions on the thread pool. Blocks that
+    * do not link or have invalid headers are left to create_block_state_future.
+    */
+   void prefetch_block_state( const signed_block_ptr& b ) {
+      EOS_ASSERT( b, block_validate_exception, "null block" );
+      if( conf.sync_lookahead_blocks == 0 )
+         return;
+
+      auto id = b->id();
+      if( lookahead_blocks.count( id ) || fork_db.get_block( id ) )
+         return;
+
+      block_state_ptr prev = fork_db.get_block( b->previous );
+      if( !prev ) {
+         auto itr = lookahead_blocks.find( b->previous );
+         if( itr == lookahead_blocks.end() )
+            return;
+         prev = itr->second.state;
+      }
+
+      // blocks which never got pushed are dropped once the head has passed them
+      for( auto itr = lookahead_blocks.begin(); itr != lookahead_blocks.end(); ) {
+         if( itr->second.state->block_num <= head->block_num )
+            itr = lookahead_blocks.erase( itr );
+         else
+            ++itr;
+      }
+      if( lookahead_blocks.size() >= conf.sync_lookahead_blocks )
+         return;
+
+      lookahead_block lb;
+      try {
+         const bool skip_validate_signee = true; // verified on the thread pool
+         lb.state = std::make_shared<block_state>( *prev, b, skip_validate_signee );
+      } catch( const fc::exception& ) {
+         return;
+      }
+
+      lb.trxs.reserve( b->transactions.size() );
+      for( const auto& receipt : b->transactions ) {
+         if( receipt.trx.contains<packed_transaction>() ) {
+            auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( receipt.trx.get<packed_transaction>() ) );
+            transaction_metadata::start_recover_keys( mtrx, thread_pool, chain_id, microseconds::maximum() );
+            lb.trxs.emplace_back( std::move( mtrx ) );
+         }
+      }
+
+      lb.verified = async_thread_pool( thread_pool, [state = lb.state, this]() {
+         compile_setcode_contracts( state->block );
+         state->verify_signee( state->signee() );
+         return state;
+      } );
+      lookahead_blocks.emplace( id, std::move( lb ) );
+   }
+
+   /// starts compiling contracts set by the block before it is applied, code which fails validation is left to block validation
+   void compile_setcode_contracts( const signed_block_ptr& b ) {
+      for( const auto& receipt : b->transactions ) {
+         if( !receipt.trx.contains<packed_transaction>() )
+            continue;
+         try {
+            for( const auto& act : receipt.trx.get<packed_transaction>().get_transaction().actions ) {
+               if( act.account != config::system_account_name || act.name != setcode::get_name() )
+                  continue;
+               auto sc = act.data_as<setcode>();
+               if( sc.code.size() > 0 ) {
+                  // the block is not validated yet, so its code must pass the checks setcode applies before compiling
+                  wasm_interface::validate( sc.code, false );
+                  auto code_id = fc::sha256::hash( sc.code.data(), (uint32_t)sc.code.size() );
+                  wasmif.compile_async( code_id, std::move(sc.code) );
+               }
+            }
+         } catch( ... ) {
+         }
+      }
+   }
+
+   /// starts compiling the contracts of the receivers of trx actions which are not cached, notified accounts are not known ahead
+   bool compile_transaction_contracts( const transaction_metadata_ptr& trx ) {
+      auto compile = [&]( const vector<action>& actions ) {
+         for( const auto& act : actions ) {
+            const auto* receiver = db.find<account_object,by_name>( act.account );
+            if( !receiver || receiver->code.size() == 0 || wasmif.is_compiled_or_compiling( receiver->code_version ) )
+               continue;
+            if( !wasmif.can_compile_ahead( receiver->code.size() ) )
+               return false;
+            wasmif.compile_async( receiver->code_version, bytes( receiver->code.begin(), receiver->code.end() ) );
+         }
+         return true;
+      };
+      try {
+         const auto& t = trx->packed_trx->get_transaction();
+         return compile( t.context_free_actions ) && compile( t.actions );
+      } catch( ... ) {
+      }
+      return true;
+   }
+
    void push_block( std::future<block_state_ptr>& block_state_future ) {
       controller::block_status s = controller::block_status::complete;
       EOS_ASSERT(!pending, block_validate_exception, "it is not valid to push a block when there is a pending block");
@@ -1430,7 +1633,7 @@ struct controller_impl {
                apply_block( (*ritr)->block, (*ritr)->validated ? controller::block_status::validated : controller::block_status::complete );
                head = *ritr;
                fork_db.mark_in_current_chain( *ritr, true );
-               (*ritr)->validated = true;
+               fork_db.set_validity( *ritr, true );
             }
             catch (const fc::exception& e) { except = e; }
             if (except) {
@@ -1479,10 +1682,29 @@ struct controller_impl {
    }
 
    void set_action_merkle() {
-      vector<digest_type> action_digests;
-      action_digests.reserve( pending->_actions.size() );
-      for( const auto& a : pending->_actions )
-         action_digests.emplace_back( a.digest() );
+      const auto& actions = pending->_actions;
+
+      // receipts are packed back to back and hashed as one batch, same digests as action_receipt::digest()
+      vector<size_t> offsets;
+      offsets.reserve( actions.size() + 1 );
+      size_t total_size = 0;
+      for( const auto& a : actions ) {
+         offsets.push_back( total_size );
+         total_size += fc::raw::pack_size( a );
+      }
+      offsets.push_back( total_size );
+
+      vector<char> packed( total_size );
+      vector<sha256_message> messages;
+      messages.reserve( actions.size() );
+      for( size_t i = 0; i < actions.size(); ++i ) {
+         fc::datastream<char*> ds( packed.data() + offsets[i], offsets[i + 1] - offsets[i] );
+         fc::raw::pack( ds, actions[i] );
+         messages.push_back( { packed.data() + offsets[i], offsets[i + 1] - offsets[i] } );
+      }
+
+      vector<digest_type> action_digests( actions.size() );
+      sha256_batch( messages.data(), messages.size(), action_digests.data() );
 
       pending->_pending_block_state->header.action_mroot = merkle( move(action_digests) );
    }
@@ -1855,6 +2077,10 @@ std::future<block_state_ptr> controller::create_block_state_future( const signed
    return my->create_block_state_future( b );
 }
 
+void controller::prefetch_block_state( const signed_block_ptr& b ) {
+   my->prefetch_block_state( b );
+}
+
 void controller::push_block( std::future<block_state_ptr>& block_state_future ) {
    validate_db_available_size();
    validate_reversible_available_size();
@@ -1868,6 +2094,10 @@ transaction_trace_ptr controller::push_transaction( const transaction_metadata_p
    return my->push_transaction(trx, deadline, billed_cpu_time_us, billed_cpu_time_us > 0 );
 }
 
+bool controller::compile_transaction_contracts( const transaction_metadata_ptr& trx ) {
+   return my->compile_transaction_contracts( trx );
+}
+
 transaction_trace_ptr controller::push_scheduled_transaction( const transaction_id_type& trxid, fc::time_point deadline, uint32_t billed_cpu_time_us )
 {
    validate_db_available_size();
@@ -2008,6 +2238,10 @@ signed_block_ptr controller::fetch_block_by_number( uint32_t block_num )const  {
    return my->blog.read_block_by_num(block_num);
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
+block_log::mapped_block controller::fetch_mapped_block_by_number( uint32_t block_num )const  { try {
+   return my->blog.read_mapped_block_by_num(block_num);
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
 block_state_ptr controller::fetch_block_state_by_id( block_id_type id )const {
    auto state = my->fork_db.get_block(id);
    return state;
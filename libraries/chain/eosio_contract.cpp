@@ -150,6 +150,9 @@ void apply_eosio_setcode(apply_context& context) {
 
    EOS_ASSERT( account.code_version != code_id, set_exact_code, "contract is already running this version of code" );
 
+   if( account.code_version != digest_type() )
+      context.control.get_wasm_interface().code_retired( account.code_version, context.control.pending_block_state()->block_num );
+
    db.modify( account, [&]( auto& a ) {
       /** TODO: consider whether a microsecond level local timestamp is sufficient to detect code version changes*/
       // TODO: update setcode message to include the hash, then validate it in validate
@@ -170,6 +173,9 @@ void apply_eosio_setcode(apply_context& context) {
    if (new_size != old_size) {
       context.add_ram_usage( act.account, new_size - old_size );
    }
+
+   if( code_size > 0 )
+      context.control.get_wasm_interface().compile_async( code_id, std::move(act.code) );
 }
 
 void apply_eosio_setabi(apply_context& context) {
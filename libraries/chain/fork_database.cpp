@@ -7,7 +7,10 @@
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/composite_key.hpp>
 #include <fc/io/fstream.hpp>
+#include <boost/filesystem.hpp>
 #include <fstream>
+#include <map>
+#include <thread>
 
 namespace eosio { namespace chain {
    using boost::multi_index_container;
@@ -32,35 +35,205 @@ namespace eosio { namespace chain {
          >,
          ordered_non_unique< tag<by_lib_block_num>,
             composite_key< block_header_state,
-                member<block_header_state,uint32_t,&block_header_state::bft_irreversible_blocknum>,
                 member<block_header_state,uint32_t,&block_header_state::dpos_irreversible_blocknum>,
                 member<block_header_state,uint32_t,&block_header_state::block_num>
             >,
-            composite_key_compare< std::greater<uint32_t>, std::greater<uint32_t>, std::greater<uint32_t> >
+            composite_key_compare< std::greater<uint32_t>, std::greater<uint32_t> >
          >
       >
    > fork_multi_index_type;
 
 
+   /**
+    *  Journal records are [size][op][payload], the payload of every op is what replaying it takes.
+    */
+   enum class journal_op : uint8_t {
+      set,              ///< block_state
+      add,              ///< block_state, added without the prune that follows it
+      remove,           ///< block_id_type
+      erase,            ///< block_id_type of a single state erased by prune
+      validated,        ///< block_id_type
+      in_current_chain, ///< pair<block_id_type, bool>
+      confirmation,     ///< header_confirmation
+      bft_finalize      ///< block_id_type
+   };
+
+   namespace {
+      const string journal_prefix = "forkdb.";
+      const string journal_suffix = ".log";
+
+      fc::path journal_path( const fc::path& datadir, uint64_t gen ) {
+         return datadir / (journal_prefix + std::to_string( gen ) + journal_suffix);
+      }
+
+      /// journals in datadir by generation
+      std::map<uint64_t, fc::path> list_journals( const fc::path& datadir ) {
+         std::map<uint64_t, fc::path> result;
+         using boost::filesystem::directory_iterator;
+         for( directory_iterator enditr, itr{datadir}; itr != enditr; ++itr ) {
+            const auto name = itr->path().filename().generic_string();
+            if( name.size() <= journal_prefix.size() + journal_suffix.size()
+                || name.compare( 0, journal_prefix.size(), journal_prefix ) != 0
+                || name.compare( name.size() - journal_suffix.size(), journal_suffix.size(), journal_suffix ) != 0 )
+               continue;
+            const auto gen = name.substr( journal_prefix.size(), name.size() - journal_prefix.size() - journal_suffix.size() );
+            if( gen.find_first_not_of( "0123456789" ) != string::npos )
+               continue;
+            result[std::stoull( gen )] = itr->path();
+         }
+         return result;
+      }
+
+      /// the snapshot holds every change journaled up to and including journal gen
+      void write_snapshot( const fc::path& datadir, uint64_t gen, const vector<block_state>& states, const block_id_type& head_id ) {
+         auto snapshot = datadir / config::forkdb_snapshot_filename;
+         auto tmp = snapshot.generic_string() + ".tmp";
+         {
+            std::ofstream out( tmp.c_str(), std::ios::out | std::ios::binary | std::ofstream::trunc );
+            out.exceptions( std::ofstream::failbit | std::ofstream::badbit );
+            fc::raw::pack( out, gen );
+            fc::raw::pack( out, unsigned_int{static_cast<uint32_t>(states.size())} );
+            for( const auto& s : states ) {
+               fc::raw::pack( out, s );
+            }
+            fc::raw::pack( out, head_id );
+            out.flush();
+         }
+         fc::rename( tmp, snapshot );
+
+         for( const auto& j : list_journals( datadir ) ) {
+            if( j.first > gen ) break;
+            fc::remove( j.second );
+         }
+      }
+   }
+
    struct fork_database_impl {
       fork_multi_index_type index;
       block_state_ptr       head;
       fc::path              datadir;
+
+      /**
+       * The highest bft irreversible block. Its descendants are not updated when it is finalized,
+       * their bft_irreversible_blocknum is resolved through their ancestors once it is needed, so
+       * bft_irreversible_blocknum is not part of any index key.
+       */
+      block_state_ptr       bft_lib;
+
+      std::ofstream         journal;
+      uint64_t              journal_gen = 0;
+      uint64_t              journal_size = 0;
+      uint64_t              compact_journal_size = 0;
+      bool                  journaling = false; ///< false while the fork database is loaded and closed
+      std::thread           compactor;
+
+      void open_journal( uint64_t gen ) {
+         if( journal.is_open() )
+            journal.close();
+         journal_gen = gen;
+         journal_size = 0;
+         journal.exceptions( std::ofstream::failbit | std::ofstream::badbit );
+         journal.open( journal_path( datadir, gen ).generic_string().c_str(), std::ios::out | std::ios::binary | std::ofstream::trunc );
+      }
+
+      void close_journal() {
+         journaling = false;
+         if( journal.is_open() )
+            journal.close();
+         if( compactor.joinable() )
+            compactor.join();
+      }
+
+      template<typename T>
+      void record( journal_op op, const T& payload ) {
+         if( !journaling ) return;
+         const auto data = fc::raw::pack( std::make_pair( static_cast<uint8_t>(op), payload ) );
+         const uint32_t size = data.size();
+         fc::raw::pack( journal, size );
+         journal.write( data.data(), data.size() );
+         journal.flush();
+         journal_size += sizeof(size) + size;
+         if( journal_size >= compact_journal_size )
+            compact();
+      }
+
+      /**
+       * Raises bft_irreversible_blocknum of s and of its ancestors up to the first resolved one to
+       * the bft lib if s builds off of it, the cost is the length of the unresolved path.
+       */
+      uint32_t resolve_bft_irreversible( const block_state_ptr& s ) {
+         if( !bft_lib || s->bft_irreversible_blocknum >= bft_lib->block_num )
+            return s->bft_irreversible_blocknum;
+
+         const auto lib_num = bft_lib->block_num;
+         vector<block_state_ptr> path;
+         auto cur = s;
+         while( cur && cur->bft_irreversible_blocknum < lib_num && cur->block_num > lib_num ) {
+            path.push_back( cur );
+            auto itr = index.find( cur->header.previous );
+            cur = itr != index.end() ? *itr : block_state_ptr();
+         }
+
+         bool descends = false;
+         if( cur )
+            descends = cur->bft_irreversible_blocknum >= lib_num || cur->id == bft_lib->id;
+         else // every block left once the bft lib is pruned builds off of it
+            descends = index.find( bft_lib->id ) == index.end();
+
+         if( descends ) {
+            for( const auto& p : path )
+               p->bft_irreversible_blocknum = lib_num;
+         }
+         return s->bft_irreversible_blocknum;
+      }
+
+      /// the block with the highest dpos lib and block number among the ones building off of the bft lib
+      block_state_ptr best_head() {
+         const auto& idx = index.get<by_lib_block_num>();
+         if( idx.empty() )
+            return block_state_ptr();
+         if( bft_lib ) {
+            for( const auto& s : idx ) {
+               if( resolve_bft_irreversible( s ) >= bft_lib->block_num )
+                  return s;
+            }
+         }
+         return *idx.begin();
+      }
+
+      /// starts the next journal and writes the states the previous ones led to on a thread of its own
+      void compact() {
+         if( compactor.joinable() )
+            compactor.join();
+
+         vector<block_state> states;
+         states.reserve( index.size() );
+         for( const auto& s : index ) {
+            resolve_bft_irreversible( s );
+            states.emplace_back( *s );
+            states.back().trxs.clear();
+         }
+         const auto head_id = head ? head->id : block_id_type();
+         const auto gen = journal_gen;
+         open_journal( gen + 1 );
+
+         compactor = std::thread( [datadir = datadir, gen, states = std::move(states), head_id]() {
+            try {
+               write_snapshot( datadir, gen, states, head_id );
+            } FC_LOG_AND_DROP();
+         });
+      }
    };
 
 
-   fork_database::fork_database( const fc::path& data_dir ):my( new fork_database_impl() ) {
+   fork_database::fork_database( const fc::path& data_dir, uint64_t compact_journal_size ):my( new fork_database_impl() ) {
       my->datadir = data_dir;
+      my->compact_journal_size = compact_journal_size;
 
       if (!fc::is_directory(my->datadir))
          fc::create_directories(my->datadir);
 
-      auto fork_db_dat = my->datadir / config::forkdb_filename;
-      if( fc::exists( fork_db_dat ) ) {
-         string content;
-         fc::read_file_contents( fork_db_dat, content );
-
-         fc::datastream<const char*> ds( content.data(), content.size() );
+      auto load = [&]( fc::datastream<const char*>& ds ) {
          unsigned_int size; fc::raw::unpack( ds, size );
          for( uint32_t i = 0, n = size.value; i < n; ++i ) {
             block_state s;
@@ -71,30 +244,150 @@ namespace eosio { namespace chain {
          fc::raw::unpack( ds, head_id );
 
          my->head = get_block( head_id );
+      };
+
+      uint64_t gen = 0;
+      auto fork_db_dat = my->datadir / config::forkdb_filename;
+      auto snapshot = my->datadir / config::forkdb_snapshot_filename;
+      const bool legacy = fc::exists( fork_db_dat );
+      if( legacy ) {
+         string content;
+         fc::read_file_contents( fork_db_dat, content );
+
+         fc::datastream<const char*> ds( content.data(), content.size() );
+         load( ds );
+      } else if( fc::exists( snapshot ) ) {
+         string content;
+         fc::read_file_contents( snapshot, content );
+
+         fc::datastream<const char*> ds( content.data(), content.size() );
+         fc::raw::unpack( ds, gen );
+         load( ds );
+      }
 
+      bool replayed = false;
+      bool intact = true;
+      for( const auto& j : list_journals( my->datadir ) ) {
+         if( j.first <= gen ) {
+            fc::remove( j.second );
+            continue;
+         }
+         if( intact ) {
+            intact = replay_journal( j.second );
+         } else {
+            wlog( "Skipping fork database journal ${j} which follows a corrupted one", ("j", j.second.generic_string()) );
+         }
+         gen = j.first;
+         replayed = true;
+      }
+
+      my->open_journal( gen + 1 );
+      my->journaling = true;
+      if( legacy ) {
+         my->compact();
+         my->compactor.join();
          fc::remove( fork_db_dat );
+      } else if( replayed ) {
+         my->compact();
       }
    }
 
-   void fork_database::close() {
-      if( my->index.size() == 0 ) return;
+   /// replays the journal until its end or its first corrupted record, which a crash may have left partially written
+   bool fork_database::replay_journal( const fc::path& journal ) {
+      string content;
+      fc::read_file_contents( journal, content );
+
+      fc::datastream<const char*> ds( content.data(), content.size() );
+      while( ds.remaining() > 0 ) {
+         uint32_t size = 0;
+         if( ds.remaining() < sizeof(size) ) {
+            wlog( "Fork database journal ${j} ends with a partial record", ("j", journal.generic_string()) );
+            return false;
+         }
+         fc::raw::unpack( ds, size );
+         if( ds.remaining() < size ) {
+            wlog( "Fork database journal ${j} ends with a partial record", ("j", journal.generic_string()) );
+            return false;
+         }
+         fc::datastream<const char*> rec( ds.pos(), size );
+         ds.skip( size );
+
+         try {
+            uint8_t op;
+            fc::raw::unpack( rec, op );
+            switch( static_cast<journal_op>(op) ) {
+               case journal_op::set:
+               case journal_op::add: {
+                  block_state s;
+                  fc::raw::unpack( rec, s );
+                  if( static_cast<journal_op>(op) == journal_op::set )
+                     set( std::make_shared<block_state>( move( s ) ) );
+                  else
+                     add( std::make_shared<block_state>( move( s ) ), true );
+                  break;
+               }
+               case journal_op::remove: {
+                  block_id_type id;
+                  fc::raw::unpack( rec, id );
+                  remove( id );
+                  break;
+               }
+               case journal_op::erase: {
+                  block_id_type id;
+                  fc::raw::unpack( rec, id );
+                  my->index.erase( id );
+                  break;
+               }
+               case journal_op::validated: {
+                  block_id_type id;
+                  fc::raw::unpack( rec, id );
+                  auto b = get_block( id );
+                  if( b ) b->validated = true;
+                  break;
+               }
+               case journal_op::in_current_chain: {
+                  std::pair<block_id_type, bool> v;
+                  fc::raw::unpack( rec, v );
+                  auto b = get_block( v.first );
+                  if( b ) mark_in_current_chain( b, v.second );
+                  break;
+               }
+               case journal_op::confirmation: {
+                  header_confirmation c;
+                  fc::raw::unpack( rec, c );
+                  add( c );
+                  break;
+               }
+               case journal_op::bft_finalize: {
+                  block_id_type id;
+                  fc::raw::unpack( rec, id );
+                  bft_finalize( id );
+                  break;
+               }
+               default:
+                  EOS_THROW( fork_database_exception, "unknown fork database journal op ${op}", ("op", op) );
+            }
+         } catch( const fc::exception& e ) {
+            elog( "Fork database journal ${j} is corrupted: ${e}", ("j", journal.generic_string())("e", e.to_detail_string()) );
+            return false;
+         }
+      }
+      return true;
+   }
 
-      auto fork_db_dat = my->datadir / config::forkdb_filename;
-      std::ofstream out( fork_db_dat.generic_string().c_str(), std::ios::out | std::ios::binary | std::ofstream::trunc );
-      uint32_t num_blocks_in_fork_db = my->index.size();
-      fc::raw::pack( out, unsigned_int{num_blocks_in_fork_db} );
-      for( const auto& s : my->index ) {
-         fc::raw::pack( out, *s );
+   void fork_database::close() {
+      if( my->index.size() == 0 ) {
+         my->close_journal();
+         return;
       }
-      if( my->head )
-         fc::raw::pack( out, my->head->id );
-      else
-         fc::raw::pack( out, block_id_type() );
 
       /// we don't normally indicate the head block as irreversible
       /// we cannot normally prune the lib if it is the head block because
       /// the next block needs to build off of the head block. We are exiting
       /// now so we can prune this block as irreversible before exiting.
+      /// The journal already holds the fork database, the prune is left out of
+      /// it so that the pruned block is loaded again on restart.
+      my->journaling = false;
       auto lib    = my->head->dpos_irreversible_blocknum;
       auto oldest = *my->index.get<by_block_num>().begin();
       if( oldest->block_num <= lib ) {
@@ -102,6 +395,7 @@ namespace eosio { namespace chain {
       }
 
       my->index.clear();
+      my->close_journal();
    }
 
    fork_database::~fork_database() {
@@ -121,6 +415,9 @@ namespace eosio { namespace chain {
       } else if( my->head->block_num < s->block_num ) {
          my->head =  s;
       }
+      if( s->bft_irreversible_blocknum == s->block_num && (!my->bft_lib || my->bft_lib->block_num < s->block_num) )
+         my->bft_lib = s;
+      my->record( journal_op::set, *s );
    }
 
    block_state_ptr fork_database::add( const block_state_ptr& n, bool skip_validate_previous ) {
@@ -129,7 +426,7 @@ namespace eosio { namespace chain {
 
       auto prior = my->index.find( n->block->previous );
 
-      if (prior != my->index.end() && (*prior)->bft_irreversible_blocknum > n->bft_irreversible_blocknum) {
+      if (prior != my->index.end() && my->resolve_bft_irreversible(*prior) > n->bft_irreversible_blocknum) {
          n->bft_irreversible_blocknum = (*prior)->bft_irreversible_blocknum;
       }
 
@@ -141,7 +438,12 @@ namespace eosio { namespace chain {
       auto inserted = my->index.insert(n);
       EOS_ASSERT( inserted.second, fork_database_exception, "duplicate block added?" );
 
-      my->head = *my->index.get<by_lib_block_num>().begin();
+      my->head = my->best_head();
+
+      my->record( journal_op::add, *n );
+      // a replayed journal holds the changes of the prune that followed
+      if( !my->journaling )
+         return n;
 
       auto lib_num   = std::max(my->head->dpos_irreversible_blocknum, my->head->bft_irreversible_blocknum);
       auto lib_block = my->index.get<by_block_num>().lower_bound(lib_num);
@@ -224,8 +526,11 @@ namespace eosio { namespace chain {
 
       for( uint32_t i = 0; i < remove_queue.size(); ++i ) {
          auto itr = my->index.find( remove_queue[i] );
-         if( itr != my->index.end() )
+         if( itr != my->index.end() ) {
+            if( *itr == my->bft_lib )
+               my->bft_lib.reset();
             my->index.erase(itr);
+         }
 
          auto& previdx = my->index.get<by_prev>();
          auto  previtr = previdx.lower_bound(remove_queue[i]);
@@ -235,7 +540,8 @@ namespace eosio { namespace chain {
          }
       }
       //wdump((my->index.size()));
-      my->head = *my->index.get<by_lib_block_num>().begin();
+      my->head = my->best_head();
+      my->record( journal_op::remove, remove_queue.front() );
    }
 
    void fork_database::set_validity( const block_state_ptr& h, bool valid ) {
@@ -244,6 +550,7 @@ namespace eosio { namespace chain {
       } else {
          /// remove older than irreversible and mark block as valid
          h->validated = true;
+         my->record( journal_op::validated, h->id );
       }
    }
 
@@ -258,6 +565,7 @@ namespace eosio { namespace chain {
       by_id_idx.modify( itr, [&]( auto& bsp ) { // Need to modify this way rather than directly so that Boost MultiIndex can re-sort
          bsp->in_current_chain = in_current_chain;
       });
+      my->record( journal_op::in_current_chain, std::make_pair( h->id, in_current_chain ) );
    }
 
    void fork_database::prune( const block_state_ptr& h ) {
@@ -272,8 +580,10 @@ namespace eosio { namespace chain {
 
       auto itr = my->index.find( h->id );
       if( itr != my->index.end() ) {
+         const auto id = (*itr)->id;
          irreversible(*itr);
          my->index.erase(itr);
+         my->record( journal_op::erase, id );
       }
 
       auto& numidx = my->index.get<by_block_num>();
@@ -310,6 +620,7 @@ namespace eosio { namespace chain {
       auto b = get_block( c.block_id );
       EOS_ASSERT( b, fork_db_block_not_found, "unable to find block id ${id}", ("id",c.block_id));
       b->add_confirmation( c );
+      my->record( journal_op::confirmation, c );
 
       if( b->bft_irreversible_blocknum < b->block_num &&
          b->confirmations.size() >= ((b->active_schedule.producers.size() * 2) / 3 + 1) ) {
@@ -326,54 +637,21 @@ namespace eosio { namespace chain {
 
       set_bft_irreversible( block_id );
 
-      my->head = *my->index.get<by_lib_block_num>().begin();
+      my->head = my->best_head();
+      my->record( journal_op::bft_finalize, block_id );
    }
 
    /**
-    *  This method will set this block as being BFT irreversible and will update
-    *  all blocks which build off of it to have the same bft_irb if their existing
-    *  bft irb is less than this block num.
-    *
-    *  This will require a search over all forks
+    *  This method will set this block as being BFT irreversible. The blocks which build
+    *  off of it get the same bft irb through resolve_bft_irreversible once they are needed,
+    *  rather than by a search over all forks.
     */
    void fork_database::set_bft_irreversible( block_id_type id ) {
-      auto& idx = my->index.get<by_block_id>();
-      auto itr = idx.find(id);
-      uint32_t block_num = (*itr)->block_num;
-      idx.modify( itr, [&]( auto& bsp ) {
-           bsp->bft_irreversible_blocknum = bsp->block_num;
-      });
-
-      /** to prevent stack-overflow, we perform a bredth-first traversal of the
-       * fork database. At each stage we iterate over the leafs from the prior stage
-       * and find all nodes that link their previous. If we update the bft lib then we
-       * add it to a queue for the next layer.  This lambda takes one layer and returns
-       * all block ids that need to be iterated over for next layer.
-       */
-      auto update = [&]( const vector<block_id_type>& in ) {
-         vector<block_id_type> updated;
-
-         for( const auto& i : in ) {
-            auto& pidx = my->index.get<by_prev>();
-            auto pitr  = pidx.lower_bound( i );
-            auto epitr = pidx.upper_bound( i );
-            while( pitr != epitr ) {
-               pidx.modify( pitr, [&]( auto& bsp ) {
-                 if( bsp->bft_irreversible_blocknum < block_num ) {
-                    bsp->bft_irreversible_blocknum = block_num;
-                    updated.push_back( bsp->id );
-                 }
-               });
-               ++pitr;
-            }
-         }
-         return updated;
-      };
-
-      vector<block_id_type> queue{id};
-      while( queue.size() ) {
-         queue = update( queue );
-      }
+      auto b = get_block( id );
+      EOS_ASSERT( b, fork_db_block_not_found, "unable to find block id ${id}", ("id",id) );
+      b->bft_irreversible_blocknum = b->block_num;
+      if( !my->bft_lib || my->bft_lib->block_num < b->block_num )
+         my->bft_lib = b;
    }
 
 } } /// eosio::chain
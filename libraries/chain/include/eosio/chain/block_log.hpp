@@ -34,17 +34,59 @@ namespace eosio { namespace chain {
     *
     * The main file is the only file that needs to persist. The index file can be reconstructed during a
     * linear scan of the main file.
+    *
+    * Blocks read by number come from read only memory mappings of both files, so readers neither unpack
+    * through the append streams nor contend with the appender. The mappings cover what has been flushed
+    * and are remapped when a read goes past their end.
+    *
+    * Appends may be queued for an appender thread, which writes everything queued so far as one group
+    * commit: the blocks first, then their index positions, then an optional fsync. Queued blocks count
+    * as appended (head, read_block_by_num) right away. A crash loses at most the queued blocks and
+    * leaves the index behind the log, which open() reconstructs.
+    *
+    * A version 3 log stores its blocks compressed in chunks instead, see chunked_block_log. Its index
+    * holds the positions of the chunks. Blocks of the unfinished last chunk are kept in memory and only
+    * count as written, see last_written_block_num(), once their chunk is full or the log is closed.
     */
 
    class block_log {
       public:
+         /**
+          * Packed bytes of a block inside the mapped block log. The mapping stays alive as long as
+          * the view does, even if the log has been remapped or reset since.
+          */
+         struct mapped_block {
+            const char*                 data = nullptr;
+            size_t                      size = 0;
+            std::shared_ptr<const void> mapping;
+
+            explicit operator bool()const { return data != nullptr; }
+         };
+
+         struct append_options {
+            uint32_t queue_size = 0;  ///< blocks queued for the appender thread, 0 writes them on the calling thread
+            bool     fsync = false;   ///< fsync the log and its index after every group commit
+         };
+
          block_log(const fc::path& data_dir);
          block_log(block_log&& other);
          ~block_log();
 
+         void set_append_options( const append_options& opts );
+
          uint64_t append(const signed_block_ptr& b);
+         /**
+          * Appends the block with its packed bytes (packed here if empty), queued if the appender thread
+          * is enabled. Blocks until there is room in the queue.
+          */
+         void append(const signed_block_ptr& b, std::vector<char>&& packed_block);
+         /// last block on disk, lower than head() while appends are queued
+         uint32_t last_written_block_num()const;
+         /// waits for queued appends to be written
          void flush();
-         void reset( const genesis_state& gs, const signed_block_ptr& genesis_block, uint32_t first_block_num = 1 );
+         /// starts a new log, compressed in chunks of chunk_blocks blocks (version 3) unless chunk_blocks is 0
+         void reset( const genesis_state& gs, const signed_block_ptr& genesis_block, uint32_t first_block_num = 1,
+                     uint32_t chunk_blocks = 0 );
 
          std::pair<signed_block_ptr, uint64_t> read_block(uint64_t file_pos)const;
          signed_block_ptr read_block_by_num(uint32_t block_num)const;
@@ -53,7 +95,13 @@ namespace eosio { namespace chain {
          }
 
          /**
-          * Return offset of block in file, or block_log::npos if it does not exist.
+          * Return the packed block without copying or unpacking it, or an empty view if it is not in the log.
+          * Safe to call from any thread while blocks are appended.
+          */
+         mapped_block read_mapped_block_by_num(uint32_t block_num)const;
+
+         /**
+          * Return offset of block in file, or block_log::npos if it does not exist or the log is chunked.
           */
          uint64_t get_block_pos(uint32_t block_num) const;
          signed_block_ptr        read_head()const;
@@ -0,0 +1,111 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+#include <eosio/chain/block_log.hpp>
+
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace eosio { namespace chain {
+
+   /* The blocks of a version 3 block log. Consecutive blocks are grouped into chunks of chunk_blocks
+    * blocks and every chunk is compressed on its own, only the last chunk may hold fewer blocks. The
+    * log starts with the version 2 header followed by the chunk size and the codec.
+    *
+    * +---------+----------------+---------+----------------+-----+------------+-------------------+
+    * | Chunk 1 | Pos of Chunk 1 | Chunk 2 | Pos of Chunk 2 | ... | Head Chunk | Pos of Head Chunk |
+    * +---------+----------------+---------+----------------+-----+------------+-------------------+
+    *
+    * +-----------------+-------------+----------+-----------------+-----------------+
+    * | First Block Num | Block Count | Raw Size | Compressed Size | Compressed Data |
+    * +-----------------+-------------+----------+-----------------+-----------------+
+    *
+    * The raw data of a chunk is the offsets of its block_count + 1 block boundaries followed by the
+    * packed blocks. The index file holds the position of every chunk, block n is found in chunk
+    * (n - first_block_num) / chunk_blocks.
+    *
+    * Appended blocks stay in memory until their chunk is full. A shorter last chunk is written on
+    * close when blocks were appended and read back into memory on open, the files are left as they
+    * are. The chunk written once it is filled, or on the next close, supersedes it, so a log may hold
+    * several chunks of the same first block and only the last one is indexed. A chunk cut short by a
+    * crash is truncated on open. Recently read chunks are kept decompressed for random access.
+    */
+   class chunked_block_log {
+      public:
+         enum class codec : uint8_t {
+            none = 0,
+            zlib = 1
+         };
+
+         static const uint32_t default_chunk_blocks  = 256;
+         static const size_t   default_cached_chunks = 16;
+
+         chunked_block_log( const fc::path& block_file, const fc::path& index_file, uint64_t data_pos,
+                            uint32_t first_block_num, uint32_t chunk_blocks, codec c );
+         ~chunked_block_log();
+
+         void append( uint32_t block_num, std::vector<char>&& packed_block );
+         void flush();
+         /// writes the unfinished chunk, nothing may be appended afterwards
+         void close();
+
+         /// empty if the block is not in the log, safe to call from any thread
+         block_log::mapped_block read_block( uint32_t block_num )const;
+
+         /// first_block_num() - 1 while the log is empty
+         uint32_t head_block_num()const;
+         /// last block of the last complete chunk on disk
+         uint32_t last_written_block_num()const;
+
+         void set_cached_chunks( size_t n );
+
+      private:
+         struct chunk_header {
+            uint32_t first_block_num = 0;
+            uint32_t block_count = 0;
+            uint32_t raw_size = 0;
+            uint32_t compressed_size = 0;
+         };
+         static_assert( sizeof(chunk_header) == 16, "chunk header is written as is" );
+
+         struct raw_chunk {
+            uint32_t          first_block_num = 0;
+            uint32_t          block_count = 0;
+            std::vector<char> data;
+         };
+         using raw_chunk_ptr = std::shared_ptr<const raw_chunk>;
+
+         void           open_files();
+         void           write_chunk( uint32_t first_num, const std::vector<std::vector<char>>& blocks );
+         raw_chunk_ptr  read_chunk( uint64_t pos )const;
+         raw_chunk_ptr  load_chunk( uint32_t chunk_num )const;
+         /// true when a complete chunk starts at pos
+         bool           read_header( uint64_t pos, uint64_t log_size, chunk_header& header )const;
+         /// indexes the complete chunks and returns where the last one ends
+         uint64_t       rebuild_index( uint64_t log_size );
+
+         fc::path                 _block_file;
+         fc::path                 _index_file;
+         const uint64_t           _data_pos;
+         const uint32_t           _first_block_num;
+         const uint32_t           _chunk_blocks;
+         const codec              _codec;
+
+         mutable std::mutex       _mtx;
+         mutable std::fstream     _log;
+         mutable std::fstream     _index;
+         uint32_t                 _written_head_num = 0;
+         std::vector<std::vector<char>> _pending;
+         size_t                   _pending_on_disk = 0; ///< leading pending blocks which are in the last chunk on disk
+         bool                     _closed = false;
+
+         size_t                                                  _cached_chunks = default_cached_chunks;
+         mutable std::list<std::pair<uint32_t, raw_chunk_ptr>>  _cache;
+         mutable std::map<uint32_t, std::list<std::pair<uint32_t, raw_chunk_ptr>>::iterator> _cache_index;
+   };
+
+} } /// eosio::chain
@@ -16,9 +16,15 @@ const static auto default_blocks_dir_name    = "blocks";
 const static auto reversible_blocks_dir_name = "reversible";
 const static auto default_reversible_cache_size = 340*1024*1024ll;/// 1MB * 340 blocks based on 21 producer BFT delay
 const static auto default_reversible_guard_size = 2*1024*1024ll;/// 1MB * 340 blocks based on 21 producer BFT delay
+const static uint32_t default_block_log_queue_size = 1024; ///< irreversible blocks waiting for the block log appender thread
+const static uint32_t default_replay_lookahead_blocks = 256; ///< blocks prepared on the thread pool ahead of replay
+const static uint32_t default_sync_lookahead_blocks = 256; ///< blocks received while syncing validated ahead of being pushed
 
 const static auto default_state_dir_name     = "state";
+const static auto default_wasm_cache_dir_name = "wasm-cache";
 const static auto forkdb_filename            = "forkdb.dat";
+const static auto forkdb_snapshot_filename   = "forkdb.snapshot";
+const static uint64_t default_forkdb_compact_journal_size = 32*1024*1024; ///< fork database journal size that triggers a compaction
 const static auto default_state_size            = 1*1024*1024*1024ll;
 const static auto default_state_guard_size      =    128*1024*1024ll;
 
@@ -96,6 +102,8 @@ const static uint32_t   setcode_ram_bytes_multiplier       = 10;     ///< multip
 const static uint32_t   hashing_checktime_block_size       = 10*1024;  /// call checktime from hashing intrinsic once per this number of bytes
 
 const static eosio::chain::wasm_interface::vm_type default_wasm_runtime = eosio::chain::wasm_interface::vm_type::wabt;
+const static uint32_t   default_wasm_cache_max_modules     = 1024;              ///< instantiated contracts kept in memory
+const static uint64_t   default_wasm_cache_max_size        = 256*1024*1024ll;   ///< prepared code plus initial memory of instantiated contracts kept in memory
 const static uint32_t   default_abi_serializer_max_time_ms = 15*1000; ///< default deadline for abi serialization methods
 
 /**
@@ -1,5 +1,6 @@
 #pragma once
 #include <eosio/chain/block_state.hpp>
+#include <eosio/chain/block_log.hpp>
 #include <eosio/chain/trace.hpp>
 #include <eosio/chain/genesis_state.hpp>
 #include <boost/signals2/signal.hpp>
@@ -66,6 +67,10 @@ namespace eosio { namespace chain {
             uint64_t                 state_guard_size       =  chain::config::default_state_guard_size;
             uint64_t                 reversible_cache_size  =  chain::config::default_reversible_cache_size;
             uint64_t                 reversible_guard_size  =  chain::config::default_reversible_guard_size;
+            uint32_t                 block_log_queue_size   =  0; ///< irreversible blocks queued for the block log appender thread, 0 appends on the main thread
+            bool                     block_log_fsync        =  false;
+            uint32_t                 replay_lookahead_blocks = chain::config::default_replay_lookahead_blocks; ///< blocks read and prepared on the thread pool ahead of the one replayed
+            uint32_t                 sync_lookahead_blocks  =  chain::config::default_sync_lookahead_blocks; ///< prefetched blocks validated ahead of being pushed, 0 disables prefetching
             uint32_t                 sig_cpu_bill_pct       =  chain::config::default_sig_cpu_bill_pct;
             uint16_t                 thread_pool_size       =  chain::config::default_controller_thread_pool_size;
             bool                     read_only              =  false;
@@ -76,6 +81,9 @@ namespace eosio { namespace chain {
 
             genesis_state            genesis;
             wasm_interface::vm_type  wasm_runtime = chain::config::default_wasm_runtime;
+            path                     wasm_cache_dir; ///< persistent cache of prepared contract code, disabled if empty
+            uint32_t                 wasm_cache_max_modules = chain::config::default_wasm_cache_max_modules;
+            uint64_t                 wasm_cache_max_size    = chain::config::default_wasm_cache_max_size;
 
             db_read_mode             read_mode              = db_read_mode::SPECULATIVE;
             validation_mode          block_validation_mode  = validation_mode::FULL;
@@ -121,6 +129,13 @@ namespace eosio { namespace chain {
           */
          transaction_trace_ptr push_transaction( const transaction_metadata_ptr& trx, fc::time_point deadline, uint32_t billed_cpu_time_us = 0 );
 
+         /**
+          * Starts compiling the contracts that the actions of trx are sent to on the thread pool, so that
+          * pushing it later does not wait for their instantiation. Compilations in flight count against the
+          * wasm cache limits, returns false once there is no room left for them
+          */
+         bool compile_transaction_contracts( const transaction_metadata_ptr& trx );
+
          /**
           * Attempt to execute a specific transaction in our deferred trx database
           *
@@ -133,6 +148,11 @@ namespace eosio { namespace chain {
          void pop_block();
 
          std::future<block_state_ptr> create_block_state_future( const signed_block_ptr& b );
+         /**
+          * Starts validating a block ahead of create_block_state_future, even if its previous block has only
+          * been prefetched so far. Lets a node validate a window of consecutive blocks in parallel while syncing.
+          */
+         void prefetch_block_state( const signed_block_ptr& b );
          void push_block( std::future<block_state_ptr>& block_state_future );
 
          boost::asio::thread_pool& get_thread_pool();
@@ -188,6 +208,10 @@ namespace eosio { namespace chain {
 
          signed_block_ptr fetch_block_by_number( uint32_t block_num )const;
          signed_block_ptr fetch_block_by_id( block_id_type id )const;
+         /**
+          *  Packed bytes of an irreversible block straight from the block log, empty if it is not there yet
+          */
+         block_log::mapped_block fetch_mapped_block_by_number( uint32_t block_num )const;
 
          block_state_ptr fetch_block_state_by_number( uint32_t block_num )const;
          block_state_ptr fetch_block_state_by_id( block_id_type id )const;
@@ -301,12 +325,19 @@ FC_REFLECT( eosio::chain::controller::config,
             (state_dir)
             (state_size)
             (reversible_cache_size)
+            (block_log_queue_size)
+            (block_log_fsync)
+            (replay_lookahead_blocks)
+            (sync_lookahead_blocks)
             (read_only)
             (force_all_checks)
             (disable_replay_opts)
             (contracts_console)
             (genesis)
             (wasm_runtime)
+            (wasm_cache_dir)
+            (wasm_cache_max_modules)
+            (wasm_cache_max_size)
             (resource_greylist)
             (trusted_producers)
           )
@@ -1,5 +1,6 @@
 #pragma once
 #include <eosio/chain/block_state.hpp>
+#include <eosio/chain/config.hpp>
 #include <boost/signals2/signal.hpp>
 
 namespace eosio { namespace chain {
@@ -18,11 +19,18 @@ namespace eosio { namespace chain {
     * database tracks the longest chain and the last irreversible block number. All
     * blocks older than the last irreversible block are freed after emitting the
     * irreversible signal.
+    *
+    * Every change is appended to a journal in data_dir as it happens, so the fork
+    * database survives a crash. Once a journal grows past compact_journal_size a
+    * new one is started and the fork database is written to a snapshot in the
+    * background, after which the older journals are deleted. On open the snapshot
+    * is loaded and the newer journals are replayed on top of it.
     */
    class fork_database {
       public:
 
-         fork_database( const fc::path& data_dir );
+         fork_database( const fc::path& data_dir,
+                        uint64_t compact_journal_size = config::default_forkdb_compact_journal_size );
          ~fork_database();
 
          void close();
@@ -74,6 +82,7 @@ namespace eosio { namespace chain {
 
       private:
          void set_bft_irreversible( block_id_type id );
+         bool replay_journal( const fc::path& journal );
          unique_ptr<fork_database_impl> my;
    };
 
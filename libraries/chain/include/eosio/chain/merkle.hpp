@@ -1,5 +1,6 @@
 #pragma once
 #include <eosio/chain/types.hpp>
+#include <eosio/chain/sha256_batch.hpp>
 
 namespace eosio { namespace chain {
 
@@ -16,7 +17,8 @@ namespace eosio { namespace chain {
 
    /**
     *  Calculates the merkle root of a set of digests, if ids is odd it will duplicate the last id.
+    *  Each level of the tree is hashed as one batch.
     */
-   digest_type merkle( vector<digest_type> ids );
+   digest_type merkle( vector<digest_type> ids, sha256_kernel kernel = sha256_best_kernel() );
 
 } } /// eosio::chain
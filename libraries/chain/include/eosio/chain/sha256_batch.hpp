@@ -0,0 +1,29 @@
+#pragma once
+#include <eosio/chain/types.hpp>
+
+namespace eosio { namespace chain {
+
+   struct sha256_message {
+      const char* data = nullptr;
+      size_t      size = 0;
+   };
+
+   enum class sha256_kernel {
+      scalar, ///< one message at a time through fc::sha256
+      avx2,   ///< eight messages at a time in AVX2 lanes
+      shani   ///< one message at a time with the SHA extensions, without per hash setup
+   };
+
+   bool          sha256_kernel_supported( sha256_kernel kernel );
+   sha256_kernel sha256_best_kernel();
+   const char*   sha256_kernel_name( sha256_kernel kernel );
+
+   /**
+    *  Hashes count messages into out, out[i] == digest_type::hash( messages[i].data, messages[i].size ).
+    *  Messages are grouped by length for the multi-buffer kernel, so batches of similar messages
+    *  such as merkle nodes or action receipts gain the most.
+    */
+   void sha256_batch( const sha256_message* messages, size_t count, digest_type* out,
+                      sha256_kernel kernel = sha256_best_kernel() );
+
+} } /// eosio::chain
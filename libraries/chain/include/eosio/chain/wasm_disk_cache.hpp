@@ -0,0 +1,43 @@
+#pragma once
+#include <eosio/chain/types.hpp>
+#include <fc/filesystem.hpp>
+#include <mutex>
+
+namespace eosio { namespace chain {
+
+   /**
+    * Persistent cache of contract code prepared for instantiation: the WASM after
+    * wasm_binary_injection, re-serialized, together with its initial memory image.
+    *
+    * There is one file per code hash in the cache directory. An entry carries the cache format
+    * version, the injection version and a checksum, and all of them are verified on load.
+    * Stale or corrupted entries are removed and treated as misses.
+    *
+    * Native code is not cached: WAVM embeds absolute addresses of the module instance and the
+    * intrinsics into the code it generates, so that code can't be reused by another process.
+    */
+   class wasm_disk_cache {
+      public:
+         struct entry {
+            std::vector<uint8_t> code;
+            std::vector<uint8_t> initial_memory;
+         };
+
+         static const uint32_t format_version;
+
+         explicit wasm_disk_cache( const fc::path& dir );
+
+         bool load( const digest_type& code_id, entry& result )const;
+         void store( const digest_type& code_id, const entry& e );
+         void remove( const digest_type& code_id );
+
+         const fc::path& get_dir()const { return dir; }
+
+      private:
+         fc::path file_path( const digest_type& code_id )const;
+
+         fc::path            dir;
+         mutable std::mutex  mtx;
+   };
+
+} } // eosio::chain
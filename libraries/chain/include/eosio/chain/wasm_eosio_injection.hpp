@@ -19,6 +19,10 @@
 
 namespace eosio { namespace chain { namespace wasm_injections {
    using namespace IR;
+
+   // bump whenever the injected code changes, wasm_disk_cache entries of older versions are discarded
+   constexpr uint32_t injection_version = 1;
+
    // helper functions for injection
 
    struct injector_utils {
@@ -1,6 +1,7 @@
 #pragma once
 #include <eosio/chain/types.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <fc/filesystem.hpp>
 #include "Runtime/Linker.h"
 #include "Runtime/Runtime.h"
 
@@ -56,18 +57,53 @@ namespace eosio { namespace chain {
             wabt
          };
 
-         wasm_interface(vm_type vm);
+         struct cache_stats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t compiled_ahead = 0; ///< misses served by compile_async
+            uint64_t evictions = 0;
+            uint32_t modules = 0;
+            uint64_t size = 0; ///< accounted size of cached modules: prepared code plus initial memory
+         };
+
+         // code prepared for instantiation is persisted in cache_dir unless it is empty
+         wasm_interface(vm_type vm, const fc::path& cache_dir = fc::path());
          ~wasm_interface();
 
          //validates code -- does a WASM validation pass and checks the wasm against EOSIO specific constraints
          static void validate(const controller& control, const bytes& code);
 
+         //validates code as above for a block which is or is not being produced. Thread safe.
+         static void validate(const bytes& code, bool producing_block);
+
          //Calls apply or error on a given code
          void apply(const digest_type& code_id, const shared_string& code, apply_context& context);
 
          //Immediately exits currently running wasm. UB is called when no wasm running
          void exit();
 
+         //Bounds the least recently used cache of instantiated modules, 0 disables a limit. Misses may exceed the limits
+         //until the next current_lib, so that evicting is not billed to the transaction that missed
+         void set_cache_limits(uint32_t max_modules, uint64_t max_size);
+
+         //Marks code replaced by setcode in block_num, it's evicted once block_num is irreversible unless executed again
+         void code_retired(const digest_type& code_id, uint32_t block_num);
+
+         //Evicts modules over the cache limits and retired code replaced in irreversible blocks
+         void current_lib(uint32_t lib);
+
+         //Instantiates validated code on a compile thread ahead of its first execution, which waits for it or compiles
+         //synchronously if the job has not started yet. Thread safe, failures are reported by the synchronous path.
+         void compile_async(const digest_type& code_id, bytes code);
+
+         //True when code is cached or being compiled ahead. Thread safe.
+         bool is_compiled_or_compiling(const digest_type& code_id)const;
+
+         //True when compiling code_size bytes ahead keeps the cached modules and the compilations in flight within the cache limits
+         bool can_compile_ahead(size_t code_size)const;
+
+         cache_stats get_cache_stats()const;
+
       private:
          unique_ptr<struct wasm_interface_impl> my;
          friend class eosio::chain::webassembly::common::intrinsics_accessor;
@@ -80,3 +116,4 @@ namespace eosio{ namespace chain {
 }}
 
 FC_REFLECT_ENUM( eosio::chain::wasm_interface::vm_type, (wavm)(wabt) )
+FC_REFLECT( eosio::chain::wasm_interface::cache_stats, (hits)(misses)(compiled_ahead)(evictions)(modules)(size) )
@@ -5,10 +5,21 @@
 #include <eosio/chain/webassembly/wabt.hpp>
 #include <eosio/chain/webassembly/runtime_interface.hpp>
 #include <eosio/chain/wasm_eosio_injection.hpp>
+#include <eosio/chain/wasm_disk_cache.hpp>
 #include <eosio/chain/transaction_context.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fc/scoped_exit.hpp>
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+
 #include "IR/Module.h"
 #include "Runtime/Intrinsics.h"
 #include "Platform/Platform.h"
@@ -22,14 +33,54 @@ using namespace Runtime;
 
 namespace eosio { namespace chain {
 
+   struct wasm_cache_entry {
+      digest_type                                                  code_id;
+      uint64_t                                                     size = 0; ///< prepared code plus initial memory
+      mutable std::unique_ptr<wasm_instantiated_module_interface>  module;
+   };
+
+   struct by_code_id;
+   // sequenced index keeps the least recently used module in front
+   typedef boost::multi_index_container<
+      wasm_cache_entry,
+      boost::multi_index::indexed_by<
+         boost::multi_index::sequenced<>,
+         boost::multi_index::ordered_unique<boost::multi_index::tag<by_code_id>,
+            boost::multi_index::member<wasm_cache_entry, digest_type, &wasm_cache_entry::code_id>
+         >
+      >
+   > wasm_cache_index;
+
+   // instantiation started ahead of time, run by whichever of the compile thread and the first execution of the code comes first
+   struct compile_job {
+      size_t                                     code_size = 0;
+      std::atomic<bool>                          started{false};
+      std::packaged_task<wasm_cache_entry()>     task;
+      std::future<wasm_cache_entry>              result;
+
+      void run() {
+         if(!started.exchange(true))
+            task();
+      }
+   };
+
    struct wasm_interface_impl {
-      wasm_interface_impl(wasm_interface::vm_type vm) {
+      wasm_interface_impl(wasm_interface::vm_type vm, const fc::path& cache_dir) {
          if(vm == wasm_interface::vm_type::wavm)
             runtime_interface = std::make_unique<webassembly::wavm::wavm_runtime>();
          else if(vm == wasm_interface::vm_type::wabt)
             runtime_interface = std::make_unique<webassembly::wabt_runtime::wabt_runtime>();
          else
             EOS_THROW(wasm_exception, "wasm_interface_impl fall through");
+
+         if(!cache_dir.empty())
+            disk_cache = std::make_unique<wasm_disk_cache>(cache_dir);
+      }
+
+      ~wasm_interface_impl() {
+         // compilations not started yet are dropped, their futures report a broken promise
+         compile_thread.stop();
+         compile_thread.join();
       }
 
       std::vector<uint8_t> parse_initial_memory(const Module& module) {
@@ -50,47 +101,253 @@ namespace eosio { namespace chain {
          return mem_image;
       }
 
+      // parses and injects the code, the result is what runtimes instantiate
+      wasm_disk_cache::entry prepare_code( const char* code, size_t code_size ) {
+         IR::Module module;
+         try {
+            Serialization::MemoryInputStream stream((const U8*)code, code_size);
+            WASM::serialize(stream, module);
+            module.userSections.clear();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+
+         {
+            // the injectors keep their state in static members
+            std::lock_guard<std::mutex> g(instantiate_mutex);
+            wasm_injections::wasm_binary_injection injector(module);
+            injector.inject();
+         }
+
+         std::vector<U8> bytes;
+         try {
+            Serialization::ArrayOutputStream outstream;
+            WASM::serialize(outstream, module);
+            bytes = outstream.getBytes();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+         return {std::move(bytes), parse_initial_memory(module)};
+      }
+
+      // WAVM objects are process wide, so only one thread instantiates at a time, parsing and the disk cache run unlocked
+      wasm_cache_entry instantiate( const digest_type& code_id, const char* code, size_t code_size ) {
+         wasm_disk_cache::entry prepared;
+         if(!disk_cache || !disk_cache->load(code_id, prepared)) {
+            prepared = prepare_code(code, code_size);
+            if(disk_cache)
+               disk_cache->store(code_id, prepared);
+         }
+         wasm_cache_entry entry{code_id, prepared.code.size() + prepared.initial_memory.size()};
+         std::lock_guard<std::mutex> g(instantiate_mutex);
+         entry.module = runtime_interface->instantiate_module((const char*)prepared.code.data(), prepared.code.size(), std::move(prepared.initial_memory));
+         return entry;
+      }
+
+      void compile_async( const digest_type& code_id, bytes code ) {
+         std::shared_ptr<compile_job> job;
+         {
+            std::lock_guard<std::mutex> g(compile_jobs_mutex);
+            if(compile_jobs.count(code_id) || cached_code_ids.count(code_id))
+               return;
+            job = std::make_shared<compile_job>();
+            job->code_size = code.size();
+            compiling_size += job->code_size;
+            job->task = std::packaged_task<wasm_cache_entry()>([this, code_id, code{std::move(code)}]() {
+               return instantiate(code_id, code.data(), code.size());
+            });
+            job->result = job->task.get_future();
+            compile_jobs.emplace(code_id, job);
+         }
+         boost::asio::post(compile_thread, [job]() {
+            job->run();
+         });
+      }
+
+      bool is_compiled_or_compiling( const digest_type& code_id ) {
+         std::lock_guard<std::mutex> g(compile_jobs_mutex);
+         return compile_jobs.count(code_id) || cached_code_ids.count(code_id);
+      }
+
+      // compilations in flight count against the cache limits, the code size stands in for the module size
+      bool can_compile_ahead( size_t code_size ) {
+         std::lock_guard<std::mutex> g(compile_jobs_mutex);
+         if(max_cached_modules && cached_code_ids.size() + compile_jobs.size() >= max_cached_modules)
+            return false;
+         return !max_cached_size || stats.size + compiling_size + code_size <= max_cached_size;
+      }
+
+      // takes the module compiled ahead of time if any, waits for it when the compilation is running
+      // or runs it here when it didn't start yet
+      bool take_compiled( const digest_type& code_id, wasm_cache_entry& entry ) {
+         std::shared_ptr<compile_job> job;
+         {
+            std::lock_guard<std::mutex> g(compile_jobs_mutex);
+            auto it = compile_jobs.find(code_id);
+            if(it == compile_jobs.end())
+               return false;
+            job = it->second;
+            compiling_size -= job->code_size;
+            compile_jobs.erase(it);
+         }
+         job->run();
+         try {
+            entry = job->result.get();
+            return true;
+         } catch(...) {
+            // compiled the same way on the synchronous path, which reports the failure
+            return false;
+         }
+      }
+
+      // moves finished ahead of time compilations to the cache, the caller evicts what is over its limits
+      void adopt_compiled() {
+         std::vector<wasm_cache_entry> ready;
+         {
+            std::lock_guard<std::mutex> g(compile_jobs_mutex);
+            for(auto it = compile_jobs.begin(); it != compile_jobs.end();) {
+               auto& result = it->second->result;
+               if(result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                  ++it;
+                  continue;
+               }
+               try {
+                  ready.emplace_back(result.get());
+               } catch(...) {
+               }
+               compiling_size -= it->second->code_size;
+               it = compile_jobs.erase(it);
+            }
+         }
+         for(auto& entry : ready) {
+            if(!instantiation_cache.get<by_code_id>().count(entry.code_id))
+               insert_cached(std::move(entry));
+         }
+      }
+
+      // the cache may go over its limits here, it is trimmed by current_lib so that freeing modules is not billed
       std::unique_ptr<wasm_instantiated_module_interface>& get_instantiated_module( const digest_type& code_id,
                                                                                     const shared_string& code,
                                                                                     transaction_context& trx_context )
       {
-         auto it = instantiation_cache.find(code_id);
-         if(it == instantiation_cache.end()) {
+         // code executed again after setcode is still in use by some account
+         retired_code.erase(code_id);
+
+         auto& by_id = instantiation_cache.get<by_code_id>();
+         auto it = by_id.find(code_id);
+         if(it != by_id.end()) {
+            ++stats.hits;
+            instantiation_cache.relocate(instantiation_cache.end(), instantiation_cache.project<0>(it));
+            return it->module;
+         }
+
+         ++stats.misses;
+         wasm_cache_entry entry;
+         {
             auto timer_pause = fc::make_scoped_exit([&](){
                trx_context.resume_billing_timer();
             });
             trx_context.pause_billing_timer();
-            IR::Module module;
-            try {
-               Serialization::MemoryInputStream stream((const U8*)code.data(), code.size());
-               WASM::serialize(stream, module);
-               module.userSections.clear();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            }
+            if(take_compiled(code_id, entry))
+               ++stats.compiled_ahead;
+            else
+               entry = instantiate(code_id, code.data(), code.size());
+         }
+         return insert_cached(std::move(entry))->module;
+      }
 
-            wasm_injections::wasm_binary_injection injector(module);
-            injector.inject();
+      wasm_cache_index::iterator insert_cached( wasm_cache_entry&& entry ) {
+         {
+            std::lock_guard<std::mutex> g(compile_jobs_mutex);
+            cached_code_ids.insert(entry.code_id);
+         }
+         stats.size += entry.size;
+         return instantiation_cache.emplace_back(std::move(entry)).first;
+      }
+
+      // evicts least recently used modules, the most recent one is kept even if it alone exceeds the limits
+      void evict_over_limits() {
+         while(instantiation_cache.size() > 1 &&
+               ((max_cached_modules && instantiation_cache.size() > max_cached_modules) ||
+                (max_cached_size && stats.size > max_cached_size))) {
+            erase_cached(instantiation_cache.begin());
+         }
+      }
+
+      // the compile thread holds instantiate_mutex while it injects or instantiates, so the runtime's garbage
+      // collection is skipped then and retried by the next call
+      void release_unused_modules() {
+         if(!release_pending)
+            return;
+         std::unique_lock<std::mutex> g(instantiate_mutex, std::try_to_lock);
+         if(!g.owns_lock())
+            return;
+         runtime_interface->release_unused_modules();
+         release_pending = false;
+      }
+
+      void erase_cached( wasm_cache_index::iterator it ) {
+         {
+            std::lock_guard<std::mutex> g(compile_jobs_mutex);
+            cached_code_ids.erase(it->code_id);
+         }
+         stats.size -= it->size;
+         ++stats.evictions;
+         instantiation_cache.erase(it);
+         release_pending = true;
+      }
+
+      void code_retired( const digest_type& code_id, uint32_t block_num ) {
+         if(instantiation_cache.get<by_code_id>().count(code_id))
+            retired_code[code_id] = block_num;
+      }
 
-            std::vector<U8> bytes;
-            try {
-               Serialization::ArrayOutputStream outstream;
-               WASM::serialize(outstream, module);
-               bytes = outstream.getBytes();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+      void current_lib( uint32_t lib ) {
+         adopt_compiled();
+         evict_over_limits();
+
+         for(auto rit = retired_code.begin(); rit != retired_code.end();) {
+            if(rit->second > lib) {
+               ++rit;
+               continue;
             }
-            it = instantiation_cache.emplace(code_id, runtime_interface->instantiate_module((const char*)bytes.data(), bytes.size(), parse_initial_memory(module))).first;
+            auto& by_id = instantiation_cache.get<by_code_id>();
+            auto it = by_id.find(rit->first);
+            if(it != by_id.end())
+               erase_cached(instantiation_cache.project<0>(it));
+            rit = retired_code.erase(rit);
          }
-         return it->second;
+         release_unused_modules();
+      }
+
+      wasm_interface::cache_stats get_cache_stats()const {
+         auto result = stats;
+         result.modules = instantiation_cache.size();
+         return result;
       }
 
       std::unique_ptr<wasm_runtime_interface> runtime_interface;
-      map<digest_type, std::unique_ptr<wasm_instantiated_module_interface>> instantiation_cache;
+      std::unique_ptr<wasm_disk_cache> disk_cache;
+      wasm_cache_index instantiation_cache;
+      uint32_t max_cached_modules = 0;
+      uint64_t max_cached_size = 0;
+      wasm_interface::cache_stats stats;
+      // code replaced by setcode -> block of the replacement, evicted once the block is irreversible
+      map<digest_type, uint32_t> retired_code;
+      bool release_pending = false; ///< modules were evicted since the runtime last released unused ones
+
+      static std::mutex instantiate_mutex;
+      static std::mutex validate_mutex; ///< the validators keep their state in static members
+      std::mutex compile_jobs_mutex;
+      map<digest_type, std::shared_ptr<compile_job>> compile_jobs;
+      uint64_t compiling_size = 0; ///< code size of compile_jobs, guarded by compile_jobs_mutex
+      set<digest_type> cached_code_ids; ///< keys of instantiation_cache for compile_async, guarded by compile_jobs_mutex
+      // a single thread of its own, so that compilations never hold up the controller's thread pool
+      boost::asio::thread_pool compile_thread{1};
    };
 
 #define _REGISTER_INTRINSIC_EXPLICIT(CLS, MOD, METHOD, WASM_SIG, NAME, SIG)\
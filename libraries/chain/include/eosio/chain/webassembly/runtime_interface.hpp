@@ -20,6 +20,9 @@ class wasm_runtime_interface {
       //immediately exit the currently running wasm_instantiated_module_interface. Yep, this assumes only one can possibly run at a time.
       virtual void immediately_exit_currently_running_module() = 0;
 
+      //frees runtime resources left by destroyed wasm_instantiated_module_interfaces
+      virtual void release_unused_modules() = 0;
+
       virtual ~wasm_runtime_interface();
 };
 
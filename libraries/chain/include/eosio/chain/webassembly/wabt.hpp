@@ -54,6 +54,8 @@ class wabt_runtime : public eosio::chain::wasm_runtime_interface {
 
       void immediately_exit_currently_running_module() override;
 
+      void release_unused_modules() override;
+
    private:
       wabt::ReadBinaryOptions read_binary_options;  //note default ctor will look at each option in feature.def and default to DISABLED for the feature
 };
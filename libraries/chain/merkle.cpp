@@ -32,18 +32,30 @@ bool is_canonical_right(const digest_type& val) {
 }
 
 
-digest_type merkle(vector<digest_type> ids) {
+digest_type merkle(vector<digest_type> ids, sha256_kernel kernel) {
+   static_assert( sizeof(digest_type) == 32, "canonical pairs are hashed straight from the id buffer" );
    if( 0 == ids.size() ) { return digest_type(); }
 
+   vector<sha256_message> pairs;
+   vector<digest_type> parents;
+   pairs.reserve( (ids.size() + 1) / 2 );
+   parents.reserve( (ids.size() + 1) / 2 );
+
    while( ids.size() > 1 ) {
       if( ids.size() % 2 )
          ids.push_back(ids.back());
 
-      for (size_t i = 0; i < ids.size() / 2; i++) {
-         ids[i] = digest_type::hash(make_canonical_pair(ids[2 * i], ids[(2 * i) + 1]));
+      // same bytes as packing make_canonical_pair, without the copies
+      pairs.resize( ids.size() / 2 );
+      for (size_t i = 0; i < pairs.size(); i++) {
+         ids[2 * i] = make_canonical_left(ids[2 * i]);
+         ids[(2 * i) + 1] = make_canonical_right(ids[(2 * i) + 1]);
+         pairs[i] = { (const char*)&ids[2 * i], 2 * sizeof(digest_type) };
       }
 
-      ids.resize(ids.size() / 2);
+      parents.resize( pairs.size() );
+      sha256_batch( pairs.data(), pairs.size(), parents.data(), kernel );
+      ids.swap( parents );
    }
 
    return ids.front();
@@ -0,0 +1,317 @@
+#include <eosio/chain/sha256_batch.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define EOSIO_SHA256_BATCH_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace eosio { namespace chain {
+
+namespace {
+
+   const uint32_t sha256_round_constants[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+   };
+
+   const uint32_t sha256_initial_state[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+   };
+
+   /// full blocks are read in place, the rest of the message and the padding go to tail
+   struct padded_message {
+      const uint8_t* data = nullptr;
+      size_t         full_blocks = 0;
+      size_t         blocks = 0;
+      uint8_t        tail[128];
+
+      explicit padded_message( const sha256_message& m ) {
+         data = (const uint8_t*)m.data;
+         full_blocks = m.size / 64;
+         const size_t rest = m.size % 64;
+         const size_t tail_blocks = rest + 9 > 64 ? 2 : 1;
+         blocks = full_blocks + tail_blocks;
+
+         memset( tail, 0, sizeof(tail) );
+         if( rest )
+            memcpy( tail, data + full_blocks * 64, rest );
+         tail[rest] = 0x80;
+         const uint64_t bits = uint64_t(m.size) * 8;
+         uint8_t* length = tail + tail_blocks * 64 - 8;
+         for( int i = 0; i < 8; ++i )
+            length[i] = uint8_t( bits >> (56 - 8 * i) );
+      }
+
+      const uint8_t* block( size_t i )const {
+         return i < full_blocks ? data + i * 64 : tail + (i - full_blocks) * 64;
+      }
+   };
+
+   void store_digest( const uint32_t state[8], digest_type& out ) {
+      uint8_t* bytes = (uint8_t*)out._hash;
+      for( int i = 0; i < 8; ++i ) {
+         bytes[4 * i]     = uint8_t( state[i] >> 24 );
+         bytes[4 * i + 1] = uint8_t( state[i] >> 16 );
+         bytes[4 * i + 2] = uint8_t( state[i] >> 8 );
+         bytes[4 * i + 3] = uint8_t( state[i] );
+      }
+   }
+
+   void sha256_batch_scalar( const sha256_message* messages, size_t count, digest_type* out ) {
+      for( size_t i = 0; i < count; ++i )
+         out[i] = digest_type::hash( messages[i].data, messages[i].size );
+   }
+
+#ifdef EOSIO_SHA256_BATCH_X86
+
+   bool cpu_supports( sha256_kernel kernel ) {
+      unsigned int eax, ebx, ecx, edx;
+      if( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+         return false;
+      const bool ssse3 = ecx & (1u << 9);
+      const bool sse41 = ecx & (1u << 19);
+      const bool osxsave = ecx & (1u << 27);
+      if( __get_cpuid_max( 0, nullptr ) < 7 )
+         return false;
+      __cpuid_count( 7, 0, eax, ebx, ecx, edx );
+      const bool avx2 = ebx & (1u << 5);
+      const bool sha = ebx & (1u << 29);
+
+      if( kernel == sha256_kernel::shani )
+         return sha && ssse3 && sse41;
+      if( kernel == sha256_kernel::avx2 ) {
+         if( !avx2 || !osxsave )
+            return false;
+         // the OS has to save the ymm registers
+         uint32_t xcr0_lo, xcr0_hi;
+         __asm__( "xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0) );
+         return (xcr0_lo & 0x6) == 0x6;
+      }
+      return true;
+   }
+
+   __attribute__((target("sha,sse4.1")))
+   void compress_shani( uint32_t state[8], const uint8_t* data, size_t blocks ) {
+      const __m128i byte_swap = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL );
+
+      // the sha256rnds2 instruction works on ABEF and CDGH halves of the state
+      __m128i tmp = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)&state[0] ), 0xB1 );
+      __m128i state1 = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*)&state[4] ), 0x1B );
+      __m128i state0 = _mm_alignr_epi8( tmp, state1, 8 );
+      state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+      for( ; blocks; --blocks, data += 64 ) {
+         const __m128i abef = state0;
+         const __m128i cdgh = state1;
+         __m128i w[16];
+         for( int i = 0; i < 16; ++i ) {
+            if( i < 4 ) {
+               w[i] = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)(data + 16 * i) ), byte_swap );
+            } else {
+               const __m128i w7 = _mm_alignr_epi8( w[i - 1], w[i - 2], 4 );
+               w[i] = _mm_sha256msg2_epu32( _mm_add_epi32( _mm_sha256msg1_epu32( w[i - 4], w[i - 3] ), w7 ), w[i - 1] );
+            }
+            __m128i msg = _mm_add_epi32( w[i], _mm_loadu_si128( (const __m128i*)&sha256_round_constants[4 * i] ) );
+            state1 = _mm_sha256rnds2_epu32( state1, state0, msg );
+            msg = _mm_shuffle_epi32( msg, 0x0E );
+            state0 = _mm_sha256rnds2_epu32( state0, state1, msg );
+         }
+         state0 = _mm_add_epi32( state0, abef );
+         state1 = _mm_add_epi32( state1, cdgh );
+      }
+
+      tmp = _mm_shuffle_epi32( state0, 0x1B );
+      state1 = _mm_shuffle_epi32( state1, 0xB1 );
+      state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+      state1 = _mm_alignr_epi8( state1, tmp, 8 );
+      _mm_storeu_si128( (__m128i*)&state[0], state0 );
+      _mm_storeu_si128( (__m128i*)&state[4], state1 );
+   }
+
+   void sha256_batch_shani( const sha256_message* messages, size_t count, digest_type* out ) {
+      for( size_t i = 0; i < count; ++i ) {
+         padded_message m( messages[i] );
+         uint32_t state[8];
+         memcpy( state, sha256_initial_state, sizeof(state) );
+         compress_shani( state, m.data, m.full_blocks );
+         compress_shani( state, m.tail, m.blocks - m.full_blocks );
+         store_digest( state, out[i] );
+      }
+   }
+
+#define SHA256_AVX2_ROTR(x, n) _mm256_or_si256( _mm256_srli_epi32( x, n ), _mm256_slli_epi32( x, 32 - (n) ) )
+#define SHA256_AVX2_LOAD(p, t) int( __builtin_bswap32( load_u32( (p) + 4 * (t) ) ) )
+
+   inline uint32_t load_u32( const uint8_t* p ) {
+      uint32_t v;
+      memcpy( &v, p, sizeof(v) );
+      return v;
+   }
+
+   /// one block of each of the eight lanes, lane i is the i-th 32 bit element of every state word
+   __attribute__((target("avx2")))
+   void compress_avx2( __m256i state[8], const uint8_t* const blocks[8] ) {
+      __m256i w[64];
+      for( int t = 0; t < 16; ++t ) {
+         w[t] = _mm256_set_epi32( SHA256_AVX2_LOAD(blocks[7], t), SHA256_AVX2_LOAD(blocks[6], t),
+                                  SHA256_AVX2_LOAD(blocks[5], t), SHA256_AVX2_LOAD(blocks[4], t),
+                                  SHA256_AVX2_LOAD(blocks[3], t), SHA256_AVX2_LOAD(blocks[2], t),
+                                  SHA256_AVX2_LOAD(blocks[1], t), SHA256_AVX2_LOAD(blocks[0], t) );
+      }
+      for( int t = 16; t < 64; ++t ) {
+         const __m256i s0 = _mm256_xor_si256( _mm256_xor_si256( SHA256_AVX2_ROTR(w[t - 15], 7), SHA256_AVX2_ROTR(w[t - 15], 18) ),
+                                              _mm256_srli_epi32( w[t - 15], 3 ) );
+         const __m256i s1 = _mm256_xor_si256( _mm256_xor_si256( SHA256_AVX2_ROTR(w[t - 2], 17), SHA256_AVX2_ROTR(w[t - 2], 19) ),
+                                              _mm256_srli_epi32( w[t - 2], 10 ) );
+         w[t] = _mm256_add_epi32( _mm256_add_epi32( w[t - 16], s0 ), _mm256_add_epi32( w[t - 7], s1 ) );
+      }
+
+      __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+      __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+      for( int t = 0; t < 64; ++t ) {
+         const __m256i s1 = _mm256_xor_si256( _mm256_xor_si256( SHA256_AVX2_ROTR(e, 6), SHA256_AVX2_ROTR(e, 11) ), SHA256_AVX2_ROTR(e, 25) );
+         const __m256i ch = _mm256_xor_si256( _mm256_and_si256( e, f ), _mm256_andnot_si256( e, g ) );
+         const __m256i k = _mm256_set1_epi32( int( sha256_round_constants[t] ) );
+         const __m256i t1 = _mm256_add_epi32( _mm256_add_epi32( _mm256_add_epi32( h, s1 ), _mm256_add_epi32( ch, k ) ), w[t] );
+         const __m256i s0 = _mm256_xor_si256( _mm256_xor_si256( SHA256_AVX2_ROTR(a, 2), SHA256_AVX2_ROTR(a, 13) ), SHA256_AVX2_ROTR(a, 22) );
+         const __m256i maj = _mm256_xor_si256( _mm256_and_si256( a, _mm256_xor_si256( b, c ) ), _mm256_and_si256( b, c ) );
+         const __m256i t2 = _mm256_add_epi32( s0, maj );
+         h = g; g = f; f = e;
+         e = _mm256_add_epi32( d, t1 );
+         d = c; c = b; b = a;
+         a = _mm256_add_epi32( t1, t2 );
+      }
+
+      state[0] = _mm256_add_epi32( state[0], a );
+      state[1] = _mm256_add_epi32( state[1], b );
+      state[2] = _mm256_add_epi32( state[2], c );
+      state[3] = _mm256_add_epi32( state[3], d );
+      state[4] = _mm256_add_epi32( state[4], e );
+      state[5] = _mm256_add_epi32( state[5], f );
+      state[6] = _mm256_add_epi32( state[6], g );
+      state[7] = _mm256_add_epi32( state[7], h );
+   }
+
+#undef SHA256_AVX2_LOAD
+#undef SHA256_AVX2_ROTR
+
+   /// hashes up to eight messages, lanes which ran out of blocks keep hashing a zero block until the longest one is done
+   __attribute__((target("avx2")))
+   void hash_lanes_avx2( const padded_message* const lanes[8], size_t used, digest_type* const outs[8] ) {
+      static const uint8_t zero_block[64] = {};
+
+      __m256i state[8];
+      for( int i = 0; i < 8; ++i )
+         state[i] = _mm256_set1_epi32( int( sha256_initial_state[i] ) );
+
+      size_t max_blocks = 0;
+      for( size_t l = 0; l < used; ++l )
+         max_blocks = std::max( max_blocks, lanes[l]->blocks );
+
+      for( size_t b = 0; b < max_blocks; ++b ) {
+         const uint8_t* blocks[8];
+         for( size_t l = 0; l < 8; ++l )
+            blocks[l] = l < used && b < lanes[l]->blocks ? lanes[l]->block( b ) : zero_block;
+         compress_avx2( state, blocks );
+
+         for( size_t l = 0; l < used; ++l ) {
+            if( lanes[l]->blocks != b + 1 )
+               continue;
+            alignas(32) uint32_t words[8][8];
+            for( int i = 0; i < 8; ++i )
+               _mm256_store_si256( (__m256i*)words[i], state[i] );
+            uint32_t lane_state[8];
+            for( int i = 0; i < 8; ++i )
+               lane_state[i] = words[i][l];
+            store_digest( lane_state, *outs[l] );
+         }
+      }
+   }
+
+   void sha256_batch_avx2( const sha256_message* messages, size_t count, digest_type* out ) {
+      std::vector<padded_message> padded;
+      padded.reserve( count );
+      for( size_t i = 0; i < count; ++i )
+         padded.emplace_back( messages[i] );
+
+      // lanes of similar length waste fewer rounds on zero blocks
+      std::vector<size_t> order( count );
+      std::iota( order.begin(), order.end(), 0 );
+      std::stable_sort( order.begin(), order.end(), [&]( size_t l, size_t r ) {
+         return padded[l].blocks < padded[r].blocks;
+      } );
+
+      for( size_t first = 0; first < count; first += 8 ) {
+         const size_t used = std::min<size_t>( 8, count - first );
+         const padded_message* lanes[8] = {};
+         digest_type* outs[8] = {};
+         for( size_t l = 0; l < used; ++l ) {
+            lanes[l] = &padded[order[first + l]];
+            outs[l] = &out[order[first + l]];
+         }
+         hash_lanes_avx2( lanes, used, outs );
+      }
+   }
+
+#else
+
+   bool cpu_supports( sha256_kernel kernel ) {
+      return kernel == sha256_kernel::scalar;
+   }
+
+#endif
+
+} /// namespace
+
+bool sha256_kernel_supported( sha256_kernel kernel ) {
+   static const bool avx2 = cpu_supports( sha256_kernel::avx2 );
+   static const bool shani = cpu_supports( sha256_kernel::shani );
+   switch( kernel ) {
+      case sha256_kernel::avx2:  return avx2;
+      case sha256_kernel::shani: return shani;
+      default:                   return true;
+   }
+}
+
+sha256_kernel sha256_best_kernel() {
+   if( sha256_kernel_supported( sha256_kernel::shani ) )
+      return sha256_kernel::shani;
+   if( sha256_kernel_supported( sha256_kernel::avx2 ) )
+      return sha256_kernel::avx2;
+   return sha256_kernel::scalar;
+}
+
+const char* sha256_kernel_name( sha256_kernel kernel ) {
+   switch( kernel ) {
+      case sha256_kernel::avx2:  return "avx2";
+      case sha256_kernel::shani: return "sha-ni";
+      default:                   return "scalar";
+   }
+}
+
+void sha256_batch( const sha256_message* messages, size_t count, digest_type* out, sha256_kernel kernel ) {
+   if( !sha256_kernel_supported( kernel ) )
+      kernel = sha256_kernel::scalar;
+#ifdef EOSIO_SHA256_BATCH_X86
+   if( kernel == sha256_kernel::shani )
+      return sha256_batch_shani( messages, count, out );
+   // a partly filled group of lanes costs as much as a full one
+   if( kernel == sha256_kernel::avx2 && count >= 4 )
+      return sha256_batch_avx2( messages, count, out );
+#endif
+   sha256_batch_scalar( messages, count, out );
+}
+
+} } /// eosio::chain
@@ -0,0 +1,117 @@
+#include <eosio/chain/wasm_disk_cache.hpp>
+#include <eosio/chain/wasm_eosio_injection.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <fc/io/raw.hpp>
+#include <fstream>
+
+namespace eosio { namespace chain {
+
+   const uint32_t wasm_disk_cache::format_version = 1;
+
+   namespace detail {
+      struct wasm_disk_cache_file {
+         uint32_t              format_version = 0;
+         uint32_t              injection_version = 0;
+         digest_type           code_id;
+         std::vector<uint8_t>  code;
+         std::vector<uint8_t>  initial_memory;
+         digest_type           checksum;
+
+         digest_type compute_checksum()const {
+            digest_type::encoder enc;
+            fc::raw::pack( enc, format_version );
+            fc::raw::pack( enc, injection_version );
+            fc::raw::pack( enc, code_id );
+            fc::raw::pack( enc, code );
+            fc::raw::pack( enc, initial_memory );
+            return enc.result();
+         }
+      };
+   }
+
+} } // eosio::chain
+
+FC_REFLECT( eosio::chain::detail::wasm_disk_cache_file, (format_version)(injection_version)(code_id)(code)(initial_memory)(checksum) )
+
+namespace eosio { namespace chain {
+
+   wasm_disk_cache::wasm_disk_cache( const fc::path& dir )
+   :dir(dir)
+   {
+      if( !fc::is_directory( dir ) )
+         fc::create_directories( dir );
+   }
+
+   fc::path wasm_disk_cache::file_path( const digest_type& code_id )const {
+      return dir / (code_id.str() + ".wasm");
+   }
+
+   bool wasm_disk_cache::load( const digest_type& code_id, entry& result )const {
+      std::lock_guard<std::mutex> g( mtx );
+      const auto path = file_path( code_id );
+      if( !fc::exists( path ) )
+         return false;
+
+      try {
+         std::ifstream in( path.generic_string(), std::ios::in | std::ios::binary );
+         std::vector<char> data( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
+         EOS_ASSERT( in.good() || in.eof(), wasm_exception, "failed to read ${p}", ("p", path.generic_string()) );
+
+         auto file = fc::raw::unpack<detail::wasm_disk_cache_file>( data );
+         if( file.format_version == format_version &&
+             file.injection_version == wasm_injections::injection_version &&
+             file.code_id == code_id &&
+             file.checksum == file.compute_checksum() ) {
+            result.code = std::move( file.code );
+            result.initial_memory = std::move( file.initial_memory );
+            return true;
+         }
+         ilog( "discarding stale wasm cache entry ${p}", ("p", path.generic_string()) );
+      } catch( const fc::exception& e ) {
+         wlog( "discarding corrupted wasm cache entry ${p}: ${e}", ("p", path.generic_string())("e", e.to_detail_string()) );
+      } catch( const std::exception& e ) {
+         wlog( "discarding corrupted wasm cache entry ${p}: ${e}", ("p", path.generic_string())("e", e.what()) );
+      }
+
+      boost::system::error_code ec;
+      boost::filesystem::remove( path, ec );
+      return false;
+   }
+
+   void wasm_disk_cache::store( const digest_type& code_id, const entry& e ) {
+      detail::wasm_disk_cache_file file;
+      file.format_version = format_version;
+      file.injection_version = wasm_injections::injection_version;
+      file.code_id = code_id;
+      file.code = e.code;
+      file.initial_memory = e.initial_memory;
+      file.checksum = file.compute_checksum();
+      auto data = fc::raw::pack( file );
+
+      std::lock_guard<std::mutex> g( mtx );
+      const auto path = file_path( code_id );
+      const auto tmp_path = fc::path( path.generic_string() + ".tmp" );
+      try {
+         {
+            std::ofstream out( tmp_path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+            out.write( data.data(), data.size() );
+            out.close();
+            EOS_ASSERT( out.good(), wasm_exception, "failed to write ${p}", ("p", tmp_path.generic_string()) );
+         }
+         // rename is atomic, a crash never leaves a partially written entry behind
+         fc::rename( tmp_path, path );
+      } catch( const fc::exception& ex ) {
+         // the cache is an optimization only, code is prepared again next time
+         wlog( "failed to store wasm cache entry ${p}: ${e}", ("p", path.generic_string())("e", ex.to_detail_string()) );
+         boost::system::error_code ec;
+         boost::filesystem::remove( tmp_path, ec );
+      }
+   }
+
+   void wasm_disk_cache::remove( const digest_type& code_id ) {
+      std::lock_guard<std::mutex> g( mtx );
+      boost::system::error_code ec;
+      boost::filesystem::remove( file_path( code_id ), ec );
+   }
+
+} } // eosio::chain
@@ -30,11 +30,18 @@ namespace eosio { namespace chain {
    using namespace webassembly;
    using namespace webassembly::common;
 
-   wasm_interface::wasm_interface(vm_type vm) : my( new wasm_interface_impl(vm) ) {}
+   std::mutex wasm_interface_impl::instantiate_mutex;
+   std::mutex wasm_interface_impl::validate_mutex;
+
+   wasm_interface::wasm_interface(vm_type vm, const fc::path& cache_dir) : my( new wasm_interface_impl(vm, cache_dir) ) {}
 
    wasm_interface::~wasm_interface() {}
 
    void wasm_interface::validate(const controller& control, const bytes& code) {
+      validate(code, control.is_producing_block());
+   }
+
+   void wasm_interface::validate(const bytes& code, bool producing_block) {
       Module module;
       try {
          Serialization::MemoryInputStream stream((U8*)code.data(), code.size());
@@ -45,8 +52,11 @@ namespace eosio { namespace chain {
          EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
       }
 
-      wasm_validations::wasm_binary_validation validator(control, module);
-      validator.validate();
+      {
+         std::lock_guard<std::mutex> g(wasm_interface_impl::validate_mutex);
+         wasm_validations::wasm_binary_validation validator(producing_block, module);
+         validator.validate();
+      }
 
       root_resolver resolver(true);
       LinkResult link_result = linkModule(module, resolver);
@@ -64,6 +74,37 @@ namespace eosio { namespace chain {
       my->runtime_interface->immediately_exit_currently_running_module();
    }
 
+   void wasm_interface::set_cache_limits( uint32_t max_modules, uint64_t max_size ) {
+      my->max_cached_modules = max_modules;
+      my->max_cached_size = max_size;
+      my->evict_over_limits();
+      my->release_unused_modules();
+   }
+
+   void wasm_interface::code_retired( const digest_type& code_id, uint32_t block_num ) {
+      my->code_retired(code_id, block_num);
+   }
+
+   void wasm_interface::current_lib( uint32_t lib ) {
+      my->current_lib(lib);
+   }
+
+   void wasm_interface::compile_async( const digest_type& code_id, bytes code ) {
+      my->compile_async(code_id, std::move(code));
+   }
+
+   bool wasm_interface::is_compiled_or_compiling( const digest_type& code_id )const {
+      return my->is_compiled_or_compiling(code_id);
+   }
+
+   bool wasm_interface::can_compile_ahead( size_t code_size )const {
+      return my->can_compile_ahead(code_size);
+   }
+
+   wasm_interface::cache_stats wasm_interface::get_cache_stats()const {
+      return my->get_cache_stats();
+   }
+
    wasm_instantiated_module_interface::~wasm_instantiated_module_interface() {}
    wasm_runtime_interface::~wasm_runtime_interface() {}
 
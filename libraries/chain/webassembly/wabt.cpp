@@ -45,8 +45,13 @@ class wabt_instantiated_module : public wasm_instantiated_module_interface {
          if(_env->GetMemoryCount()) {
             Memory* memory = this_run_vars.memory = _env->GetMemory(0);
             memory->page_limits = _initial_memory_configuration;
+            //bytes added by resize are already zero and the initial data is copied over its own range,
+            //so only the rest of the previously used memory is cleared
+            const size_t used_size = memory->data.size();
             memory->data.resize(_initial_memory_configuration.initial * WABT_PAGE_SIZE);
-            memset(memory->data.data(), 0, memory->data.size());
+            const size_t clear_end = std::min(used_size, memory->data.size());
+            if(clear_end > _initial_memory.size())
+               memset(memory->data.data() + _initial_memory.size(), 0, clear_end - _initial_memory.size());
             memcpy(memory->data.data(), _initial_memory.data(), _initial_memory.size());
          }
 
@@ -100,4 +105,8 @@ void wabt_runtime::immediately_exit_currently_running_module() {
    throw wasm_exit();
 }
 
+void wabt_runtime::release_unused_modules() {
+   //wabt_instantiated_module owns its environment, nothing is left behind
+}
+
 }}}}
@@ -13,6 +13,7 @@
 #include "Runtime/Intrinsics.h"
 
 #include <mutex>
+#include <set>
 
 using namespace IR;
 using namespace Runtime;
@@ -21,13 +22,25 @@ namespace eosio { namespace chain { namespace webassembly { namespace wavm {
 
 running_instance_context the_running_instance_context;
 
+//module instances of all live wavm_instantiated_modules, roots for WAVM's object garbage collection
+static std::set<ModuleInstance*> __live_module_instances;
+static std::mutex __live_module_instances_lock;
+
 class wavm_instantiated_module : public wasm_instantiated_module_interface {
    public:
       wavm_instantiated_module(ModuleInstance* instance, std::unique_ptr<Module> module, std::vector<uint8_t> initial_mem) :
          _initial_memory(initial_mem),
          _instance(instance),
          _module(std::move(module))
-      {}
+      {
+         std::lock_guard<std::mutex> l(__live_module_instances_lock);
+         __live_module_instances.insert(_instance);
+      }
+
+      ~wavm_instantiated_module() {
+         std::lock_guard<std::mutex> l(__live_module_instances_lock);
+         __live_module_instances.erase(_instance);
+      }
 
       void apply(apply_context& context) override {
          vector<Value> args = {Value(uint64_t(context.receiver)),
@@ -76,7 +89,8 @@ class wavm_instantiated_module : public wasm_instantiated_module_interface {
 
       std::vector<uint8_t>     _initial_memory;
       //naked pointer because ModuleInstance is opaque
-      //_instance is deleted via WAVM's object garbage collection when wavm_rutime is deleted
+      //_instance is deleted via WAVM's object garbage collection, either on release_unused_modules()
+      //after it was destroyed or when wavm_rutime is deleted
       ModuleInstance*          _instance;
       std::unique_ptr<Module>  _module;
 };
@@ -127,6 +141,14 @@ std::unique_ptr<wasm_instantiated_module_interface> wavm_runtime::instantiate_mo
    return std::make_unique<wavm_instantiated_module>(instance, std::move(module), initial_memory);
 }
 
+void wavm_runtime::release_unused_modules() {
+   std::lock_guard<std::mutex> l(__live_module_instances_lock);
+   std::vector<ObjectInstance*> roots;
+   for(ModuleInstance* instance : __live_module_instances)
+      roots.push_back(asObject(instance));
+   Runtime::freeUnreferencedObjects(std::move(roots));
+}
+
 void wavm_runtime::immediately_exit_currently_running_module() {
 #ifdef _WIN32
    throw wasm_exit();
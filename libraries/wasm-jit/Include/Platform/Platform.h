@@ -90,6 +90,11 @@ namespace Platform
 	// baseVirtualAddress must be a multiple of the preferred page size.
 	PLATFORM_API void decommitVirtualPages(U8* baseVirtualAddress,Uptr numPages);
 
+	// Discards the contents of committed virtual pages, they stay committed and read as zero afterwards.
+	// On Linux only pages that were actually touched cost anything to discard, elsewhere the pages are cleared.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	PLATFORM_API void resetVirtualPages(U8* baseVirtualAddress,Uptr numPages);
+
 	// Frees virtual addresses. Any physical memory committed to the addresses must have already been decommitted.
 	// baseVirtualAddress must be a multiple of the preferred page size.
 	PLATFORM_API void freeVirtualPages(U8* baseVirtualAddress,Uptr numPages);
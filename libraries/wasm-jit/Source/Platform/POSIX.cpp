@@ -101,6 +101,18 @@ namespace Platform
 		if(mprotect(baseVirtualAddress,numBytes,PROT_NONE)) { Errors::fatal("mprotect failed"); }
 	}
 
+	void resetVirtualPages(U8* baseVirtualAddress,Uptr numPages)
+	{
+		errorUnless(isPageAligned(baseVirtualAddress));
+		#ifdef __linux__
+			// private anonymous pages are zero filled on the next access
+			if(madvise(baseVirtualAddress,numPages << getPageSizeLog2(),MADV_DONTNEED)) { Errors::fatal("madvise failed"); }
+		#else
+			// MADV_DONTNEED is only a hint elsewhere, the old contents may still be read back
+			memset(baseVirtualAddress,0,numPages << getPageSizeLog2());
+		#endif
+	}
+
 	void freeVirtualPages(U8* baseVirtualAddress,Uptr numPages)
 	{
 		errorUnless(isPageAligned(baseVirtualAddress));
@@ -3,6 +3,8 @@
 #include "Platform/Platform.h"
 #include "RuntimePrivate.h"
 
+#include <algorithm>
+
 namespace Runtime
 {
 	// Global lists of memories; used to query whether an address is reserved by one of them.
@@ -89,14 +91,39 @@ namespace Runtime
 	}
 
 	void resetMemory(MemoryInstance* memory, MemoryType& newMemoryType) {
-		memory->type.size.min = 1;
-		if(shrinkMemory(memory, memory->numPages - 1) == -1)
-			causeException(Exception::Cause::outOfMemory);
-		memset(memory->baseAddress, 0, 1<<IR::numBytesPerPageLog2);
+		const Uptr previousNumPages = memory->numPages;
+		const Uptr newNumPages = Uptr(newMemoryType.size.min);
+		if(previousNumPages > newNumPages)
+		{
+			Platform::decommitVirtualPages(
+				memory->baseAddress + (newNumPages << IR::numBytesPerPageLog2),
+				(previousNumPages - newNumPages) << getPlatformPagesPerWebAssemblyPageLog2()
+				);
+		}
+		else if(previousNumPages < newNumPages)
+		{
+			if(!Platform::commitVirtualPages(
+				memory->baseAddress + (previousNumPages << IR::numBytesPerPageLog2),
+				(newNumPages - previousNumPages) << getPlatformPagesPerWebAssemblyPageLog2()
+				))
+			{
+				causeException(Exception::Cause::outOfMemory);
+			}
+			#ifndef __linux__
+			// decommitted pages are only guaranteed to read as zero on Linux
+			memset(memory->baseAddress + (previousNumPages << IR::numBytesPerPageLog2), 0, (newNumPages - previousNumPages) << IR::numBytesPerPageLog2);
+			#endif
+		}
+
+		// A single page is cheaper to clear than to discard and fault in again. Larger memories are discarded,
+		// so the reset costs the pages touched since the previous reset rather than the whole memory.
+		const Uptr keptNumPages = std::min(previousNumPages, newNumPages);
+		if(keptNumPages == 1) { memset(memory->baseAddress, 0, Uptr(1) << IR::numBytesPerPageLog2); }
+		else if(keptNumPages > 1) { Platform::resetVirtualPages(memory->baseAddress, keptNumPages << getPlatformPagesPerWebAssemblyPageLog2()); }
+
+		memory->numPages = newNumPages;
 		memory->type = newMemoryType;
-		if(growMemory(memory, memory->type.size.min - 1) == -1)
-			causeException(Exception::Cause::outOfMemory);
-   }
+	}
 
 	Iptr growMemory(MemoryInstance* memory,Uptr numNewPages)
 	{
@@ -114,7 +141,11 @@ namespace Runtime
 			{
 				return -1;
 			}
+			#ifndef __linux__
+			// decommitted pages are only guaranteed to read as zero on Linux
 			memset(memory->baseAddress + (memory->numPages << IR::numBytesPerPageLog2), 0, numNewPages << IR::numBytesPerPageLog2);
+			#endif
+			// on Linux pages past the end were never committed or were decommitted by shrinkMemory, so they already read as zero
 			memory->numPages += numNewPages;
 		}
 		return previousNumPages;
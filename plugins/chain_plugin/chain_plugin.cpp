@@ -210,12 +210,26 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "the location of the blocks directory (absolute path or relative to application data dir)")
          ("checkpoint", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
          ("wasm-runtime", bpo::value<eosio::chain::wasm_interface::vm_type>()->value_name("wavm/wabt"), "Override default WASM runtime")
+         ("disable-wasm-disk-cache", bpo::bool_switch()->default_value(false),
+          "Do not keep prepared contract code in the wasm-cache directory of the application data dir")
+         ("wasm-cache-max-modules", bpo::value<uint32_t>()->default_value(config::default_wasm_cache_max_modules),
+          "Maximum number of instantiated contracts kept in memory, 0 for no limit")
+         ("wasm-cache-max-size-mb", bpo::value<uint64_t>()->default_value(config::default_wasm_cache_max_size / (1024  * 1024)),
+          "Maximum size (in MiB) of prepared code and initial memory of instantiated contracts kept in memory, 0 for no limit")
          ("abi-serializer-max-time-ms", bpo::value<uint32_t>()->default_value(config::default_abi_serializer_max_time_ms),
           "Override default maximum ABI serialization time allowed in ms")
          ("chain-state-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_size / (1024  * 1024)), "Maximum size (in MiB) of the chain state database")
          ("chain-state-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the chain state database drops below this size (in MiB).")
          ("reversible-blocks-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_cache_size / (1024  * 1024)), "Maximum size (in MiB) of the reversible blocks database")
          ("reversible-blocks-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the reverseible blocks database drops below this size (in MiB).")
+         ("block-log-queue-size", bpo::value<uint32_t>()->default_value(config::default_block_log_queue_size),
+          "Number of irreversible blocks queued for the block log appender thread, 0 to append on the main thread")
+         ("block-log-fsync", bpo::bool_switch()->default_value(false),
+          "fsync the block log and its index after every group of appended blocks")
+         ("replay-lookahead-blocks", bpo::value<uint32_t>()->default_value(config::default_replay_lookahead_blocks),
+          "Number of blocks read, unpacked and signature recovered on the chain threads ahead of the block being replayed")
+         ("sync-lookahead-blocks", bpo::value<uint32_t>()->default_value(config::default_sync_lookahead_blocks),
+          "Number of blocks received while syncing whose signatures are verified on the chain threads ahead of being applied, 0 to disable")
          ("signature-cpu-billable-pct", bpo::value<uint32_t>()->default_value(config::default_sig_cpu_bill_pct / config::percent_1),
           "Percentage of actual signature recovery cpu to bill. Whole number percentages, e.g. 50 for 50%")
          ("chain-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
@@ -405,6 +419,14 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
 
       my->chain_config->blocks_dir = my->blocks_dir;
       my->chain_config->state_dir = app().data_dir() / config::default_state_dir_name;
+      if( !options.at( "disable-wasm-disk-cache" ).as<bool>() )
+         my->chain_config->wasm_cache_dir = app().data_dir() / config::default_wasm_cache_dir_name;
+
+      if( options.count( "wasm-cache-max-modules" ))
+         my->chain_config->wasm_cache_max_modules = options.at( "wasm-cache-max-modules" ).as<uint32_t>();
+
+      if( options.count( "wasm-cache-max-size-mb" ))
+         my->chain_config->wasm_cache_max_size = options.at( "wasm-cache-max-size-mb" ).as<uint64_t>() * 1024 * 1024;
       my->chain_config->read_only = my->readonly;
 
       if( options.count( "chain-state-db-size-mb" ))
@@ -420,6 +442,19 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       if( options.count( "reversible-blocks-db-guard-size-mb" ))
          my->chain_config->reversible_guard_size = options.at( "reversible-blocks-db-guard-size-mb" ).as<uint64_t>() * 1024 * 1024;
 
+      if( options.count( "block-log-queue-size" ))
+         my->chain_config->block_log_queue_size = options.at( "block-log-queue-size" ).as<uint32_t>();
+      my->chain_config->block_log_fsync = options.at( "block-log-fsync" ).as<bool>();
+
+      if( options.count( "replay-lookahead-blocks" )) {
+         my->chain_config->replay_lookahead_blocks = options.at( "replay-lookahead-blocks" ).as<uint32_t>();
+         EOS_ASSERT( my->chain_config->replay_lookahead_blocks > 0, plugin_config_exception,
+                     "replay-lookahead-blocks ${num} must be greater than 0", ("num", my->chain_config->replay_lookahead_blocks) );
+      }
+
+      if( options.count( "sync-lookahead-blocks" ))
+         my->chain_config->sync_lookahead_blocks = options.at( "sync-lookahead-blocks" ).as<uint32_t>();
+
       if( options.count( "chain-threads" )) {
          my->chain_config->thread_pool_size = options.at( "chain-threads" ).as<uint16_t>();
          EOS_ASSERT( my->chain_config->thread_pool_size > 0, plugin_config_exception,
@@ -45,6 +45,7 @@ namespace eosio {
 
    using fc::time_point;
    using fc::time_point_sec;
+   using eosio::chain::block_log;
    using eosio::chain::transaction_id_type;
 
    class connection;
@@ -181,6 +182,7 @@ namespace eosio {
        * encountered unpacking or processing the message.
        */
       bool process_next_message(const connection_ptr& conn, uint32_t message_length);
+      void prefetch_buffered_blocks(const connection_ptr& conn);
 
       void close(const connection_ptr& c);
       size_t count_open_sockets() const;
@@ -436,14 +438,15 @@ namespace eosio {
       }
 
       bool add_write_queue( const std::shared_ptr<vector<char>>& buff,
+                            const block_log::mapped_block& body,
                             std::function<void( boost::system::error_code, std::size_t )> callback,
                             bool to_sync_queue ) {
          if( to_sync_queue ) {
-            _sync_write_queue.push_back( {buff, callback} );
+            _sync_write_queue.push_back( {buff, body, callback} );
          } else {
-            _write_queue.push_back( {buff, callback} );
+            _write_queue.push_back( {buff, body, callback} );
          }
-         _write_queue_size += buff->size();
+         _write_queue_size += buff->size() + body.size;
          if( _write_queue_size > 2 * def_max_write_queue_size ) {
             return false;
          }
@@ -472,7 +475,9 @@ namespace eosio {
          while ( w_queue.size() > 0 ) {
             auto& m = w_queue.front();
             bufs.push_back( boost::asio::buffer( *m.buff ));
-            _write_queue_size -= m.buff->size();
+            if( m.body )
+               bufs.push_back( boost::asio::buffer( m.body.data, m.body.size ));
+            _write_queue_size -= m.buff->size() + m.body.size;
             _out_queue.emplace_back( m );
             w_queue.pop_front();
          }
@@ -481,6 +486,7 @@ namespace eosio {
    private:
       struct queued_write {
          std::shared_ptr<vector<char>> buff;
+         block_log::mapped_block       body; // sent right after buff, straight from the block log mapping
          std::function<void( boost::system::error_code, std::size_t )> callback;
       };
 
@@ -509,6 +515,8 @@ namespace eosio {
 
       fc::message_buffer<1024*1024>    pending_message_buffer;
       fc::optional<std::size_t>        outstanding_read_bytes;
+      /// blocks of the buffered messages unpacked ahead while syncing, in message order
+      std::deque<std::pair<block_id_type, signed_block_ptr>> lookahead_blocks;
 
 
       queued_buffer           buffer_queue;
@@ -599,9 +607,11 @@ namespace eosio {
 
       void enqueue( const net_message &msg, bool trigger_send = true );
       void enqueue_block( const signed_block_ptr& sb, bool trigger_send = true, bool to_sync_queue = false);
+      void enqueue_mapped_block( const block_log::mapped_block& mb, bool trigger_send, bool to_sync_queue );
       void enqueue_buffer( const std::shared_ptr<std::vector<char>>& send_buffer,
                            bool trigger_send, int priority, go_away_reason close_after_send,
-                           bool to_sync_queue = false);
+                           bool to_sync_queue = false,
+                           const block_log::mapped_block& body = block_log::mapped_block() );
       void cancel_sync(go_away_reason);
       void flush_queues();
       bool enqueue_sync_block();
@@ -614,6 +624,7 @@ namespace eosio {
       void fetch_timeout(boost::system::error_code ec);
 
       void queue_write(const std::shared_ptr<vector<char>>& buff,
+                       const block_log::mapped_block& body,
                        bool trigger_send,
                        int priority,
                        std::function<void(boost::system::error_code, std::size_t)> callback,
@@ -945,11 +956,12 @@ namespace eosio {
    }
 
    void connection::queue_write(const std::shared_ptr<vector<char>>& buff,
+                                const block_log::mapped_block& body,
                                 bool trigger_send,
                                 int priority,
                                 std::function<void(boost::system::error_code, std::size_t)> callback,
                                 bool to_sync_queue) {
-      if( !buffer_queue.add_write_queue( buff, callback, to_sync_queue )) {
+      if( !buffer_queue.add_write_queue( buff, body, callback, to_sync_queue )) {
          fc_wlog( logger, "write_queue full ${s} bytes, giving up on connection ${p}",
                   ("s", buffer_queue.write_queue_size())("p", peer_name()) );
          my_impl->close( shared_from_this() );
@@ -1044,6 +1056,12 @@ namespace eosio {
       }
       try {
          controller& cc = my_impl->chain_plug->chain();
+         // irreversible blocks go out as they are stored, without unpacking and packing them again
+         auto mb = cc.fetch_mapped_block_by_number(num);
+         if(mb) {
+            enqueue_mapped_block( mb, trigger_send, true );
+            return true;
+         }
          signed_block_ptr sb = cc.fetch_block_by_number(num);
          if(sb) {
             enqueue_block( sb, trigger_send, true);
@@ -1135,12 +1153,30 @@ namespace eosio {
       enqueue_buffer( create_send_buffer( sb ), trigger_send, priority::low, no_reason, to_sync_queue);
    }
 
+   void connection::enqueue_mapped_block( const block_log::mapped_block& mb, bool trigger_send, bool to_sync_queue ) {
+      // only the message header is built here, the packed block is written from the mapping
+      const uint32_t which_size = fc::raw::pack_size( unsigned_int( signed_block_which ) );
+      const uint32_t payload_size = which_size + mb.size;
+
+      const char* const header = reinterpret_cast<const char* const>(&payload_size); // avoid variable size encoding of uint32_t
+      constexpr size_t header_size = sizeof( payload_size );
+      static_assert( header_size == message_header_size, "invalid message_header_size" );
+      const size_t buffer_size = header_size + which_size;
+
+      auto send_buffer = std::make_shared<vector<char>>( buffer_size );
+      fc::datastream<char*> ds( send_buffer->data(), buffer_size );
+      ds.write( header, header_size );
+      fc::raw::pack( ds, unsigned_int( signed_block_which ) );
+
+      enqueue_buffer( send_buffer, trigger_send, priority::low, no_reason, to_sync_queue, mb );
+   }
+
    void connection::enqueue_buffer( const std::shared_ptr<std::vector<char>>& send_buffer,
                                     bool trigger_send, int priority, go_away_reason close_after_send,
-                                    bool to_sync_queue)
+                                    bool to_sync_queue, const block_log::mapped_block& body)
    {
       connection_wptr weak_this = shared_from_this();
-      queue_write(send_buffer,trigger_send, priority,
+      queue_write(send_buffer, body, trigger_send, priority,
                   [weak_this, close_after_send](boost::system::error_code ec, std::size_t ) {
                      connection_ptr conn = weak_this.lock();
                      if (conn) {
@@ -2102,6 +2138,7 @@ namespace eosio {
                      }
                      EOS_ASSERT(bytes_transferred <= conn->pending_message_buffer.bytes_to_write(), plugin_exception, "");
                      conn->pending_message_buffer.advance_write_ptr(bytes_transferred);
+                     prefetch_buffered_blocks(conn);
                      while (conn->pending_message_buffer.bytes_to_read() > 0) {
                         uint32_t bytes_in_buffer = conn->pending_message_buffer.bytes_to_read();
 
@@ -2174,6 +2211,46 @@ namespace eosio {
       }
    }
 
+   /**
+    * While syncing, unpacks the blocks among the complete messages in the buffer and has the controller start
+    * validating them, so the signatures of the whole window are verified in parallel while the blocks are
+    * applied one by one. process_next_message takes the unpacked blocks instead of unpacking them again.
+    */
+   void net_plugin_impl::prefetch_buffered_blocks(const connection_ptr& conn) {
+      conn->lookahead_blocks.clear();
+      if( !sync_master->is_active( conn ) )
+         return;
+
+      try {
+         controller& cc = chain_plug->chain();
+         auto index = conn->pending_message_buffer.read_index();
+         uint32_t bytes_left = conn->pending_message_buffer.bytes_to_read();
+         vector<char> data;
+         while( bytes_left >= message_header_size ) {
+            uint32_t message_length = 0;
+            conn->pending_message_buffer.peek( &message_length, sizeof(message_length), index );
+            if( message_length == 0 || message_length > def_send_buffer_size*2 || bytes_left < message_length + message_header_size )
+               break;
+            bytes_left -= message_length + message_header_size;
+            data.resize( message_length );
+            conn->pending_message_buffer.peek( data.data(), message_length, index );
+
+            fc::datastream<const char*> ds( data.data(), data.size() );
+            unsigned_int which{};
+            fc::raw::unpack( ds, which );
+            if( which != signed_block_which )
+               continue;
+            auto b = std::make_shared<signed_block>();
+            fc::raw::unpack( ds, *b );
+            conn->lookahead_blocks.emplace_back( b->id(), b );
+            cc.prefetch_block_state( b );
+         }
+      } catch( const fc::exception& ) {
+         // the message is reported when it is processed
+         conn->lookahead_blocks.clear();
+      }
+   }
+
    bool net_plugin_impl::process_next_message(const connection_ptr& conn, uint32_t message_length) {
       try {
          // if next message is a block we already have, exit early
@@ -2187,11 +2264,27 @@ namespace eosio {
             controller& cc = chain_plug->chain();
             block_id_type blk_id = bh.id();
             uint32_t blk_num = bh.block_num();
+            signed_block_ptr prefetched;
+            if( !conn->lookahead_blocks.empty() ) {
+               if( conn->lookahead_blocks.front().first == blk_id ) {
+                  prefetched = conn->lookahead_blocks.front().second;
+                  conn->lookahead_blocks.pop_front();
+               } else {
+                  conn->lookahead_blocks.clear();
+               }
+            }
             if( cc.fetch_block_by_id( blk_id ) ) {
                sync_master->recv_block( conn, blk_id, blk_num );
                conn->pending_message_buffer.advance_read_ptr( message_length );
                return true;
             }
+            if( prefetched ) {
+               conn->pending_message_buffer.advance_read_ptr( message_length );
+               handle_message( conn, prefetched );
+               app().get_plugin<telemetry_plugin>().update_counter("net_in_signed_block_cnt");
+               app().get_plugin<telemetry_plugin>().update_counter("net_in_total_cnt");
+               return true;
+            }
          }
 
          auto ds = conn->pending_message_buffer.create_datastream();
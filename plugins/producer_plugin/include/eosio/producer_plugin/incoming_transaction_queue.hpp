@@ -0,0 +1,201 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/producer_plugin/producer_plugin.hpp>
+#include <eosio/chain/plugin_interface.hpp>
+#include <eosio/chain/transaction_metadata.hpp>
+#include <eosio/chain/config.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace eosio {
+
+using chain::account_name;
+using chain::transaction_metadata_ptr;
+using chain::transaction_trace_ptr;
+using chain::plugin_interface::next_function;
+
+enum class incoming_trx_fairness {
+   none,       ///< first in first out
+   authorizer, ///< in turns over the first authorizers of the transactions
+   contract    ///< in turns over the contracts of the first actions of the transactions
+};
+
+struct queued_incoming_transaction {
+   uint64_t                              seq = 0;
+   account_name                          key; ///< queue of the transaction, empty without fairness
+   fc::time_point                        expiry;
+   uint32_t                              cpu_estimate_us = 0;
+   transaction_metadata_ptr              trx;
+   bool                                  persist_until_expired = false;
+   next_function<transaction_trace_ptr>  next;
+};
+
+struct by_seq;
+struct by_key;
+struct by_expiry;
+
+using queued_incoming_transaction_index = boost::multi_index_container<
+   queued_incoming_transaction,
+   boost::multi_index::indexed_by<
+      boost::multi_index::ordered_unique<boost::multi_index::tag<by_seq>,
+         BOOST_MULTI_INDEX_MEMBER(queued_incoming_transaction, uint64_t, seq)
+      >,
+      boost::multi_index::ordered_unique<boost::multi_index::tag<by_key>,
+         boost::multi_index::composite_key< queued_incoming_transaction,
+            BOOST_MULTI_INDEX_MEMBER(queued_incoming_transaction, account_name, key),
+            BOOST_MULTI_INDEX_MEMBER(queued_incoming_transaction, uint64_t, seq)
+         >
+      >,
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_expiry>,
+         BOOST_MULTI_INDEX_MEMBER(queued_incoming_transaction, fc::time_point, expiry)
+      >
+   >
+>;
+
+/**
+ *  Incoming transactions waiting to be applied. With fairness the queue of every account gives up one
+ *  transaction in turn, so a busy account or contract does not hold back the others. New transactions are
+ *  turned away once the queued ones are expected to take more than cpu_limit_us, as estimated from the cpu
+ *  billed to earlier transactions of their first authorizers.
+ */
+class incoming_transaction_queue {
+   public:
+      using entry = std::tuple<transaction_metadata_ptr, bool, next_function<transaction_trace_ptr>>;
+
+      incoming_trx_fairness fairness = incoming_trx_fairness::none;
+      uint64_t              cpu_limit_us = 0; ///< 0 for no limit
+
+      bool   empty()const { return _queue.empty(); }
+      size_t size()const  { return _queue.size(); }
+      queued_incoming_transaction_index::const_iterator begin()const { return _queue.begin(); }
+      queued_incoming_transaction_index::const_iterator end()const   { return _queue.end(); }
+
+      /// false when the transaction is turned away
+      bool push_back( const transaction_metadata_ptr& trx, bool persist_until_expired, const next_function<transaction_trace_ptr>& next ) {
+         if( cpu_limit_us && _queued_cpu_us >= cpu_limit_us ) {
+            ++_stats.rejected;
+            return false;
+         }
+         insert( trx, persist_until_expired, next );
+         ++_stats.admitted;
+         return true;
+      }
+
+      /// queues again a transaction popped from the queue which did not fit in the pending block, it is never turned away
+      void requeue( const transaction_metadata_ptr& trx, bool persist_until_expired, const next_function<transaction_trace_ptr>& next ) {
+         insert( trx, persist_until_expired, next );
+      }
+
+      entry pop_front() {
+         auto itr = _queue.begin();
+         if( fairness != incoming_trx_fairness::none ) {
+            // the oldest transaction of the account following the last one served
+            auto& idx = _queue.get<by_key>();
+            auto kitr = idx.upper_bound( boost::make_tuple( _last_key ) );
+            if( kitr == idx.end() )
+               kitr = idx.begin();
+            itr = _queue.project<by_seq>( kitr );
+         }
+         entry e( itr->trx, itr->persist_until_expired, itr->next );
+         _last_key = itr->key;
+         _queued_cpu_us -= itr->cpu_estimate_us;
+         _queue.erase( itr );
+         return e;
+      }
+
+      /// removes the transactions expired by block_time, they still have to be answered
+      std::vector<entry> pop_expired( const fc::time_point& block_time ) {
+         std::vector<entry> result;
+         auto& idx = _queue.get<by_expiry>();
+         while( !idx.empty() && idx.begin()->expiry < block_time ) {
+            auto itr = idx.begin();
+            result.emplace_back( itr->trx, itr->persist_until_expired, itr->next );
+            _queued_cpu_us -= itr->cpu_estimate_us;
+            idx.erase( itr );
+         }
+         _stats.expired += result.size();
+         return result;
+      }
+
+      /// learns the cpu estimate of the first authorizer of trx from the cpu billed to it
+      void record_cpu_usage( const transaction_metadata_ptr& trx, uint32_t cpu_usage_us ) {
+         const auto a = first_authorizer( trx );
+         if( _cpu_estimates.size() >= max_cpu_estimates && !_cpu_estimates.count( a ) )
+            _cpu_estimates.clear();
+         auto& estimate = _cpu_estimates[a];
+         estimate = estimate ? (estimate * 7 + cpu_usage_us) / 8 : cpu_usage_us;
+      }
+
+      producer_plugin::incoming_transaction_queue_stats get_stats()const {
+         auto result = _stats;
+         result.size = _queue.size();
+         result.estimated_cpu_us = _queued_cpu_us;
+         if( fairness != incoming_trx_fairness::none ) {
+            auto& idx = _queue.get<by_key>();
+            for( auto itr = idx.begin(); itr != idx.end(); itr = idx.upper_bound( boost::make_tuple( itr->key ) ) )
+               ++result.queues;
+         }
+         return result;
+      }
+
+   private:
+      static const size_t max_cpu_estimates = 100000;
+
+      static account_name first_authorizer( const transaction_metadata_ptr& trx ) {
+         const auto& t = trx->packed_trx->get_transaction();
+         if( t.actions.empty() || t.actions.front().authorization.empty() )
+            return account_name();
+         return t.actions.front().authorization.front().actor;
+      }
+
+      account_name queue_key( const transaction_metadata_ptr& trx )const {
+         switch( fairness ) {
+            case incoming_trx_fairness::authorizer:
+               return first_authorizer( trx );
+            case incoming_trx_fairness::contract: {
+               const auto& t = trx->packed_trx->get_transaction();
+               return t.actions.empty() ? account_name() : t.actions.front().account;
+            }
+            default:
+               return account_name();
+         }
+      }
+
+      uint32_t cpu_estimate( const transaction_metadata_ptr& trx )const {
+         auto itr = _cpu_estimates.find( first_authorizer( trx ) );
+         return itr != _cpu_estimates.end() ? itr->second : chain::config::default_min_transaction_cpu_usage;
+      }
+
+      void insert( const transaction_metadata_ptr& trx, bool persist_until_expired, const next_function<transaction_trace_ptr>& next ) {
+         queued_incoming_transaction q;
+         q.seq = _next_seq++;
+         q.key = queue_key( trx );
+         q.expiry = trx->packed_trx->expiration();
+         q.cpu_estimate_us = cpu_estimate( trx );
+         q.trx = trx;
+         q.persist_until_expired = persist_until_expired;
+         q.next = next;
+         _queued_cpu_us += q.cpu_estimate_us;
+         _queue.insert( std::move(q) );
+      }
+
+      queued_incoming_transaction_index                  _queue;
+      uint64_t                                           _next_seq = 0;
+      account_name                                       _last_key;
+      uint64_t                                           _queued_cpu_us = 0;
+      std::map<account_name, uint32_t>                   _cpu_estimates;
+      producer_plugin::incoming_transaction_queue_stats  _stats;
+};
+
+} // eosio
@@ -51,6 +51,15 @@ public:
       std::string          snapshot_name;
    };
 
+   struct incoming_transaction_queue_stats {
+      uint32_t size = 0;             ///< transactions waiting for a pending block
+      uint32_t queues = 0;           ///< accounts with waiting transactions, 0 without fairness
+      uint64_t estimated_cpu_us = 0; ///< subjective cpu the waiting transactions are expected to take
+      uint64_t admitted = 0;
+      uint64_t rejected = 0;         ///< turned away over incoming-transaction-queue-cpu-limit-us
+      uint64_t expired = 0;          ///< expired while waiting
+   };
+
    producer_plugin();
    virtual ~producer_plugin();
 
@@ -83,6 +92,8 @@ public:
    integrity_hash_information get_integrity_hash() const;
    snapshot_information create_snapshot() const;
 
+   incoming_transaction_queue_stats get_incoming_transaction_queue_stats() const;
+
    signal<void(const chain::producer_confirmation&)> confirmed_block;
 private:
    std::shared_ptr<class producer_plugin_impl> my;
@@ -95,4 +106,5 @@ FC_REFLECT(eosio::producer_plugin::greylist_params, (accounts));
 FC_REFLECT(eosio::producer_plugin::whitelist_blacklist, (actor_whitelist)(actor_blacklist)(contract_whitelist)(contract_blacklist)(action_blacklist)(key_blacklist) )
 FC_REFLECT(eosio::producer_plugin::integrity_hash_information, (head_block_id)(integrity_hash))
 FC_REFLECT(eosio::producer_plugin::snapshot_information, (head_block_id)(snapshot_name))
+FC_REFLECT(eosio::producer_plugin::incoming_transaction_queue_stats, (size)(queues)(estimated_cpu_us)(admitted)(rejected)(expired))
 
@@ -3,6 +3,7 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/producer_plugin/producer_plugin.hpp>
+#include <eosio/producer_plugin/incoming_transaction_queue.hpp>
 #include <eosio/chain/producer_object.hpp>
 #include <eosio/chain/plugin_interface.hpp>
 #include <eosio/chain/global_property_object.hpp>
@@ -178,6 +179,9 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       double _incoming_trx_weight = 0.0;
       double _incoming_defer_ratio = 1.0; // 1:1
 
+      // transactions at the front of start_block whose contracts are compiled ahead of applying them
+      uint32_t _compile_ahead_transactions = 32;
+
       // path to write the snapshots to
       bfs::path _snapshots_dir;
 
@@ -346,7 +350,19 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          }
       }
 
-      std::deque<std::tuple<transaction_metadata_ptr, bool, next_function<transaction_trace_ptr>>> _pending_incoming_transactions;
+      incoming_transaction_queue _pending_incoming_transactions;
+
+      /// false when the transaction is turned away, it is answered here
+      bool queue_incoming_transaction(const transaction_metadata_ptr& trx, bool persist_until_expired, const next_function<transaction_trace_ptr>& next) {
+         if( _pending_incoming_transactions.push_back(trx, persist_until_expired, next) )
+            return true;
+         auto e_ptr = std::static_pointer_cast<fc::exception>(std::make_shared<incoming_transaction_queue_full>(
+               FC_LOG_MESSAGE(error, "incoming transaction queue is full, rejecting ${id}", ("id", trx->id)) ));
+         next(e_ptr);
+         _transaction_ack_channel.publish(priority::low, std::pair<fc::exception_ptr, transaction_metadata_ptr>(e_ptr, trx));
+         fc_dlog(_trx_trace_log, "[TRX_TRACE] Incoming transaction queue is full, REJECTING tx: ${txid}", ("txid", trx->id));
+         return false;
+      }
 
       void on_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next) {
          chain::controller& chain = chain_plug->chain();
@@ -357,15 +373,19 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
             if( future.valid() )
                future.wait();
             app().post(priority::low, [self, trx, persist_until_expired, next]() {
-               self->process_incoming_transaction_async( trx, persist_until_expired, next );
+               self->process_incoming_transaction_async( trx, persist_until_expired, next, false );
             });
          });
       }
 
-      void process_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next) {
+      /// queued is true for transactions popped from _pending_incoming_transactions, they are not turned away again
+      void process_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next, bool queued) {
          chain::controller& chain = chain_plug->chain();
          if (!chain.pending_block_state()) {
-            _pending_incoming_transactions.emplace_back(trx, persist_until_expired, next);
+            if (queued)
+               _pending_incoming_transactions.requeue(trx, persist_until_expired, next);
+            else
+               queue_incoming_transaction(trx, persist_until_expired, next);
             return;
          }
 
@@ -423,7 +443,10 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
             auto trace = chain.push_transaction(trx, deadline);
             if (trace->except) {
                if (failure_is_subjective(*trace->except, deadline_is_subjective)) {
-                  _pending_incoming_transactions.emplace_back(trx, persist_until_expired, next);
+                  if (queued)
+                     _pending_incoming_transactions.requeue(trx, persist_until_expired, next);
+                  else if (!queue_incoming_transaction(trx, persist_until_expired, next))
+                     return;
                   if (_pending_block_mode == pending_block_mode::producing) {
                      fc_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} COULD NOT FIT, tx: ${txid} RETRYING ",
                              ("block_num", chain.head_block_num() + 1)
@@ -438,6 +461,8 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
                   send_response(e_ptr);
                }
             } else {
+               if (trace->receipt)
+                  _pending_incoming_transactions.record_cpu_usage(trx, trace->receipt->cpu_usage_us);
                if (persist_until_expired) {
                   // if this trx didnt fail/soft-fail and the persist flag is set, store its ID so that we can
                   // ensure its applied to all future speculative blocks as well.
@@ -550,6 +575,12 @@ void producer_plugin::set_program_options(
           "Maximum wall-clock time, in milliseconds, spent retiring scheduled transactions in any block before returning to normal transaction processing.")
          ("incoming-defer-ratio", bpo::value<double>()->default_value(1.0),
           "ratio between incoming transations and deferred transactions when both are exhausted")
+         ("incoming-transaction-fairness", bpo::value<string>()->default_value("none"),
+          "How queued incoming transactions take turns: \"none\" in arrival order, \"authorizer\" or \"contract\" one at a time from the queue of every first authorizer or contract of their first actions")
+         ("incoming-transaction-queue-cpu-limit-us", bpo::value<uint64_t>()->default_value(0),
+          "Estimated cpu time, in microseconds, of queued incoming transactions past which new ones are rejected, 0 for no limit")
+         ("compile-ahead-transactions", bpo::value<uint32_t>()->default_value(32),
+          "Number of transactions to be applied first in a block whose contracts are compiled ahead if they are not cached, 0 to disable")
          ("producer-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
           "Number of worker threads in producer thread pool")
          ("snapshots-dir", bpo::value<bfs::path>()->default_value("snapshots"),
@@ -686,6 +717,19 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
 
    my->_incoming_defer_ratio = options.at("incoming-defer-ratio").as<double>();
 
+   const auto fairness = options.at("incoming-transaction-fairness").as<string>();
+   if( fairness == "none" ) {
+      my->_pending_incoming_transactions.fairness = incoming_trx_fairness::none;
+   } else if( fairness == "authorizer" ) {
+      my->_pending_incoming_transactions.fairness = incoming_trx_fairness::authorizer;
+   } else if( fairness == "contract" ) {
+      my->_pending_incoming_transactions.fairness = incoming_trx_fairness::contract;
+   } else {
+      EOS_THROW( plugin_config_exception, "incoming-transaction-fairness ${f} must be none, authorizer or contract", ("f", fairness) );
+   }
+   my->_pending_incoming_transactions.cpu_limit_us = options.at("incoming-transaction-queue-cpu-limit-us").as<uint64_t>();
+   my->_compile_ahead_transactions = options.at("compile-ahead-transactions").as<uint32_t>();
+
    auto thread_pool_size = options.at( "producer-threads" ).as<uint16_t>();
    EOS_ASSERT( thread_pool_size > 0, plugin_config_exception,
                "producer-threads ${num} must be greater than 0", ("num", thread_pool_size));
@@ -920,6 +964,10 @@ void producer_plugin::set_whitelist_blacklist(const producer_plugin::whitelist_b
    if(params.key_blacklist.valid()) chain.set_key_blacklist(*params.key_blacklist);
 }
 
+producer_plugin::incoming_transaction_queue_stats producer_plugin::get_incoming_transaction_queue_stats() const {
+   return my->_pending_incoming_transactions.get_stats();
+}
+
 producer_plugin::integrity_hash_information producer_plugin::get_integrity_hash() const {
    chain::controller& chain = my->chain_plug->chain();
 
@@ -1181,8 +1229,40 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
       }
 
       try {
+         // queued transactions which expired while waiting are answered without being applied
+         for( const auto& e : _pending_incoming_transactions.pop_expired( pbs->header.timestamp.to_time_point() ) ) {
+            process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e), true);
+         }
+
          size_t orig_pending_txn_size = _pending_incoming_transactions.size();
 
+         // contracts of the first transactions to be applied are instantiated on the compile thread while the ones
+         // ahead of them are applied, as many as the wasm cache has room for
+         uint32_t compile_ahead_left = _compile_ahead_transactions;
+         auto compile_ahead = [&]( const transaction_metadata_ptr& trx ) {
+            if( !compile_ahead_left )
+               return false;
+            --compile_ahead_left;
+            if( !chain.compile_transaction_contracts( trx ) )
+               compile_ahead_left = 0;
+            return true;
+         };
+         // unapplied transactions are retried first, see below
+         if( !_producers.empty() || !persisted_by_id.empty() ) {
+            for( const auto& t : chain.get_unapplied_transactions() ) {
+               if( !compile_ahead_left )
+                  break;
+               const auto& trx = t.second;
+               if( trx->packed_trx->expiration() >= pbs->header.timestamp.to_time_point() &&
+                   (persisted_by_id.find( trx->id ) != persisted_by_id.end() || _pending_block_mode == pending_block_mode::producing) )
+                  compile_ahead( trx );
+            }
+         }
+         for( const auto& q : _pending_incoming_transactions ) {
+            if( !compile_ahead( q.trx ) )
+               break;
+         }
+
          // Processing unapplied transactions...
          //
          if (_producers.empty() && persisted_by_id.empty()) {
@@ -1332,11 +1412,10 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
                while (_incoming_trx_weight >= 1.0 && orig_pending_txn_size && _pending_incoming_transactions.size()) {
                   if (scheduled_trx_deadline <= fc::time_point::now()) break;
 
-                  auto e = _pending_incoming_transactions.front();
-                  _pending_incoming_transactions.pop_front();
+                  auto e = _pending_incoming_transactions.pop_front();
                   --orig_pending_txn_size;
                   _incoming_trx_weight -= 1.0;
-                  process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+                  process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e), true);
                }
 
                if (scheduled_trx_deadline <= fc::time_point::now()) {
@@ -1399,10 +1478,9 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
                fc_dlog(_log, "Processing ${n} pending transactions", ("n", _pending_incoming_transactions.size()));
                while (orig_pending_txn_size && _pending_incoming_transactions.size()) {
                   if (preprocess_deadline <= fc::time_point::now()) return start_block_result::exhausted;
-                  auto e = _pending_incoming_transactions.front();
-                  _pending_incoming_transactions.pop_front();
+                  auto e = _pending_incoming_transactions.pop_front();
                   --orig_pending_txn_size;
-                  process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+                  process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e), true);
                }
             }
             return start_block_result::succeeded;
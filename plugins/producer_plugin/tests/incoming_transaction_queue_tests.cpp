@@ -0,0 +1,161 @@
+#include <eosio/producer_plugin/incoming_transaction_queue.hpp>
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace eosio;
+using namespace chain;
+using std::vector;
+
+static transaction_metadata_ptr make_trx(account_name authorizer, account_name contract, uint32_t expiration, uint32_t nonce) {
+    signed_transaction trx;
+    trx.expiration = fc::time_point_sec(expiration);
+    action act;
+    act.account = contract;
+    act.name = N(test);
+    act.authorization = vector<permission_level>{{authorizer, config::active_name}};
+    act.data = fc::raw::pack(nonce);
+    trx.actions.push_back(act);
+    return std::make_shared<transaction_metadata>(trx);
+}
+
+static void push(incoming_transaction_queue& queue, const transaction_metadata_ptr& trx) {
+    BOOST_REQUIRE(queue.push_back(trx, false, [](const auto&){}));
+}
+
+static vector<transaction_id_type> pop_all(incoming_transaction_queue& queue) {
+    vector<transaction_id_type> ids;
+    while (!queue.empty())
+        ids.push_back(std::get<0>(queue.pop_front())->id);
+    return ids;
+}
+
+static const uint32_t expiration = 1000;
+
+BOOST_AUTO_TEST_SUITE(incoming_transaction_queue_tests)
+
+BOOST_AUTO_TEST_CASE(fifo_without_fairness) try {
+    incoming_transaction_queue queue;
+    auto a1 = make_trx(N(alice), N(token), expiration, 1);
+    auto a2 = make_trx(N(alice), N(token), expiration, 2);
+    auto b1 = make_trx(N(bob), N(token), expiration, 3);
+    push(queue, a1);
+    push(queue, a2);
+    push(queue, b1);
+
+    BOOST_TEST(queue.get_stats().queues == 0u);
+    BOOST_CHECK(pop_all(queue) == (vector<transaction_id_type>{a1->id, a2->id, b1->id}));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(round_robin_over_authorizers) try {
+    incoming_transaction_queue queue;
+    queue.fairness = incoming_trx_fairness::authorizer;
+    auto a1 = make_trx(N(alice), N(token), expiration, 1);
+    auto a2 = make_trx(N(alice), N(token), expiration, 2);
+    auto a3 = make_trx(N(alice), N(token), expiration, 3);
+    auto b1 = make_trx(N(bob), N(token), expiration, 4);
+    auto c1 = make_trx(N(carol), N(token), expiration, 5);
+    auto c2 = make_trx(N(carol), N(token), expiration, 6);
+    for (const auto& trx : {a1, a2, a3, b1, c1, c2})
+        push(queue, trx);
+
+    BOOST_TEST(queue.get_stats().queues == 3u);
+    BOOST_CHECK(pop_all(queue) == (vector<transaction_id_type>{a1->id, b1->id, c1->id, a2->id, c2->id, a3->id}));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(round_robin_over_contracts) try {
+    incoming_transaction_queue queue;
+    queue.fairness = incoming_trx_fairness::contract;
+    auto t1 = make_trx(N(alice), N(token), expiration, 1);
+    auto t2 = make_trx(N(bob), N(token), expiration, 2);
+    auto g1 = make_trx(N(alice), N(game), expiration, 3);
+    for (const auto& trx : {t1, t2, g1})
+        push(queue, trx);
+
+    BOOST_TEST(queue.get_stats().queues == 2u);
+    BOOST_CHECK(pop_all(queue) == (vector<transaction_id_type>{g1->id, t1->id, t2->id}));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(serving_continues_after_the_last_account) try {
+    incoming_transaction_queue queue;
+    queue.fairness = incoming_trx_fairness::authorizer;
+    auto a1 = make_trx(N(alice), N(token), expiration, 1);
+    auto c1 = make_trx(N(carol), N(token), expiration, 2);
+    push(queue, a1);
+    push(queue, c1);
+    BOOST_CHECK(std::get<0>(queue.pop_front())->id == a1->id);
+
+    // bob comes after alice, who was served last, and before carol
+    auto a2 = make_trx(N(alice), N(token), expiration, 3);
+    auto b1 = make_trx(N(bob), N(token), expiration, 4);
+    push(queue, a2);
+    push(queue, b1);
+    BOOST_CHECK(pop_all(queue) == (vector<transaction_id_type>{b1->id, c1->id, a2->id}));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(pop_expired_at_block_time) try {
+    incoming_transaction_queue queue;
+    queue.fairness = incoming_trx_fairness::authorizer;
+    auto early = make_trx(N(alice), N(token), expiration - 1, 1);
+    auto at_block = make_trx(N(bob), N(token), expiration, 2);
+    auto late = make_trx(N(alice), N(token), expiration + 1, 3);
+    for (const auto& trx : {late, at_block, early})
+        push(queue, trx);
+
+    // a transaction expiring at the block time is still valid in the block
+    auto expired = queue.pop_expired(fc::time_point(fc::time_point_sec(expiration)));
+    BOOST_REQUIRE(expired.size() == 1u);
+    BOOST_CHECK(std::get<0>(expired.front())->id == early->id);
+
+    const auto stats = queue.get_stats();
+    BOOST_TEST(stats.expired == 1u);
+    BOOST_TEST(stats.size == 2u);
+    BOOST_TEST(stats.estimated_cpu_us == 2u * config::default_min_transaction_cpu_usage);
+    BOOST_CHECK(pop_all(queue) == (vector<transaction_id_type>{late->id, at_block->id}));
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(rejects_over_cpu_limit) try {
+    incoming_transaction_queue queue;
+    queue.cpu_limit_us = 2 * config::default_min_transaction_cpu_usage;
+    push(queue, make_trx(N(alice), N(token), expiration, 1));
+    push(queue, make_trx(N(alice), N(token), expiration, 2));
+    BOOST_TEST(!queue.push_back(make_trx(N(alice), N(token), expiration, 3), false, [](const auto&){}));
+
+    // transactions which were admitted before are queued again whatever the limit
+    auto retried = std::get<0>(queue.pop_front());
+    queue.requeue(retried, false, [](const auto&){});
+    queue.requeue(make_trx(N(bob), N(token), expiration, 4), false, [](const auto&){});
+    BOOST_TEST(queue.size() == 3u);
+
+    auto stats = queue.get_stats();
+    BOOST_TEST(stats.admitted == 2u);
+    BOOST_TEST(stats.rejected == 1u);
+    BOOST_TEST(stats.estimated_cpu_us == 3u * config::default_min_transaction_cpu_usage);
+
+    // admits again once the queued transactions fall below the limit
+    queue.pop_front();
+    BOOST_TEST(!queue.push_back(make_trx(N(alice), N(token), expiration, 5), false, [](const auto&){}));
+    queue.pop_front();
+    BOOST_TEST(queue.push_back(make_trx(N(alice), N(token), expiration, 6), false, [](const auto&){}));
+    stats = queue.get_stats();
+    BOOST_TEST(stats.admitted == 3u);
+    BOOST_TEST(stats.rejected == 2u);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(cpu_estimate_follows_billed_cpu) try {
+    incoming_transaction_queue queue;
+    queue.cpu_limit_us = 900;
+    queue.record_cpu_usage(make_trx(N(alice), N(token), expiration, 1), 800);
+
+    push(queue, make_trx(N(alice), N(token), expiration, 2));
+    push(queue, make_trx(N(bob), N(token), expiration, 3));
+    BOOST_TEST(queue.get_stats().estimated_cpu_us == 800u + config::default_min_transaction_cpu_usage);
+    BOOST_TEST(!queue.push_back(make_trx(N(bob), N(token), expiration, 4), false, [](const auto&){}));
+
+    // moves an eighth of the way to the latest billed cpu
+    queue.record_cpu_usage(make_trx(N(alice), N(token), expiration, 5), 0);
+    pop_all(queue);
+    push(queue, make_trx(N(alice), N(token), expiration, 6));
+    BOOST_TEST(queue.get_stats().estimated_cpu_us == 700u);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -26,12 +26,24 @@ public:
     }
 
     public_key_type public_key() const {
-        return public_key_type(signature, hash());
+        if (!_public_key) {
+            _public_key = public_key_type(signature, hash());
+        }
+        return *_public_key;
+    }
+
+    // stores public key recovered elsewhere (e.g. in batch), so `public_key()` won't recover it again
+    void set_public_key(const public_key_type& pub_key) const {
+        _public_key = pub_key;
     }
 
     bool validate(const public_key_type& pub_key) const {
         return public_key() == pub_key;
     }
+
+private:
+    // recovered signer key, not serialized
+    mutable fc::optional<public_key_type> _public_key;
 };
 
 
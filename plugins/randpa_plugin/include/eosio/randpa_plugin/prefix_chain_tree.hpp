@@ -1,54 +1,58 @@
 #pragma once
 
 #include "types.hpp"
+#include <boost/dynamic_bitset.hpp>
 #include <memory>
 #include <vector>
 #include <map>
 #include <set>
-#include <queue>
+#include <unordered_map>
+#include <limits>
 
 namespace randpa_finality {
 
 using std::vector;
 using std::shared_ptr;
-using std::weak_ptr;
+using std::unique_ptr;
 using std::pair;
 using std::make_pair;
 using std::set;
 using std::map;
+using std::unordered_map;
+
+using bp_keys_type = set<public_key_type>;
 
 template <typename ConfType>
 class prefix_node {
 public:
     using conf_type = ConfType;
-private:
-    using node_type = prefix_node<conf_type>;
-    using node_ptr = shared_ptr<node_type>;
+    using node_id_type = uint32_t;
+    using bp_keys_itr_type = typename map<bp_keys_type, size_t>::iterator;
+
+    static constexpr node_id_type null_id = std::numeric_limits<node_id_type>::max();
 
 public:
     block_id_type block_id;
-    std::map<public_key_type, shared_ptr<conf_type>> confirmation_data;
-    vector<node_ptr> adjacent_nodes;
-    weak_ptr<node_type> parent;
-    public_key_type creator_key;
-    set<public_key_type> active_bp_keys;
+    node_id_type parent { null_id };
+    node_id_type first_child { null_id };
+    node_id_type next_sibling { null_id };
+    // confirmations by key slot of the tree
+    boost::dynamic_bitset<uint64_t> confirmations;
 
     size_t confirmation_number() const {
-        return confirmation_data.size();
+        return confirmations.count();
     }
 
-    node_ptr get_matching_node(block_id_type block_id) {
-        for (const auto& node : adjacent_nodes) {
-            if (node->block_id == block_id) {
-                return node;
-            }
-        }
-        return nullptr;
+    // active bp keys are interned by the tree, nodes with the same schedule share one set
+    const bp_keys_type& active_bp_keys() const {
+        return bp_keys_itr->first;
     }
 
-    bool has_confirmation(const public_key_type& pub_key ) {
-        return confirmation_data.find(pub_key) != confirmation_data.end();
-    }
+private:
+    template <typename NodeType>
+    friend class prefix_chain_tree;
+
+    bp_keys_itr_type bp_keys_itr;
 };
 
 struct chain_type {
@@ -58,25 +62,35 @@ struct chain_type {
 
 class NodeNotFoundError : public std::exception {};
 
+/**
+ * Tree of unfinalized blocks. Nodes are stored in a pooled arena and linked by indexes,
+ * node pointers returned by the tree stay valid until the node is pruned by `set_root`.
+ */
 template <typename NodeType>
 class prefix_chain_tree {
 private:
-    using node_ptr = shared_ptr<NodeType>;
-    using node_weak_ptr = weak_ptr<NodeType>;
+    using node_ptr = NodeType*;
+    using node_id_type = typename NodeType::node_id_type;
     using conf_ptr = shared_ptr<typename NodeType::conf_type>;
+    using key_slot_type = uint32_t;
 
-    struct node_info {
-        node_ptr node;
-        size_t height;
-    };
+    static constexpr node_id_type null_id = NodeType::null_id;
+    static constexpr size_t arena_chunk_size = 1024;
 
 public:
-    explicit prefix_chain_tree(node_ptr&& root_): root(std::move(root_)) {}
+    explicit prefix_chain_tree(const block_id_type& root_id) {
+        root = new_node(root_id, null_id, intern_bp_keys({}));
+    }
     prefix_chain_tree() = delete;
     prefix_chain_tree(const prefix_chain_tree&) = delete;
 
-    auto find(const block_id_type& block_id) const {
-        return find_node(block_id, root);
+    node_ptr find(const block_id_type& block_id) const {
+        auto itr = node_index.find(block_id);
+        return itr != node_index.end() ? get(itr->second) : nullptr;
+    }
+
+    size_t size() const {
+        return node_index.size();
     }
 
     node_ptr add_confirmations(const chain_type& chain, const public_key_type& sender_key, const conf_ptr& conf) {
@@ -90,10 +104,10 @@ public:
     }
 
     void remove_confirmations() {
-        _remove_confirmations(root);
+        _remove_confirmations();
     }
 
-    void insert(const chain_type& chain, const public_key_type& creator_key, const set<public_key_type>& active_bp_keys) {
+    void insert(const chain_type& chain, const public_key_type& creator_key, const bp_keys_type& active_bp_keys) {
         node_ptr node = nullptr;
         vector<block_id_type> blocks;
         std::tie(node, blocks) = get_tree_node(chain);
@@ -105,32 +119,70 @@ public:
         insert_blocks(node, blocks, creator_key, active_bp_keys);
     }
 
-    auto get_final_chain_head(size_t confirmation_number) const {
-        auto head = get_chain_head(root, confirmation_number, 0).node;
-        return head != root ? head : nullptr;
+    node_ptr get_final_chain_head(size_t confirmation_number) const {
+        auto head = get_chain_head(confirmation_number);
+        return head != root ? get(head) : nullptr;
     }
 
-    auto get_root() const {
-        return root;
+    node_ptr get_root() const {
+        return get(root);
     }
 
-    auto set_root(const node_ptr& new_root) {
+    // makes block a new root and prunes all nodes which are not its descendants;
+    // if block is unknown, tree is reset to the single root node
+    void set_root(const block_id_type& block_id) {
+        auto itr = node_index.find(block_id);
+        auto new_root = itr != node_index.end() ? itr->second : null_id;
+
+        remove_subtree_except(root, new_root);
+
+        if (new_root == null_id) {
+            new_root = new_node(block_id, null_id, intern_bp_keys({}));
+        }
         root = new_root;
-        root->parent.reset();
+        get(root)->parent = null_id;
+        get(root)->next_sibling = null_id;
     }
 
-    auto get_head() const {
-        if (!head_block.lock()) {
-            return root;
+    node_ptr get_parent(const NodeType* node) const {
+        return node->parent != null_id ? get(node->parent) : nullptr;
+    }
+
+    vector<node_ptr> get_children(const NodeType* node) const {
+        vector<node_ptr> children;
+        for (auto id = node->first_child; id != null_id; id = get(id)->next_sibling) {
+            children.push_back(get(id));
         }
-        return head_block.lock();
+        return children;
+    }
+
+    // confirmations of the node, one per confirmed key
+    vector<conf_ptr> get_confirmations(const NodeType* node) const {
+        vector<conf_ptr> result;
+        const auto& confirmations = node->confirmations;
+        for (auto slot = confirmations.find_first(); slot != confirmations.npos; slot = confirmations.find_next(slot)) {
+            result.push_back(slot_confirmations[slot]);
+        }
+        return result;
+    }
+
+    bool has_confirmation(const NodeType* node, const public_key_type& pub_key) const {
+        auto itr = key_slots.find(pub_key);
+        if (itr == key_slots.end()) {
+            return false;
+        }
+        return itr->second < node->confirmations.size() && node->confirmations.test(itr->second);
+    }
+
+    node_ptr get_head() const {
+        auto head = find(head_block);
+        return head ? head : get(root);
     }
 
     node_ptr get_last_inserted_block(const public_key_type& pub_key) {
         auto iterator = last_inserted_block.find(pub_key);
         if (iterator != last_inserted_block.end()) {
-            auto node = iterator->second;
-            return node.lock();
+            return find(iterator->second);
         }
         return nullptr;
     }
@@ -138,11 +190,11 @@ public:
     chain_type get_branch(const block_id_type& head_block_id) const {
         auto last_node = find(head_block_id);
 
-        chain_type chain { root->block_id, {} };
-        while (last_node != root) {
+        chain_type chain { get(root)->block_id, {} };
+        while (last_node != get(root)) {
             chain.blocks.push_back(last_node->block_id);
-            FC_ASSERT(!last_node->parent.expired(), "parent should be exists");
-            last_node = last_node->parent.lock();
+            FC_ASSERT(last_node->parent != null_id, "parent should be exists");
+            last_node = get(last_node->parent);
         }
         std::reverse(chain.blocks.begin(), chain.blocks.end());
 
@@ -150,16 +202,115 @@ public:
     }
 
 private:
-    node_ptr root;
-    map<public_key_type, node_weak_ptr> last_inserted_block;
-    node_weak_ptr head_block;
+    vector<unique_ptr<NodeType[]>> arena;
+    vector<node_id_type> free_nodes;
+    node_id_type arena_size { 0 };
+
+    node_id_type root { null_id };
+    unordered_map<block_id_type, node_id_type> node_index;
+    map<bp_keys_type, size_t> interned_bp_keys;
+    map<public_key_type, key_slot_type> key_slots;
+    vector<conf_ptr> slot_confirmations;
+    map<public_key_type, block_id_type> last_inserted_block;
+    block_id_type head_block;
+
+    node_ptr get(node_id_type id) const {
+        return &arena[id / arena_chunk_size][id % arena_chunk_size];
+    }
+
+    node_id_type get_id(const NodeType* node) const {
+        return node_index.at(node->block_id);
+    }
+
+    // returns child with `block_id`, or null_id and the last child of the node (if requested)
+    node_id_type get_matching_child(node_id_type node_id, const block_id_type& block_id,
+            node_id_type* last_child = nullptr) const {
+        for (auto child = get(node_id)->first_child; child != null_id; child = get(child)->next_sibling) {
+            if (get(child)->block_id == block_id) {
+                return child;
+            }
+            if (last_child) {
+                *last_child = child;
+            }
+        }
+        return null_id;
+    }
+
+    typename NodeType::bp_keys_itr_type intern_bp_keys(const bp_keys_type& bp_keys) {
+        return interned_bp_keys.emplace(bp_keys, 0).first;
+    }
+
+    key_slot_type get_key_slot(const public_key_type& pub_key) {
+        auto itr = key_slots.find(pub_key);
+        if (itr != key_slots.end()) {
+            return itr->second;
+        }
+        key_slot_type slot = key_slots.size();
+        key_slots.emplace(pub_key, slot);
+        slot_confirmations.resize(key_slots.size());
+        return slot;
+    }
+
+    node_id_type new_node(const block_id_type& block_id, node_id_type parent,
+            typename NodeType::bp_keys_itr_type bp_keys_itr) {
+        node_id_type id;
+        if (!free_nodes.empty()) {
+            id = free_nodes.back();
+            free_nodes.pop_back();
+        } else {
+            if (arena_size == arena.size() * arena_chunk_size) {
+                arena.emplace_back(new NodeType[arena_chunk_size]);
+            }
+            id = arena_size++;
+        }
+
+        auto node = get(id);
+        node->block_id = block_id;
+        node->parent = parent;
+        node->first_child = null_id;
+        node->next_sibling = null_id;
+        node->bp_keys_itr = bp_keys_itr;
+        bp_keys_itr->second++;
+
+        node_index[block_id] = id;
+        return id;
+    }
+
+    void free_node(node_id_type id) {
+        auto node = get(id);
+        node_index.erase(node->block_id);
+        node->confirmations.clear();
+        if (!--node->bp_keys_itr->second) {
+            interned_bp_keys.erase(node->bp_keys_itr);
+        }
+        free_nodes.push_back(id);
+    }
+
+    // frees all nodes of `subtree_root` subtree, except ones from `kept_node` subtree
+    void remove_subtree_except(node_id_type subtree_root, node_id_type kept_node) {
+        vector<node_id_type> stack { subtree_root };
+
+        while (stack.size()) {
+            auto id = stack.back();
+            stack.pop_back();
+
+            if (id == kept_node) {
+                continue;
+            }
+
+            for (auto child = get(id)->first_child; child != null_id; child = get(child)->next_sibling) {
+                stack.push_back(child);
+            }
+            free_node(id);
+        }
+    }
 
     pair<node_ptr, vector<block_id_type> > get_tree_node(const chain_type& chain) {
         auto node = find(chain.base_block);
         const auto& blocks = chain.blocks;
 
         if (node) {
-            return {node, std::move(chain.blocks)};
+            return {node, blocks};
         }
 
         auto block_itr = std::find_if(blocks.begin(), blocks.end(), [&](const auto& block) {
@@ -172,73 +323,106 @@ private:
         return {nullptr, {} };
     }
 
-    node_info get_chain_head(const node_ptr& node, size_t confirmation_number, size_t depth) const {
-        auto result = node_info{node, depth};
-        for (const auto& adjacent_node : node->adjacent_nodes) {
-            if (adjacent_node->confirmation_number() < confirmation_number) {
-                continue;
+    // finds the deepest node reachable from root through nodes with enough confirmations,
+    // walks the tree in preorder using links, so the first found node wins among equally deep ones
+    node_id_type get_chain_head(size_t confirmation_number) const {
+        auto has_enough = [&](node_id_type id) {
+            return get(id)->confirmation_number() >= confirmation_number;
+        };
+        auto next_matching = [&](node_id_type id) {
+            while (id != null_id && !has_enough(id)) {
+                id = get(id)->next_sibling;
             }
-            const auto head_node = get_chain_head(adjacent_node, confirmation_number, depth + 1);
-            if (head_node.height > result.height) {
-                result = head_node;
+            return id;
+        };
+
+        auto result = root;
+        size_t result_depth = 0;
+
+        auto id = root;
+        size_t depth = 0;
+        while (true) {
+            auto child = next_matching(get(id)->first_child);
+            if (child != null_id) {
+                id = child;
+                depth++;
+                if (depth > result_depth) {
+                    result = id;
+                    result_depth = depth;
+                }
+                continue;
             }
-        }
-        return result;
-    }
-
-    node_ptr find_node(const block_id_type& block_id, node_ptr node) const {
-        std::queue<node_ptr> queue {{ node }};
 
-        while (queue.size()) {
-            auto top_node = queue.front();
-            queue.pop();
-
-            if (top_node->block_id == block_id) {
-                return top_node;
+            // go up until a matching sibling is found
+            while (id != root) {
+                auto sibling = next_matching(get(id)->next_sibling);
+                if (sibling != null_id) {
+                    id = sibling;
+                    break;
+                }
+                id = get(id)->parent;
+                depth--;
             }
-
-            for (auto&& adj_node: top_node->adjacent_nodes) {
-                queue.push(adj_node);
+            if (id == root) {
+                break;
             }
         }
-
-        return nullptr;
+        return result;
     }
 
     void insert_blocks(node_ptr node, const vector<block_id_type>& blocks, const public_key_type& creator_key,
-            const set<public_key_type>& active_bp_keys) {
+            const bp_keys_type& active_bp_keys) {
+        auto node_id = get_id(node);
+        auto bp_keys_itr = interned_bp_keys.end();
+
         for (const auto& block_id : blocks) {
-            auto next_node = node->get_matching_node(block_id);
-            if (!next_node) {
-                next_node = std::make_shared<NodeType>(NodeType{block_id,
-                                                                      {},
-                                                                      {},
-                                                                      node,
-                                                                      creator_key,
-                                                                      active_bp_keys});
-                node->adjacent_nodes.push_back(next_node);
+            auto last_child = null_id;
+            auto next_id = get_matching_child(node_id, block_id, &last_child);
+
+            if (next_id == null_id) {
+                if (bp_keys_itr == interned_bp_keys.end()) {
+                    bp_keys_itr = intern_bp_keys(active_bp_keys);
+                }
+                next_id = new_node(block_id, node_id, bp_keys_itr);
+                if (last_child == null_id) {
+                    get(node_id)->first_child = next_id;
+                } else {
+                    get(last_child)->next_sibling = next_id;
+                }
             }
-            node = next_node;
+            node_id = next_id;
         }
-        last_inserted_block[creator_key] = node;
+        node = get(node_id);
+        last_inserted_block[creator_key] = node->block_id;
 
         if (get_block_num(node->block_id) > get_block_num(get_head()->block_id)) {
-            head_block = node;
+            head_block = node->block_id;
         }
     }
 
     node_ptr _add_confirmations(node_ptr node, const vector<block_id_type>& blocks, const public_key_type& sender_key,
                            const conf_ptr& conf) {
+        const auto slot = get_key_slot(sender_key);
+        slot_confirmations[slot] = conf;
+
+        auto confirm = [&](node_ptr node) {
+            if (node->confirmations.size() <= slot) {
+                node->confirmations.resize(key_slots.size());
+            }
+            node->confirmations.set(slot);
+        };
+
         auto max_conf_node = node;
-        node->confirmation_data[sender_key] = conf;
+        confirm(node);
 
         for (const auto& block_id : blocks) {
-            node = node->get_matching_node(block_id);
-            if (!node) {
+            auto child = get_matching_child(get_id(node), block_id);
+            if (child == null_id) {
                 break;
             }
-            node->confirmation_data[sender_key] = conf;
-            if (max_conf_node->confirmation_data.size() <= node->confirmation_data.size()) {
+            node = get(child);
+            confirm(node);
+            if (max_conf_node->confirmation_number() <= node->confirmation_number()) {
                 max_conf_node = node;
             }
         }
@@ -246,14 +430,11 @@ private:
         return max_conf_node;
     }
 
-    void _remove_confirmations(node_ptr root) {
-        if (!root) {
-            return;
-        }
-        root->confirmation_data.clear();
-        for (const auto& node : root->adjacent_nodes) {
-            _remove_confirmations(node);
+    void _remove_confirmations() {
+        for (node_id_type id = 0; id < arena_size; id++) {
+            get(id)->confirmations.reset();
         }
+        std::fill(slot_confirmations.begin(), slot_confirmations.end(), nullptr);
     }
 };
 
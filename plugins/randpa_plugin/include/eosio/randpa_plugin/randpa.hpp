@@ -8,7 +8,11 @@
 #include <atomic>
 #include <mutex>
 #include <thread>
+#include <future>
 #include <condition_variable>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/lockfree/queue.hpp>
 
 namespace randpa_finality {
 
@@ -20,76 +24,104 @@ using std::pair;
 using mutex_guard = std::lock_guard<std::mutex>;
 
 
+/**
+ * Multi-producer single-consumer queue of randpa messages.
+ * Producers never block: messages are pushed into lock-free queues, and the mutex is taken
+ * only to wake up the consumer when it's waiting. High priority messages (events) are always
+ * drained before normal ones (network messages), so a flood of votes cannot delay them.
+ */
 template <typename message_type>
 class message_queue {
 public:
-    using message_ptr = std::shared_ptr<message_type>;
+    static constexpr size_t default_capacity = 1024;
 
 public:
-    template <typename T>
-    void push_message(const T& msg) {
-        mutex_guard lock(_message_queue_mutex);
-
-        auto randpa_msg = std::make_shared<message_type>(msg);
-        _message_queue.push(randpa_msg);
-
-        if (_need_notify) {
-            _new_msg_cond.notify_one();
+    ~message_queue() {
+        queue_item* item = nullptr;
+        while (pop(item)) {
+            delete item;
         }
     }
 
-    message_ptr get_next_msg() {
-        mutex_guard lock(_message_queue_mutex);
+    template <typename T>
+    void push_message(const T& msg, bool high_priority = false) {
+        auto item = new queue_item { message_type(msg), fc::time_point::now() };
+        auto& queue = high_priority ? _high_priority_queue : _queue;
+        queue.push(item);
+        _size++;
 
-        if (!_message_queue.size()) {
-            _need_notify = true;
-            return nullptr;
-        } else {
-            _need_notify = false;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_need_notify) {
+            mutex_guard lock(_message_queue_mutex);
+            _new_msg_cond.notify_one();
         }
-
-        auto msg = _message_queue.front();
-        _message_queue.pop();
-
-        return msg;
     }
 
-    message_ptr get_next_msg_wait() {
-        while (true) {
-            if (_need_notify) {
-                std::unique_lock<std::mutex> lk(_message_queue_mutex);
-
-                _new_msg_cond.wait(lk, [this](){
-                    return (bool)_message_queue.size() || _done;
-                });
+    /**
+     * Waits for messages and moves up to `max_batch_size` of them into `batch`, high priority first.
+     * Returns false if queue was terminated.
+     */
+    bool get_next_msgs_wait(vector<message_type>& batch, size_t max_batch_size) {
+        batch.clear();
+        while (!_done) {
+            queue_item* item = nullptr;
+            while (batch.size() < max_batch_size && pop(item)) {
+                std::unique_ptr<queue_item> item_ptr(item);
+                _last_wait_time_us = (fc::time_point::now() - item_ptr->push_time).count();
+                batch.push_back(std::move(item_ptr->msg));
             }
 
-            if (_done)
-                return nullptr;
-
-            auto msg = get_next_msg();
-
-            if (msg) {
-                return msg;
+            if (!batch.empty()) {
+                return true;
             }
+
+            std::unique_lock<std::mutex> lk(_message_queue_mutex);
+            _need_notify = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            _new_msg_cond.wait(lk, [this]() {
+                return !_high_priority_queue.empty() || !_queue.empty() || _done;
+            });
+            _need_notify = false;
         }
+        return false;
     }
 
     void terminate() {
         _done = true;
+        mutex_guard lock(_message_queue_mutex);
         _new_msg_cond.notify_one();
     }
 
-    auto size() {
-        mutex_guard lock(_message_queue_mutex);
-        return _message_queue.size();
+    size_t size() const {
+        return _size;
+    }
+
+    // time the last popped message spent in the queue
+    fc::microseconds get_last_wait_time() const {
+        return fc::microseconds(_last_wait_time_us);
     }
 
 private:
+    struct queue_item {
+        message_type msg;
+        fc::time_point push_time;
+    };
+
+    bool pop(queue_item*& item) {
+        if (_high_priority_queue.pop(item) || _queue.pop(item)) {
+            _size--;
+            return true;
+        }
+        return false;
+    }
+
     std::mutex _message_queue_mutex;
-    bool _need_notify = true;
     std::condition_variable _new_msg_cond;
-    std::queue<message_ptr> _message_queue;
+    std::atomic<bool> _need_notify { false };
+    boost::lockfree::queue<queue_item*> _high_priority_queue { default_capacity };
+    boost::lockfree::queue<queue_item*> _queue { default_capacity };
+    std::atomic<size_t> _size { 0 };
+    std::atomic<int64_t> _last_wait_time_us { 0 };
     std::atomic<bool> _done { false };
 };
 
@@ -142,7 +174,6 @@ struct randpa_event {
 };
 
 using randpa_message = static_variant<randpa_net_msg, randpa_event>;
-using randpa_message_ptr = shared_ptr<randpa_message>;
 
 
 using net_channel = channel<const randpa_net_msg&>;
@@ -156,9 +187,12 @@ using finality_channel_ptr = std::shared_ptr<finality_channel>;
 
 class randpa {
 public:
-    static constexpr uint32_t round_width = 2;
-    static constexpr uint32_t prevote_width = 1;
+    static constexpr uint32_t default_round_width = 2;
+    static constexpr uint32_t default_prevote_width = 1;
     static constexpr uint32_t msg_expiration_ms = 1000;
+    static constexpr size_t max_recovered_keys = 10000;
+    static constexpr size_t max_known_messages = 100000;
+    static constexpr size_t max_msg_batch_size = 64;
 
 public:
     randpa() {
@@ -188,6 +222,20 @@ public:
         return *this;
     }
 
+    // signatures of votes are recovered in batches on this pool; without it recovery is done in place
+    randpa& set_thread_pool(boost::asio::thread_pool& thread_pool) {
+        _thread_pool = &thread_pool;
+        return *this;
+    }
+
+    // round consists of round_width blocks, prevote stage ends at block prevote_width of the round
+    randpa& set_round_width(uint32_t round_width, uint32_t prevote_width) {
+        FC_ASSERT(prevote_width > 0 && prevote_width < round_width, "prevote width should be in [1, round width)");
+        _round_width = round_width;
+        _prevote_width = prevote_width;
+        return *this;
+    }
+
     randpa& set_signature_provider(const signature_provider_type& signature_provider,
         const public_key_type& public_key) {
         _signature_provider = signature_provider;
@@ -203,6 +251,7 @@ public:
 
         _prefix_tree = tree;
         _lib = tree->get_root()->block_id;
+        update_head_block_num();
 
 #ifndef SYNC_RANDPA
         _thread_ptr.reset(new std::thread([this]() {
@@ -233,8 +282,42 @@ public:
         return _prefix_tree;
     }
 
+    // relay stats of the last round evicted from known messages
+    size_t get_last_round_relayed_msgs() const {
+        return _last_round_relayed_msgs;
+    }
+
+    size_t get_last_round_relayed_bytes() const {
+        return _last_round_relayed_bytes;
+    }
+
+    // head of the prefix tree as of the last event handled, safe to read from other threads
+    uint32_t get_head_block_num() const {
+        return _head_block_num;
+    }
+
 private:
+    using recovery_key_type = pair<digest_type, signature_type>;
+
+    struct round_known_messages {
+        std::set<digest_type> seen; // messages relayed or processed by this node
+        std::map<public_key_type, std::set<digest_type>> peers; // messages sent to or received from peers
+        size_t size { 0 };
+        size_t relayed_msgs { 0 };
+        size_t relayed_bytes { 0 };
+    };
+
+    using known_messages_map = std::map<uint32_t, round_known_messages>;
+
+    struct recovery_request {
+        digest_type digest;
+        signature_type signature;
+        std::function<void(const public_key_type&)> set_public_key;
+    };
+
     std::unique_ptr<std::thread> _thread_ptr;
+    boost::asio::thread_pool* _thread_pool { nullptr };
+    std::map<recovery_key_type, public_key_type> _recovered_keys;
     std::atomic<bool> _done { false };
     signature_provider_type _signature_provider;
     public_key_type _public_key;
@@ -243,8 +326,14 @@ private:
     block_id_type _lib;
     uint32_t _last_prooved_block_num { 0 };
     std::map<public_key_type, uint32_t> _peers;
-    std::map<public_key_type, std::set<digest_type>> known_messages;
+    known_messages_map _known_messages;
+    size_t _known_messages_size { 0 };
+    std::atomic<size_t> _last_round_relayed_msgs { 0 };
+    std::atomic<size_t> _last_round_relayed_bytes { 0 };
+    std::atomic<uint32_t> _head_block_num { 0 };
     bool _provided_bp_key { false };
+    uint32_t _round_width { default_round_width };
+    uint32_t _prevote_width { default_prevote_width };
 
 #ifndef SYNC_RANDPA
     message_queue<randpa_message> _message_queue;
@@ -259,7 +348,7 @@ private:
         _in_net_channel->subscribe([&](const randpa_net_msg& msg) {
             dlog("Randpa received net message, type: ${type}", ("type", msg.data.which()));
 #ifdef SYNC_RANDPA
-            process_msg(std::make_shared<randpa_message>(msg));
+            process_msg(randpa_message(msg));
 #else
             _message_queue.push_message(msg);
 #endif
@@ -268,9 +357,9 @@ private:
         _in_event_channel->subscribe([&](const randpa_event& event) {
             dlog("Randpa received event, type: ${type}", ("type", event.data.which()));
 #ifdef SYNC_RANDPA
-            process_msg(std::make_shared<randpa_message>(event));
+            process_msg(randpa_message(event));
 #else
-            _message_queue.push_message(event);
+            _message_queue.push_message(event, true);
 #endif
         });
     }
@@ -287,34 +376,200 @@ private:
 
     template <typename T>
     void bcast(const T & msg) {
-        auto msg_hash = digest_type::hash(msg);
+        const auto msg_hash = digest_type::hash(msg);
+        mark_seen(msg.data.round_num, msg_hash);
+        bcast(msg, msg_hash);
+    }
+
+    template <typename T>
+    void bcast(const T & msg, const digest_type& msg_hash) {
+        auto& known = _known_messages[msg.data.round_num];
+        size_t msg_size = 0;
         for (const auto& peer: _peers) {
-            if (!known_messages[peer.first].count(msg_hash)) {
+            if (known.peers[peer.first].insert(msg_hash).second) {
                 send(peer.second, msg);
-                known_messages[peer.first].insert(msg_hash);
+                known.size++;
+                _known_messages_size++;
+                if (!msg_size) {
+                    msg_size = fc::raw::pack_size(msg);
+                }
+                known.relayed_msgs++;
+                known.relayed_bytes += msg_size;
             }
         }
+        prune_known_messages_by_size();
+    }
+
+    // returns false if message was already seen
+    bool mark_seen(uint32_t round_num, const digest_type& msg_hash) {
+        auto& known = _known_messages[round_num];
+        if (!known.seen.insert(msg_hash).second) {
+            return false;
+        }
+        known.size++;
+        _known_messages_size++;
+        return true;
+    }
+
+    void unmark_seen(uint32_t round_num, const digest_type& msg_hash) {
+        auto& known = _known_messages[round_num];
+        if (known.seen.erase(msg_hash)) {
+            known.size--;
+            _known_messages_size--;
+        }
+    }
+
+    void mark_known_by_peer(uint32_t ses_id, uint32_t round_num, const digest_type& msg_hash) {
+        auto peer_itr = std::find_if(_peers.begin(), _peers.end(), [ses_id](const auto& peer) {
+            return peer.second == ses_id;
+        });
+        if (peer_itr == _peers.end()) {
+            return;
+        }
+
+        auto& known = _known_messages[round_num];
+        if (known.peers[peer_itr->first].insert(msg_hash).second) {
+            known.size++;
+            _known_messages_size++;
+        }
+    }
+
+    // removes known messages of rounds older than `min_round_num`
+    void prune_known_messages(uint32_t min_round_num) {
+        auto end_itr = _known_messages.lower_bound(min_round_num);
+        for (auto itr = _known_messages.begin(); itr != end_itr; ) {
+            itr = erase_known_messages(itr);
+        }
+    }
+
+    void prune_known_messages_by_size() {
+        while (_known_messages_size > max_known_messages && _known_messages.size() > 1) {
+            erase_known_messages(_known_messages.begin());
+        }
+    }
+
+    void update_head_block_num() {
+        _head_block_num = get_block_num(_prefix_tree->get_head()->block_id);
+    }
+
+    known_messages_map::iterator erase_known_messages(known_messages_map::iterator itr) {
+        dlog("Randpa relayed ${cnt} messages (${bytes} bytes) in round ${r}",
+            ("cnt", itr->second.relayed_msgs)
+            ("bytes", itr->second.relayed_bytes)
+            ("r", itr->first)
+        );
+        _last_round_relayed_msgs = itr->second.relayed_msgs;
+        _last_round_relayed_bytes = itr->second.relayed_bytes;
+        _known_messages_size -= itr->second.size;
+        return _known_messages.erase(itr);
+    }
+
+    template <typename T>
+    static void add_recovery_request(vector<recovery_request>& requests, const network_msg<T>& msg) {
+        requests.push_back({ msg.hash(), msg.signature, [&msg](const public_key_type& key) {
+            msg.set_public_key(key);
+        } });
+    }
+
+    /**
+     * Recovers signer keys for all requests, skipping (digest, signature) pairs recovered before.
+     * If there is more than one key to recover and thread pool is set, keys are recovered on the pool
+     * and the calling thread only waits for results.
+     */
+    void recover_public_keys(const vector<recovery_request>& requests) {
+        vector<const recovery_request*> missed;
+        for (const auto& request : requests) {
+            auto itr = _recovered_keys.find({ request.digest, request.signature });
+            if (itr != _recovered_keys.end()) {
+                request.set_public_key(itr->second);
+            } else {
+                missed.push_back(&request);
+            }
+        }
+
+        if (_recovered_keys.size() + missed.size() > max_recovered_keys) {
+            _recovered_keys.clear();
+        }
+
+        if (!_thread_pool || missed.size() < 2) {
+            for (const auto request : missed) {
+                try {
+                    auto key = public_key_type(request->signature, request->digest);
+                    _recovered_keys.emplace(recovery_key_type{ request->digest, request->signature }, key);
+                    request->set_public_key(key);
+                } catch (const fc::exception& e) {
+                    dlog("Randpa failed to recover public key, reason: ${e}", ("e", e.what()));
+                }
+            }
+            return;
+        }
+
+        vector<std::future<public_key_type>> futures;
+        futures.reserve(missed.size());
+        for (const auto request : missed) {
+            auto task = std::make_shared<std::packaged_task<public_key_type()>>(
+                [digest = request->digest, signature = request->signature]() {
+                    return public_key_type(signature, digest);
+                });
+            futures.push_back(task->get_future());
+            boost::asio::post(*_thread_pool, [task]() { (*task)(); });
+        }
+
+        for (size_t i = 0; i < missed.size(); i++) {
+            try {
+                auto key = futures[i].get();
+                _recovered_keys.emplace(recovery_key_type{ missed[i]->digest, missed[i]->signature }, key);
+                missed[i]->set_public_key(key);
+            } catch (const fc::exception& e) {
+                // key is left unset, so `public_key()` will fail the same way in the message handler
+                dlog("Randpa failed to recover public key, reason: ${e}", ("e", e.what()));
+            }
+        }
+    }
+
+    template <typename T>
+    void recover_public_keys(const network_msg<T>& msg) {
+        vector<recovery_request> requests;
+        add_recovery_request(requests, msg);
+        recover_public_keys(requests);
+    }
+
+    void recover_public_keys(const proof_msg& msg) {
+        const auto& proof = msg.data;
+        vector<recovery_request> requests;
+        requests.reserve(proof.prevotes.size() + proof.precommits.size() + 1);
+
+        add_recovery_request(requests, msg);
+        for (const auto& prevote : proof.prevotes) {
+            add_recovery_request(requests, prevote);
+        }
+        for (const auto& precommit : proof.precommits) {
+            add_recovery_request(requests, precommit);
+        }
+        recover_public_keys(requests);
     }
 
 #ifndef SYNC_RANDPA
     void loop() {
-        while (true) {
-            auto msg = _message_queue.get_next_msg_wait();
+        vector<randpa_message> batch;
+        batch.reserve(max_msg_batch_size);
 
-            if (_done) {
-                break;
-            }
+        while (_message_queue.get_next_msgs_wait(batch, max_msg_batch_size)) {
+            for (const auto& msg : batch) {
+                if (_done) {
+                    return;
+                }
 
-            dlog("Randpa message processing started, type: ${type}", ("type", msg->which()));
+                dlog("Randpa message processing started, type: ${type}", ("type", msg.which()));
 
-            process_msg(msg);
+                process_msg(msg);
+            }
         }
     }
 #endif
 
     // need handle all messages
-    void process_msg(randpa_message_ptr msg_ptr) {
-        auto msg = *msg_ptr;
+    void process_msg(const randpa_message& msg) {
         switch (msg.which()) {
             case randpa_message::tag<randpa_net_msg>::value:
                 process_net_msg(msg.get<randpa_net_msg>());
@@ -422,7 +677,7 @@ private:
         }
 
         set<public_key_type> prevoted_keys, precommited_keys;
-        const auto& bp_keys = node->active_bp_keys;
+        const auto& bp_keys = node->active_bp_keys();
 
         for (const auto& prevote : proof.prevotes) {
             const auto& prevoter_pub_key = prevote.public_key();
@@ -448,7 +703,7 @@ private:
             }
             precommited_keys.insert(precommiter_pub_key);
         }
-        return precommited_keys.size() > node->active_bp_keys.size() * 2 / 3;
+        return precommited_keys.size() > bp_keys.size() * 2 / 3;
     }
 
     void on(uint32_t ses_id, const proof_msg& msg) {
@@ -477,6 +732,8 @@ private:
             return;
         }
 
+        recover_public_keys(msg);
+
         if (!validate_proof(proof)) {
             ilog("Invalid proof from ${peer}", ("peer", msg.public_key()));
             dlog("Proof msg: ${msg}", ("msg", msg));
@@ -533,6 +790,7 @@ private:
             );
             return;
         }
+        update_head_block_num();
 
         if (event.sync) {
             ilog("Randpa omit block while syncing, id: ${id}", ("id", event.block_id));
@@ -576,34 +834,39 @@ private:
 
     template <typename T>
     void process_round_msg(uint32_t ses_id, const T& msg) {
-        auto last_round_num = round_num(_prefix_tree->get_head()->block_id);
-
-        if (last_round_num == msg.data.round_num) {
-            bcast(msg);
-        }
+        const auto msg_round_num = msg.data.round_num;
+        const auto msg_hash = digest_type::hash(msg);
 
-        auto msg_hash = digest_type::hash(msg);
+        mark_known_by_peer(ses_id, msg_round_num, msg_hash);
 
-        if (known_messages[_public_key].count(msg_hash)) {
+        if (!mark_seen(msg_round_num, msg_hash)) {
             dlog("Message already known");
             return;
         }
 
+        auto last_round_num = round_num(_prefix_tree->get_head()->block_id);
+
+        if (last_round_num == msg_round_num) {
+            bcast(msg, msg_hash);
+        }
+
         if (!_round) {
             dlog("Randpa round does not exists");
+            // message could be processed when round starts, peers that know it are still remembered
+            unmark_seen(msg_round_num, msg_hash);
             return;
         }
 
+        recover_public_keys(msg);
         _round->on(msg);
-        known_messages[_public_key].insert(msg_hash);
     }
 
     uint32_t round_num(const block_id_type& block_id) const {
-        return (get_block_num(block_id) - 1) / round_width;
+        return (get_block_num(block_id) - 1) / _round_width;
     }
 
     uint32_t num_in_round(const block_id_type& block_id) const {
-        return (get_block_num(block_id) - 1) % round_width;
+        return (get_block_num(block_id) - 1) % _round_width;
     }
 
     bool should_start_round(const block_id_type& block_id) const {
@@ -624,7 +887,7 @@ private:
         }
 
         return round_num(block_id) == _round->get_num()
-            && num_in_round(block_id) == prevote_width;
+            && num_in_round(block_id) == _prevote_width;
     }
 
     bool is_active_bp(const block_id_type& block_id) const {
@@ -637,7 +900,7 @@ private:
             return false;
         }
 
-        return node_ptr->active_bp_keys.count(_public_key);
+        return node_ptr->active_bp_keys().count(_public_key);
     }
 
     void finish_round() {
@@ -677,23 +940,22 @@ private:
     }
 
     void remove_round() {
-        known_messages.clear();
+        // keep messages of the previous round, its proof could be still relayed
+        auto last_round_num = round_num(_prefix_tree->get_head()->block_id);
+        if (last_round_num > 0) {
+            prune_known_messages(last_round_num - 1);
+        }
         _prefix_tree->remove_confirmations();
         _round.reset();
     }
 
     void update_lib(const block_id_type& lib_id) {
-        auto node_ptr = _prefix_tree->find(lib_id);
-
-        if (node_ptr) {
-            _prefix_tree->set_root(node_ptr);
-        }
-        else {
-            auto new_irb = std::make_shared<tree_node>(tree_node { lib_id });
-            _prefix_tree->set_root(new_irb);
-        }
-
+        _prefix_tree->set_root(lib_id);
         _lib = lib_id;
+        update_head_block_num();
+        if (get_block_num(lib_id) > 0) {
+            prune_known_messages(round_num(lib_id));
+        }
     }
 };
 
@@ -8,7 +8,7 @@ namespace randpa_finality {
 using tree_node = prefix_node<prevote_msg>;
 using prefix_tree = prefix_chain_tree<tree_node>;
 
-using tree_node_ptr = std::shared_ptr<tree_node>;
+using tree_node_ptr = tree_node*;
 using prefix_tree_ptr = std::shared_ptr<prefix_tree>;
 
 using randpa_round_ptr = std::shared_ptr<class randpa_round>;
@@ -112,12 +112,6 @@ public:
             return;
         }
 
-        proof.round_num = num;
-        proof.best_block = best_node->block_id;
-
-        std::transform(best_node->confirmation_data.begin(), best_node->confirmation_data.end(),
-            std::back_inserter(proof.prevotes), [](const auto& item) -> prevote_msg { return *item.second; });
-
         precommit();
     }
 
@@ -157,7 +151,7 @@ private:
         FC_ASSERT(state == state::ready_to_precommit, "state should be `ready_to_precommit`");
         state = state::precommit;
 
-        auto precommit = precommit_type { num, best_node->block_id };
+        auto precommit = precommit_type { num, proof.best_block };
         auto msg = precommit_msg(precommit, signature_provider);
 
         add_precommit(msg);
@@ -186,7 +180,7 @@ private:
             return false;
         }
 
-        if (!node->active_bp_keys.count(msg.public_key())) {
+        if (!node->active_bp_keys().count(msg.public_key())) {
             dlog("Randpa received prevote for block from not active producer, id : ${id}",
                 ("id", node->block_id)
             );
@@ -210,15 +204,15 @@ private:
             return false;
         }
 
-        if (msg.data.block_id != best_node->block_id) {
+        if (msg.data.block_id != proof.best_block) {
             dlog("Randpa received precommit for not best block, id: ${id}, best_id: ${best_id}",
                 ("id", msg.data.block_id)
-                ("best_id", best_node->block_id)
+                ("best_id", proof.best_block)
             );
             return false;
         }
 
-        if (!best_node->has_confirmation(msg.public_key())) {
+        if (!best_prevoted_keys.count(msg.public_key())) {
             dlog("Randpa received precommit from not prevoted peer");
             return false;
         }
@@ -245,10 +239,17 @@ private:
 
         if (has_threshold_prevotes(max_prevote_node)) {
             state = state::ready_to_precommit;
-            best_node = max_prevote_node;
+            // tree nodes could be pruned by lib update while round is alive, so best node is copied
+            proof.round_num = num;
+            proof.best_block = max_prevote_node->block_id;
+            for (const auto& prevote : tree->get_confirmations(max_prevote_node)) {
+                proof.prevotes.push_back(*prevote);
+                best_prevoted_keys.insert(prevote->public_key());
+            }
+            best_bp_keys_count = max_prevote_node->active_bp_keys().size();
             dlog("Prevote threshold reached, round: ${r}, best block: ${b}",
                 ("r", num)
-                ("b", best_node->block_id)
+                ("b", proof.best_block)
             );
             return;
         }
@@ -258,10 +259,10 @@ private:
         precommited_keys.insert(msg.public_key());
         proof.precommits.push_back(msg);
 
-        if (proof.precommits.size() > 2 * best_node->active_bp_keys.size() / 3) {
+        if (proof.precommits.size() > 2 * best_bp_keys_count / 3) {
             dlog("Precommit threshold reached, round: ${r}, best block: ${b}",
                 ("r", num)
-                ("b", best_node->block_id)
+                ("b", proof.best_block)
             );
             state = state::done;
             done_cb();
@@ -282,7 +283,7 @@ private:
     }
 
     bool has_threshold_prevotes(const tree_node_ptr& node) {
-        return node->confirmation_number() > 2 * node->active_bp_keys.size() / 3;
+        return node->confirmation_number() > 2 * node->active_bp_keys().size() / 3;
     }
 
     uint32_t num { 0 };
@@ -290,7 +291,8 @@ private:
     prefix_tree_ptr tree;
     state state { state::init };
     proof_type proof;
-    tree_node_ptr best_node;
+    std::set<public_key_type> best_prevoted_keys;
+    size_t best_bp_keys_count { 0 };
     signature_provider_type signature_provider;
     prevote_bcaster_type prevote_bcaster;
     precommit_bcaster_type precommit_bcaster;
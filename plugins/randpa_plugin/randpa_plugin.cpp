@@ -60,7 +60,8 @@ public:
             .set_in_net_channel(in_net_ch)
             .set_out_net_channel(out_net_ch)
             .set_event_channel(ev_ch)
-            .set_finality_channel(finality_ch);
+            .set_finality_channel(finality_ch)
+            .set_thread_pool(app().get_plugin<chain_plugin>().chain().get_thread_pool());
 
         subscribe<handshake_msg>(in_net_ch);
         subscribe<handshake_ans_msg>(in_net_ch);
@@ -71,7 +72,10 @@ public:
         _on_accepted_block_handle = app().get_channel<channels::accepted_block>()
         .subscribe( [ev_ch, this]( block_state_ptr s ) {
             app().get_plugin<telemetry_plugin>().update_gauge("randpa_queue_size", _randpa.get_message_queue().size());
-            app().get_plugin<telemetry_plugin>().update_gauge("head_block_num", get_block_num(_randpa.get_prefix_tree()->get_head()->block_id));
+            app().get_plugin<telemetry_plugin>().update_gauge("randpa_queue_wait_us", _randpa.get_message_queue().get_last_wait_time().count());
+            app().get_plugin<telemetry_plugin>().update_gauge("head_block_num", _randpa.get_head_block_num());
+            app().get_plugin<telemetry_plugin>().update_gauge("randpa_round_relayed_msgs", _randpa.get_last_round_relayed_msgs());
+            app().get_plugin<telemetry_plugin>().update_gauge("randpa_round_relayed_bytes", _randpa.get_last_round_relayed_bytes());
             ev_ch->send(randpa_event { on_accepted_block_event {
                     s->id,
                     s->header.previous,
@@ -142,8 +146,11 @@ public:
         });
 
         app().get_plugin<telemetry_plugin>().add_gauge("randpa_queue_size");
+        app().get_plugin<telemetry_plugin>().add_gauge("randpa_queue_wait_us");
         app().get_plugin<telemetry_plugin>().add_gauge("head_block_num");
         app().get_plugin<telemetry_plugin>().add_gauge("lib_block_num");
+        app().get_plugin<telemetry_plugin>().add_gauge("randpa_round_relayed_msgs");
+        app().get_plugin<telemetry_plugin>().add_gauge("randpa_round_relayed_bytes");
 
         app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_total_cnt");
         app().get_plugin<telemetry_plugin>().add_counter("randpa_net_in_prevote_cnt");
@@ -170,7 +177,7 @@ public:
         const auto& ctrl = app().get_plugin<chain_plugin>().chain();
         auto lib_id = ctrl.last_irreversible_block_id();
         dlog("Initializing prefix_chain_tree with ${lib_id}", ("lib_id", lib_id));
-        prefix_tree_ptr tree(new prefix_tree(std::make_shared<tree_node>(tree_node { lib_id })));
+        prefix_tree_ptr tree(new prefix_tree(lib_id));
         dlog("Copying master chain from fork_db");
 
         auto current_block = ctrl.head_block_state();
@@ -0,0 +1,95 @@
+#include <eosio/randpa_plugin/prefix_chain_tree.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+using namespace randpa_finality;
+using std::vector;
+
+using tree_node = prefix_node<uint32_t>;
+using prefix_tree = prefix_chain_tree<tree_node>;
+using bench_clock = std::chrono::steady_clock;
+
+static block_id_type make_block_id(uint32_t block_num, uint32_t fork) {
+    auto block_id = digest_type::hash(std::to_string(block_num) + "/" + std::to_string(fork));
+    block_id._hash[0] = fc::endian_reverse_u32(block_num);
+    return block_id;
+}
+
+static double ops_per_sec(size_t ops, bench_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return us ? ops * 1e6 / us : 0;
+}
+
+/**
+ * Builds a tree of `depth` blocks with a short fork every `fork_step` blocks and measures
+ * block insertion and prevote confirmation throughput the same way randpa uses the tree:
+ * one block per insert, one branch from the root per confirmation.
+ */
+static void run(size_t depth, size_t producers, size_t fork_step) {
+    vector<private_key_type> keys;
+    for (size_t i = 0; i < producers; i++) {
+        keys.push_back(private_key_type::generate());
+    }
+
+    const auto lib_id = make_block_id(0, 0);
+    prefix_tree tree(lib_id);
+
+    auto start = bench_clock::now();
+    auto prev_id = lib_id;
+    size_t inserted = 0;
+    for (uint32_t num = 1; num <= depth; num++) {
+        const auto& creator = keys[num % producers].get_public_key();
+        auto block_id = make_block_id(num, 0);
+        tree.insert({prev_id, {block_id}}, creator, {});
+        inserted++;
+        if (num % fork_step == 0) {
+            tree.insert({prev_id, {make_block_id(num, 1)}}, creator, {});
+            inserted++;
+        }
+        prev_id = block_id;
+    }
+    auto insert_time = bench_clock::now() - start;
+
+    start = bench_clock::now();
+    size_t confirmed = 0;
+    for (const auto& key : keys) {
+        auto chain = tree.get_branch(prev_id);
+        tree.add_confirmations(chain, key.get_public_key(), nullptr);
+        confirmed++;
+    }
+    auto confirm_time = bench_clock::now() - start;
+
+    start = bench_clock::now();
+    auto head = tree.get_final_chain_head(2 * producers / 3 + 1);
+    auto final_head_time = bench_clock::now() - start;
+
+    std::cout << std::setw(8) << depth
+              << std::setw(10) << tree.size()
+              << std::setw(16) << std::fixed << std::setprecision(0) << ops_per_sec(inserted, insert_time)
+              << std::setw(16) << ops_per_sec(confirmed, confirm_time)
+              << std::setw(16) << std::chrono::duration_cast<std::chrono::microseconds>(final_head_time).count()
+              << (head && head->block_id == prev_id ? "" : "  (unexpected final head)")
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const size_t producers = argc > 1 ? std::stoul(argv[1]) : 21;
+    const size_t fork_step = 10;
+
+    std::cout << "producers: " << producers << ", fork every " << fork_step << " blocks" << std::endl;
+    std::cout << std::setw(8) << "depth"
+              << std::setw(10) << "nodes"
+              << std::setw(16) << "inserts/s"
+              << std::setw(16) << "confirms/s"
+              << std::setw(16) << "final_head_us"
+              << std::endl;
+
+    for (size_t depth : {10, 100, 1000, 5000, 20000}) {
+        run(depth, producers, fork_step);
+    }
+    return 0;
+}
@@ -33,17 +33,15 @@ using blocks_type = vector<block_id_type>;
 
 BOOST_AUTO_TEST_CASE(prefix_chain_one_node) try {
     auto lib_block_id = fc::sha256("beef");
-    auto root = std::make_shared<tree_node>(tree_node{lib_block_id});
-    prefix_tree tree(std::move(root));
-    BOOST_REQUIRE_EQUAL(nullptr, tree.get_final_chain_head(1));
+    prefix_tree tree(lib_block_id);
+    BOOST_TEST(!tree.get_final_chain_head(1));
 } FC_LOG_AND_RETHROW()
 
 BOOST_AUTO_TEST_CASE(prefix_chain_two_nodes) try {
     auto lib_block_id = fc::sha256("beef");
-    auto root = std::make_shared<tree_node>(tree_node{lib_block_id});
     auto chain = chain_type{lib_block_id,
                             vector<block_id_type>{fc::sha256("a")}};
-    prefix_tree tree(std::move(root));
+    prefix_tree tree(lib_block_id);
     tree.insert(chain, get_pub_key(), {});
     tree.add_confirmations(chain, get_pub_key(), 0);
     auto head = tree.get_final_chain_head(1);
@@ -62,8 +60,7 @@ BOOST_AUTO_TEST_CASE(prefix_chain_test_longest) try {
     auto pub_key_1 = get_pub_key();
     auto pub_key_2 = get_pub_key();
     auto lib_block_id = fc::sha256("beef");
-    auto root = std::make_shared<tree_node>(tree_node{lib_block_id});
-    prefix_tree tree(std::move(root));
+    prefix_tree tree(lib_block_id);
     std::map<char, block_id_type> blocks;
     for (char c = 'a'; c <= 'd'; c++) {
         blocks[c] = fc::sha256(std::string{c});
@@ -92,31 +89,95 @@ BOOST_AUTO_TEST_CASE(prefix_chain_internal) try {
     auto pub_key_2 = get_pub_key();
 
     auto lib_block_id = fc::sha256("beef");
-    auto node = tree_node{lib_block_id};
-
-    prefix_tree tree(std::make_shared<tree_node>(node));
+    prefix_tree tree(lib_block_id);
     auto chain = chain_type{lib_block_id, blocks_type{fc::sha256("abc"), fc::sha256("def")}};
     tree.insert(chain, pub_key_1, {});
     tree.add_confirmations(chain, pub_key_1, 0);
 
     const auto root = tree.get_root();
     BOOST_REQUIRE_EQUAL(lib_block_id, root->block_id);
-    BOOST_REQUIRE_EQUAL(1, root->adjacent_nodes.size());
+    BOOST_REQUIRE_EQUAL(1, tree.get_children(root).size());
 
-    const auto chain_first_node = root->adjacent_nodes[0];
+    const auto chain_first_node = tree.get_children(root)[0];
     BOOST_TEST(tree.find(fc::sha256("abc")) == chain_first_node);
-    BOOST_TEST(chain_first_node->adjacent_nodes[0] == tree.get_final_chain_head(1));
+    BOOST_TEST(tree.get_children(chain_first_node)[0] == tree.get_final_chain_head(1));
 
     // add second chain
     chain = chain_type{fc::sha256("abc"), blocks_type{fc::sha256("bbc")}};
     tree.insert(chain, pub_key_2, {});
     tree.add_confirmations(chain, pub_key_2, 0);
 
-    BOOST_REQUIRE_EQUAL(2, chain_first_node->adjacent_nodes.size());
+    BOOST_REQUIRE_EQUAL(2, tree.get_children(chain_first_node).size());
     BOOST_TEST(chain_first_node == tree.get_final_chain_head(2));
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_AUTO_TEST_CASE(prefix_chain_find_after_set_root) try {
+    /*
+     ++++++++A++++++++++++++
+     ++++++++|\+++++++++++++
+     ++++++++B+C++++++++++++
+     ++++++++++|++++++++++++
+     ++++++++++D++++++++++++
+     */
+    auto pub_key = get_pub_key();
+    auto lib_block_id = fc::sha256("beef");
+    prefix_tree tree(lib_block_id);
+    std::map<char, block_id_type> blocks;
+    for (char c = 'a'; c <= 'd'; c++) {
+        blocks[c] = fc::sha256(std::string{c});
+    }
+    tree.insert({lib_block_id, blocks_type{blocks['a'], blocks['b']}}, pub_key, {});
+    tree.insert({blocks['a'], blocks_type{blocks['c'], blocks['d']}}, pub_key, {});
+    BOOST_REQUIRE_EQUAL(5, tree.size());
+    BOOST_TEST(tree.get_parent(tree.find(blocks['d'])) == tree.find(blocks['c']));
+
+    tree.set_root(blocks['c']);
+    BOOST_REQUIRE_EQUAL(2, tree.size());
+    BOOST_TEST(!tree.find(lib_block_id));
+    BOOST_TEST(!tree.find(blocks['a']));
+    BOOST_TEST(!tree.find(blocks['b']));
+    BOOST_TEST(tree.find(blocks['c']) == tree.get_root());
+    BOOST_TEST(tree.find(blocks['d']));
+
+    auto new_lib_block_id = fc::sha256("cafe");
+    tree.set_root(new_lib_block_id);
+    BOOST_REQUIRE_EQUAL(1, tree.size());
+    BOOST_TEST(!tree.find(blocks['d']));
+    BOOST_TEST(tree.find(new_lib_block_id) == tree.get_root());
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(prefix_chain_confirmations) try {
+    auto pub_key_1 = get_pub_key();
+    auto pub_key_2 = get_pub_key();
+    auto bp_keys = std::set<public_key_type>{pub_key_1, pub_key_2};
+
+    auto lib_block_id = fc::sha256("beef");
+    prefix_tree tree(lib_block_id);
+    auto chain = chain_type{lib_block_id, blocks_type{fc::sha256("a"), fc::sha256("b")}};
+    tree.insert(chain, pub_key_1, bp_keys);
+
+    const auto node_a = tree.find(fc::sha256("a"));
+    const auto node_b = tree.find(fc::sha256("b"));
+    BOOST_TEST(node_a->active_bp_keys() == bp_keys);
+    BOOST_TEST(&node_a->active_bp_keys() == &node_b->active_bp_keys());
+
+    tree.add_confirmations(chain, pub_key_1, std::make_shared<uint32_t>(1));
+    tree.add_confirmations({lib_block_id, blocks_type{fc::sha256("a")}}, pub_key_2, std::make_shared<uint32_t>(2));
+    BOOST_REQUIRE_EQUAL(2, node_a->confirmation_number());
+    BOOST_REQUIRE_EQUAL(1, node_b->confirmation_number());
+    BOOST_TEST(tree.has_confirmation(node_b, pub_key_1));
+    BOOST_TEST(!tree.has_confirmation(node_b, pub_key_2));
+
+    auto confirmations = tree.get_confirmations(node_a);
+    BOOST_REQUIRE_EQUAL(2, confirmations.size());
+    BOOST_REQUIRE_EQUAL(3, *confirmations[0] + *confirmations[1]);
+
+    tree.remove_confirmations();
+    BOOST_REQUIRE_EQUAL(0, node_a->confirmation_number());
+    BOOST_TEST(tree.get_confirmations(node_a).empty());
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -211,19 +272,18 @@ BOOST_AUTO_TEST_SUITE(last_inserted_block_test)
 
 BOOST_AUTO_TEST_CASE(get_last_inserted_block) try {
     auto lib_block_id = fc::sha256("beef");
-    auto root = std::make_shared<tree_node>(tree_node{lib_block_id});
-    auto chain1 = chain_type{lib_block_id, {fc::sha256("a")}};
+        auto chain1 = chain_type{lib_block_id, {fc::sha256("a")}};
     auto chain2 = chain_type{fc::sha256("a"), {fc::sha256("b")}};
     auto pub_key1 = get_pub_key();
     auto pub_key2 = get_pub_key();
     auto unknown_pub_key = get_pub_key();
-    prefix_tree tree(std::move(root));
+    prefix_tree tree(lib_block_id);
     tree.insert(chain1, pub_key1, {});
     tree.insert(chain2, pub_key2, {});
     BOOST_TEST(tree.get_last_inserted_block(pub_key1)->block_id == fc::sha256("a"));
     BOOST_TEST(tree.get_last_inserted_block(pub_key2)->block_id == fc::sha256("b"));
     BOOST_TEST(not tree.get_last_inserted_block(unknown_pub_key));
-    tree.set_root(tree.find(fc::sha256("b")));
+    tree.set_root(fc::sha256("b"));
     BOOST_TEST(not tree.get_last_inserted_block(pub_key1));
 } FC_LOG_AND_RETHROW()
 
@@ -233,10 +293,9 @@ BOOST_AUTO_TEST_SUITE(remove_confirmations)
 
 BOOST_AUTO_TEST_CASE(remove_confirmations_test) try {
     auto lib_block_id = fc::sha256("beef");
-    auto root = std::make_shared<tree_node>(tree_node{lib_block_id});
     auto chain = chain_type{lib_block_id,
                             vector<block_id_type>{fc::sha256("a")}};
-    prefix_tree tree(std::move(root));
+    prefix_tree tree(lib_block_id);
     tree.insert(chain, get_pub_key(), {});
     tree.add_confirmations(chain, get_pub_key(), 0);
     auto head = tree.get_final_chain_head(1);
@@ -5,6 +5,7 @@
 #include <eosio/telemetry_plugin/telemetry_plugin.hpp>
 #include <fc/exception/exception.hpp>
 #include <eosio/chain/plugin_interface.hpp>
+#include <eosio/chain_plugin/chain_plugin.hpp>
 #include <prometheus/exposer.h>
 
 #define LATENCY_HISTOGRAM_KEYPOINTS \
@@ -25,6 +26,8 @@ namespace eosio {
         std::unique_ptr<Exposer> exposer;
         std::shared_ptr<Registry> registry;
 
+        chain::wasm_interface::cache_stats last_wasm_cache_stats;
+
         void start_server() {
             exposer = std::make_unique<Exposer>(endpoint, uri, threads);
         }
@@ -33,6 +36,7 @@ namespace eosio {
             _on_accepted_block_handle = app().get_channel<channels::accepted_block>()
                     .subscribe([this](block_state_ptr s) {
                         update_counter("accepted_trx_total", s->trxs.size());
+                        update_wasm_cache_metrics();
                     });
 
             _on_irreversible_block_handle = app().get_channel<channels::irreversible_block>()
@@ -44,8 +48,27 @@ namespace eosio {
                     });
         }
 
+        void update_wasm_cache_metrics() {
+            auto chain_plug = app().find_plugin<chain_plugin>();
+            if (!chain_plug) {
+                return;
+            }
+            const auto stats = chain_plug->chain().get_wasm_interface().get_cache_stats();
+            update_counter("wasm_cache_hits_total", stats.hits - last_wasm_cache_stats.hits);
+            update_counter("wasm_cache_misses_total", stats.misses - last_wasm_cache_stats.misses);
+            update_counter("wasm_cache_evictions_total", stats.evictions - last_wasm_cache_stats.evictions);
+            update_gauge("wasm_cache_modules", stats.modules);
+            update_gauge("wasm_cache_size_bytes", stats.size);
+            last_wasm_cache_stats = stats;
+        }
+
         void add_metrics() {
             add_counter("accepted_trx_total");
+            add_counter("wasm_cache_hits_total");
+            add_counter("wasm_cache_misses_total");
+            add_counter("wasm_cache_evictions_total");
+            add_gauge("wasm_cache_modules");
+            add_gauge("wasm_cache_size_bytes");
             add_histogram("irreversible_latency", LATENCY_HISTOGRAM_KEYPOINTS);
             add_gauge("last_irreversible_latency");
 
@@ -4,6 +4,7 @@
  */
 #include <eosio/chain/abi_serializer.hpp>
 #include <eosio/chain/block_log.hpp>
+#include <eosio/chain/chunked_block_log.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/reversible_block_object.hpp>
 
@@ -27,15 +28,20 @@ struct blocklog {
    {}
 
    void read_log();
+   void convert_log();
    void set_program_options(options_description& cli);
    void initialize(const variables_map& options);
 
    bfs::path                        blocks_dir;
    bfs::path                        output_file;
+   bfs::path                        output_blocks_dir;
    uint32_t                         first_block;
    uint32_t                         last_block;
    bool                             no_pretty_print;
    bool                             as_json_array;
+   bool                             compress;
+   bool                             decompress;
+   uint32_t                         chunk_blocks;
 };
 
 void blocklog::read_log() {
@@ -130,6 +136,35 @@ void blocklog::read_log() {
       *out << "]";
 }
 
+void blocklog::convert_log() {
+   EOS_ASSERT( compress != decompress, block_log_exception, "Converting a block log takes exactly one of --compress or --decompress" );
+   EOS_ASSERT( !bfs::exists(output_blocks_dir / "blocks.log"), block_log_exception,
+               "Block log already exists in '${dir}'", ("dir", output_blocks_dir.generic_string()) );
+
+   const auto gs = block_log::extract_genesis_state(blocks_dir);
+   block_log in(blocks_dir);
+   EOS_ASSERT( in.head(), block_log_exception, "No blocks found in block log" );
+   const uint32_t first = std::max( std::max(first_block, 1u), in.first_block_num() );
+   const uint32_t last = std::min( last_block, in.head()->block_num() );
+   EOS_ASSERT( first <= last, block_log_exception, "No blocks in the block log between ${f} and ${l}", ("f", first_block)("l", last_block) );
+
+   ilog( "${op} blocks ${f} through ${l} into '${dir}'",
+         ("op", compress ? "compressing" : "decompressing")("f", first)("l", last)("dir", output_blocks_dir.generic_string()) );
+
+   block_log out(output_blocks_dir);
+   out.reset( gs, in.read_block_by_num(first), first, compress ? chunk_blocks : 0 );
+   for( uint32_t block_num = first + 1; block_num <= last; ++block_num ) {
+      auto mapped = in.read_mapped_block_by_num( block_num );
+      EOS_ASSERT( mapped, block_log_exception, "Block ${n} is missing from the block log", ("n", block_num) );
+      auto b = std::make_shared<signed_block>();
+      fc::datastream<const char*> ds( mapped.data, mapped.size );
+      fc::raw::unpack( ds, *b );
+      out.append( b, std::vector<char>( mapped.data, mapped.data + mapped.size ) );
+      if( block_num % 100000 == 0 )
+         ilog( "Converted block ${n}", ("n", block_num) );
+   }
+}
+
 void blocklog::set_program_options(options_description& cli)
 {
    cli.add_options()
@@ -145,6 +180,14 @@ void blocklog::set_program_options(options_description& cli)
           "Do not pretty print the output.  Useful if piping to jq to improve performance.")
          ("as-json-array", bpo::bool_switch(&as_json_array)->default_value(false),
           "Print out json blocks wrapped in json array (otherwise the output is free-standing json objects).")
+         ("output-blocks-dir", bpo::value<bfs::path>(),
+          "convert the block log between --first and --last into a new blocks directory instead of printing it")
+         ("compress", bpo::bool_switch(&compress)->default_value(false),
+          "Write the converted block log compressed in chunks (version 3).")
+         ("decompress", bpo::bool_switch(&decompress)->default_value(false),
+          "Write the converted block log uncompressed (version 2).")
+         ("chunk-blocks", bpo::value<uint32_t>(&chunk_blocks)->default_value(chunked_block_log::default_chunk_blocks),
+          "the number of blocks compressed together by --compress")
          ("help", "Print this help message and exit.")
          ;
 
@@ -165,6 +208,14 @@ void blocklog::initialize(const variables_map& options) {
          else
             output_file = bld;
       }
+
+      if (options.count( "output-blocks-dir" )) {
+         bld = options.at( "output-blocks-dir" ).as<bfs::path>();
+         if( bld.is_relative())
+            output_blocks_dir = bfs::current_path() / bld;
+         else
+            output_blocks_dir = bld;
+      }
    } FC_LOG_AND_RETHROW()
 
 }
@@ -185,7 +236,10 @@ int main(int argc, char** argv)
         return 0;
       }
       blog.initialize(vmap);
-      blog.read_log();
+      if (blog.output_blocks_dir.empty())
+         blog.read_log();
+      else
+         blog.convert_log();
    } catch( const fc::exception& e ) {
       elog( "${e}", ("e", e.to_detail_string()));
       return -1;
@@ -0,0 +1,213 @@
+// Finality benchmark: sweeps topology size, link delays, packet loss and randpa round width,
+// runs DPoS and randpa finality on the same topology and prints one CSV or JSON line per run.
+//
+// Usage:
+//   simulator_benchmark [--nodes 21,50,100] [--delays 10:50,50:200] [--loss 0,0.05]
+//                       [--round-width 2,4] [--topology regular|clusters] [--degree 8]
+//                       [--slots 20] [--threads 1] [--seed 42] [--format csv|json]
+
+#include <simulator.hpp>
+#include <topology.hpp>
+#include <randpa.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct BenchmarkConfig {
+    vector<uint32_t> nodes { 21, 50, 100 };
+    vector<pair<int, int>> delays { {10, 50}, {50, 200} };
+    vector<double> losses { 0 };
+    vector<uint32_t> round_widths { randpa::default_round_width };
+    string topology = "regular";
+    uint32_t degree = 8;
+    uint32_t slots = 20;
+    size_t threads = 1;
+    uint32_t seed = 42;
+    string format = "csv";
+};
+
+struct BenchmarkCase {
+    string mode;
+    uint32_t nodes;
+    pair<int, int> delay;
+    double loss;
+    uint32_t round_width;
+};
+
+template <typename T, typename Parse>
+static vector<T> parse_list(const string& value, Parse parse) {
+    vector<T> result;
+    stringstream ss(value);
+    string item;
+    while (getline(ss, item, ',')) {
+        result.push_back(parse(item));
+    }
+    return result;
+}
+
+static pair<int, int> parse_delay(const string& value) {
+    auto pos = value.find(':');
+    if (pos == string::npos) {
+        auto delay = stoi(value);
+        return {delay, delay};
+    }
+    return {stoi(value.substr(0, pos)), stoi(value.substr(pos + 1))};
+}
+
+static BenchmarkConfig parse_args(int argc, char** argv) {
+    BenchmarkConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string key = argv[i];
+        string value = argv[i + 1];
+        if (key == "--nodes") {
+            config.nodes = parse_list<uint32_t>(value, [](const string& s) { return stoul(s); });
+        } else if (key == "--delays") {
+            config.delays = parse_list<pair<int, int>>(value, parse_delay);
+        } else if (key == "--loss") {
+            config.losses = parse_list<double>(value, [](const string& s) { return stod(s); });
+        } else if (key == "--round-width") {
+            config.round_widths = parse_list<uint32_t>(value, [](const string& s) { return stoul(s); });
+        } else if (key == "--topology") {
+            config.topology = value;
+        } else if (key == "--degree") {
+            config.degree = stoul(value);
+        } else if (key == "--slots") {
+            config.slots = stoul(value);
+        } else if (key == "--threads") {
+            config.threads = stoul(value);
+        } else if (key == "--seed") {
+            config.seed = stoul(value);
+        } else if (key == "--format") {
+            config.format = value;
+        } else {
+            cerr << "Unknown option " << key << endl;
+            exit(1);
+        }
+    }
+    for (auto round_width : config.round_widths) {
+        if (round_width < 2) {
+            cerr << "Round width should be at least 2" << endl;
+            exit(1);
+        }
+    }
+    if (config.topology != "regular" && config.topology != "clusters") {
+        cerr << "Unknown topology " << config.topology << endl;
+        exit(1);
+    }
+    return config;
+}
+
+static graph_type make_graph(const BenchmarkConfig& config, uint32_t nodes, pair<int, int> delay) {
+    std::mt19937 gen(config.seed + nodes);
+    if (config.topology == "clusters") {
+        GeoClustersConfig clusters;
+        clusters.nodes = nodes;
+        clusters.clusters = max<uint32_t>(1, nodes / 20);
+        clusters.min_local_delay = delay.first;
+        clusters.max_local_delay = delay.second;
+        clusters.inter_delay_base = delay.second;
+        return make_geo_clusters_graph(clusters, gen);
+    }
+    auto degree = min(config.degree, nodes - 1);
+    if ((uint64_t(nodes) * degree) % 2) {
+        degree--;
+    }
+    return make_random_regular_graph(nodes, degree, delay.first, delay.second, gen);
+}
+
+static void print_result(const BenchmarkConfig& config, const BenchmarkCase& bench,
+                         const SimulationStats& stats, double wall_ms) {
+    auto bytes = stats.message_bytes + stats.relay_bytes;
+    auto bytes_per_block = stats.finalized_blocks ? double(bytes) / stats.finalized_blocks : 0;
+    if (config.format == "json") {
+        cout << "{\"mode\":\"" << bench.mode << "\""
+             << ",\"topology\":\"" << config.topology << "\""
+             << ",\"nodes\":" << bench.nodes
+             << ",\"min_delay_ms\":" << bench.delay.first
+             << ",\"max_delay_ms\":" << bench.delay.second
+             << ",\"loss\":" << bench.loss
+             << ",\"round_width\":" << bench.round_width
+             << ",\"threads\":" << config.threads
+             << ",\"sim_ms\":" << stats.duration_ms
+             << ",\"produced_blocks\":" << stats.produced_blocks
+             << ",\"finalized_blocks\":" << stats.finalized_blocks
+             << ",\"latency_mean_ms\":" << stats.mean_latency()
+             << ",\"latency_p50_ms\":" << stats.latency_percentile(50)
+             << ",\"latency_p90_ms\":" << stats.latency_percentile(90)
+             << ",\"latency_p99_ms\":" << stats.latency_percentile(99)
+             << ",\"latency_max_ms\":" << stats.latency_percentile(100)
+             << ",\"messages\":" << stats.messages
+             << ",\"dropped_messages\":" << stats.dropped_messages
+             << ",\"relayed_blocks\":" << stats.relayed_blocks
+             << ",\"bytes\":" << bytes
+             << ",\"msgs_per_finalized_block\":" << stats.messages_per_finalized_block()
+             << ",\"bytes_per_finalized_block\":" << bytes_per_block
+             << ",\"wall_ms\":" << wall_ms
+             << "}" << endl;
+    } else {
+        cout << bench.mode << "," << config.topology << "," << bench.nodes << ","
+             << bench.delay.first << "," << bench.delay.second << "," << bench.loss << ","
+             << bench.round_width << "," << config.threads << "," << stats.duration_ms << ","
+             << stats.produced_blocks << "," << stats.finalized_blocks << ","
+             << stats.mean_latency() << "," << stats.latency_percentile(50) << ","
+             << stats.latency_percentile(90) << "," << stats.latency_percentile(99) << ","
+             << stats.latency_percentile(100) << "," << stats.messages << ","
+             << stats.dropped_messages << "," << stats.relayed_blocks << "," << bytes << ","
+             << stats.messages_per_finalized_block() << "," << bytes_per_block << ","
+             << wall_ms << endl;
+    }
+}
+
+static void run_case(const BenchmarkConfig& config, const BenchmarkCase& bench, const graph_type& graph) {
+    srand(config.seed);
+    auto runner = TestRunner(bench.nodes);
+    runner.load_graph(graph);
+    runner.set_log_level(LogLevel::NONE);
+    runner.set_threads(config.threads);
+    runner.set_packet_loss(bench.loss);
+    runner.add_stop_task(config.slots * runner.get_slot_ms());
+
+    auto start = chrono::steady_clock::now();
+    if (bench.mode == "randpa") {
+        RandpaConfig randpa_config;
+        randpa_config.round_width = bench.round_width;
+        randpa_config.prevote_width = min(randpa_config.prevote_width, bench.round_width - 1);
+        runner.run<RandpaNode>(randpa_config);
+    } else {
+        runner.run<Node>();
+    }
+    auto wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    print_result(config, bench, runner.get_stats(), wall_ms);
+}
+
+int main(int argc, char** argv) {
+    auto config = parse_args(argc, argv);
+
+    if (config.format == "csv") {
+        cout << "mode,topology,nodes,min_delay_ms,max_delay_ms,loss,round_width,threads,sim_ms,"
+                "produced_blocks,finalized_blocks,latency_mean_ms,latency_p50_ms,latency_p90_ms,"
+                "latency_p99_ms,latency_max_ms,messages,dropped_messages,relayed_blocks,bytes,"
+                "msgs_per_finalized_block,bytes_per_finalized_block,wall_ms" << endl;
+    }
+
+    for (auto nodes : config.nodes) {
+        for (auto delay : config.delays) {
+            auto graph = make_graph(config, nodes, delay);
+            // DPoS has neither votes to lose nor rounds
+            run_case(config, BenchmarkCase{"dpos", nodes, delay, 0, 0}, graph);
+            for (auto loss : config.losses) {
+                for (auto round_width : config.round_widths) {
+                    run_case(config, BenchmarkCase{"randpa", nodes, delay, loss, round_width}, graph);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -14,21 +14,32 @@ using std::unique_ptr;
 using std::make_unique;
 using randpa_ptr = std::unique_ptr<randpa>;
 
+namespace randpa_finality {
+    inline uint32_t get_message_size(const randpa_net_msg& msg) {
+        return fc::raw::pack_size(msg.data);
+    }
+}
+
 static signature_provider_type make_key_signature_provider(const private_key_type& key) {
    return [key]( const digest_type& digest ) {
       return key.sign(digest);
    };
 }
 
+struct RandpaConfig {
+    uint32_t round_width = randpa::default_round_width;
+    uint32_t prevote_width = randpa::default_prevote_width;
+};
+
 class RandpaNode: public Node {
 public:
-    explicit RandpaNode(int id, Network && net, fork_db && db_, private_key_type private_key):
-        Node(id, std::move(net), std::move(db_), std::move(private_key))
+    explicit RandpaNode(int id, Network && net, fork_db && db_, private_key_type private_key,
+                        const RandpaConfig& config = RandpaConfig()):
+        Node(id, std::move(net), std::move(db_), std::move(private_key)),
+        config(config)
     {
         init();
-        prefix_tree_ptr tree(new prefix_tree(std::make_shared<tree_node>(tree_node {
-            db.last_irreversible_block_id()
-        })));
+        prefix_tree_ptr tree(new prefix_tree(db.last_irreversible_block_id()));
         randpa_impl->start(tree);
     }
 
@@ -38,22 +49,16 @@ public:
     }
 
     virtual void restart() override {
-        cout << "[Node] #" << id << " restarted " << endl;
+        SIM_LOG(this, LogLevel::INFO) << "[Node] #" << id << " restarted " << endl;
         init();
         randpa_impl->start(copy_fork_db());
-        auto runner = get_runner();
-        auto from = this->id;
-        for (uint32_t to = 0; to < runner->get_instances(); to++) {
-            int delay = runner->get_delay_matrix()[from][to];
-            if (from != to && delay != -1) {
-                on_new_peer_event(to);
-            }
+        for (const auto& link : get_runner()->get_links(this->id)) {
+            on_new_peer_event(link.first);
         }
     }
 
     prefix_tree_ptr copy_fork_db() {
-        tree_node_ptr root = std::make_shared<tree_node>(tree_node { db.last_irreversible_block_id() });;
-        prefix_tree_ptr tree(new prefix_tree(std::move(root)));
+        prefix_tree_ptr tree(new prefix_tree(db.last_irreversible_block_id()));
         queue<fork_db_node_ptr> q;
         q.push(db.get_root());
         while (!q.empty()) {
@@ -75,7 +80,7 @@ public:
     }
 
     void on_receive(uint32_t from, void* msg) override {
-        cout << "[Node] #" << this->id << " on_receive " << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << "[Node] #" << this->id << " on_receive " << endl;
         auto data = *static_cast<randpa_net_msg*>(msg);
         data.ses_id = from;
         data.receive_time = fc::time_point::now();
@@ -83,12 +88,12 @@ public:
     }
 
     void on_new_peer_event(uint32_t id) override {
-        cout << "[Node] #" << this->id << " on_new_peer_event " << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << "[Node] #" << this->id << " on_new_peer_event " << endl;
         ev_ch->send(randpa_event { ::on_new_peer_event { id } });
     }
 
     void on_accepted_block_event(pair<block_id_type, public_key_type> block) override {
-        cout << "[Node] #" << this->id << " on_accepted_block_event " << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << "[Node] #" << this->id << " on_accepted_block_event " << endl;
         ev_ch->send(randpa_event { ::on_accepted_block_event { block.first, db.fetch_prev_block_id(block.first),
                                                                 block.second, get_active_bp_keys()
                                                                 } });
@@ -117,9 +122,12 @@ private:
             .set_in_net_channel(in_net_ch)
             .set_out_net_channel(out_net_ch)
             .set_finality_channel(finality_ch)
+            .set_round_width(config.round_width, config.prevote_width)
             .set_signature_provider(make_key_signature_provider(private_key), private_key.get_public_key());
     }
 
+    RandpaConfig config;
+
     net_channel_ptr in_net_ch;
     net_channel_ptr out_net_ch;
     event_channel_ptr ev_ch;
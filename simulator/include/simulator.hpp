@@ -10,11 +10,18 @@
 #include <thread>
 #include <numeric>
 #include <chrono>
+#include <random>
+#include <memory>
+#include <tuple>
+#include <limits>
 #include <fc/bitutil.hpp>
 #include <fc/crypto/sha256.hpp>
 #include <boost/optional.hpp>
 
 #include <database.hpp>
+#include <worker_pool.hpp>
+#include <trace.hpp>
+#include <stats.hpp>
 
 using namespace std;
 using namespace fc::crypto;
@@ -37,8 +44,28 @@ static uint32_t get_block_height(const block_id_type& id) {
     return fc::endian_reverse_u32(id._hash[0]);
 }
 
-static inline auto get_priv_key() {
-    return private_key::generate();
+static inline auto get_priv_key(uint32_t node_id) {
+    // keys are derived from the node index so that runs are reproducible
+    return private_key::regenerate<fc::ecc::private_key_shim>(
+            fc::sha256::hash("simulator_node_" + std::to_string(node_id)));
+}
+
+enum class LogLevel {
+    NONE,
+    INFO,
+    DEBUG,
+};
+
+// Output stream for a log line which is evaluated only if the level is enabled for the runner or node
+#define SIM_LOG(source, level) if (!(source)->log_enabled(level)) {} else cout
+
+static uint32_t get_message_size(const fork_db_chain_type& chain) {
+    return sizeof(block_id_type) + chain.blocks.size() * (sizeof(block_id_type) + sizeof(public_key_type));
+}
+
+template <typename T>
+uint32_t get_message_size(const T& msg) {
+    return sizeof(msg);
 }
 
 class Clock {
@@ -85,14 +112,24 @@ struct Task {
         GENERAL,
     };
     task_type type = GENERAL;
+    // size of the carried message, if any
+    uint32_t size = 0;
+
+    // Scheduling context (node id or runner) and its sequence number, assigned by TestRunner.
+    // They make the order of simultaneous tasks independent of the execution mode.
+    uint32_t owner = 0;
+    uint64_t seq = 0;
 
     bool operator<(const Task& task) const {
-        return at > task.at || (at == task.at && type > task.type);
+        return std::tie(task.at, task.type, task.to, task.owner, task.seq)
+             < std::tie(at, type, to, owner, seq);
     }
 };
 
 using matrix_type = vector<vector<int> >;
 using graph_type = vector<vector<pair<int, int>>>;
+// (peer, delay) pairs sorted by peer
+using links_type = vector<pair<uint32_t, int>>;
 
 class Network {
 public:
@@ -121,7 +158,9 @@ class Node {
 public:
     Node() = default;
     explicit Node(int id, Network && net, fork_db&& db, private_key_type private_key):
-        id(id), net(std::move(net)), db(std::move(db)), private_key(std::move(private_key)) {}
+        id(id), net(std::move(net)), db(std::move(db)), private_key(std::move(private_key)) {
+        last_lib = this->db.get_root();
+    }
     virtual ~Node() = default;
 
     TestRunner* get_runner() const {
@@ -137,23 +176,23 @@ public:
         stringstream ss;
         ss << "[Node] #" << id << " ";
         auto node_id = ss.str();
-        cout << node_id << "Received " << chain.blocks.size() << " blocks " << endl;
-        cout << node_id << chain << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << node_id << "Received " << chain.blocks.size() << " blocks " << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << node_id << chain << endl;
 
         if (db.find(chain.blocks.back().first)) {
-            cout << node_id << "Already got chain head. Skipping chain " << endl;
+            SIM_LOG(this, LogLevel::DEBUG) << node_id << "Already got chain head. Skipping chain " << endl;
             return false;
         }
 
         if (get_block_height(chain.blocks.back().first) <= get_block_height(db.get_master_block_id())) {
-            cout << node_id << "Current master is not smaller than chain head. Skipping chain";
+            SIM_LOG(this, LogLevel::DEBUG) << node_id << "Current master is not smaller than chain head. Skipping chain";
             return false;
         }
 
         try {
             db.insert(chain);
         } catch (const ForkDbInsertException&) {
-            cout << node_id << "Failed to apply chain" << endl;
+            SIM_LOG(this, LogLevel::INFO) << node_id << "Failed to apply chain" << endl;
             pending_chains.push(chain);
             return false;
         }
@@ -164,19 +203,23 @@ public:
         return true;
     }
 
-    inline Clock get_clock() const;
-    inline set<public_key_type> get_active_bp_keys() const;
+    Clock get_clock() const {
+        return clock;
+    }
+
+    inline const set<public_key_type>& get_active_bp_keys() const;
+    inline bool log_enabled(LogLevel level) const;
 
     virtual void on_receive(uint32_t from, void *) {
-        std::cout << "Received from " << from << std::endl;
+        SIM_LOG(this, LogLevel::DEBUG) << "Received from " << from << std::endl;
     }
 
     virtual void on_new_peer_event(uint32_t from) {
-        std::cout << "On new peer event handled by " << id << " at " << get_clock().now() << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << "On new peer event handled by " << id << " at " << get_clock().now() << endl;
     }
 
     virtual void on_accepted_block_event(pair<block_id_type, public_key_type> block) {
-        std::cout << "On accepted block event handled by " << this->id << " at " << get_clock().now() << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << "On accepted block event handled by " << this->id << " at " << get_clock().now() << endl;
     }
 
     virtual void restart() {}
@@ -193,6 +236,37 @@ public:
     bool should_sync() const {
         return !pending_chains.empty();
     }
+
+    // Local time of the task being executed; nodes never read the runner clock
+    // so that they can be processed concurrently.
+    Clock clock;
+    uint64_t task_seq = 0;
+    uint32_t produced_blocks = 0;
+    vector<Task> outbox;
+    // used for packet loss, seeded with the node id
+    std::mt19937 rng;
+    uint64_t dropped_messages = 0;
+
+    // Finality tracking for SimulationStats: creation time of own blocks
+    // and the time when blocks became irreversible on this node
+    vector<pair<block_id_type, uint32_t>> created_blocks;
+    vector<pair<block_id_type, uint32_t>> finalized_blocks;
+    fork_db_node_ptr last_lib;
+
+    void track_finality() {
+        auto lib = db.get_root();
+        if (lib == last_lib) {
+            return;
+        }
+        auto last_lib_height = get_block_height(last_lib->block_id);
+        auto first = finalized_blocks.size();
+        // after sync the new root is a copy which is not linked to the previous one
+        for (auto node = lib; node && get_block_height(node->block_id) > last_lib_height; node = node->parent.lock()) {
+            finalized_blocks.push_back({node->block_id, clock.now()});
+        }
+        reverse(finalized_blocks.begin() + first, finalized_blocks.end());
+        last_lib = lib;
+    }
 };
 
 class TestRunner {
@@ -204,9 +278,7 @@ public:
     }
 
     explicit TestRunner(const matrix_type& matrix) {
-        // TODO check that it's square matrix
-        delay_matrix = matrix;
-        count_dist_matrix();
+        load_matrix(matrix);
     }
 
     void load_graph(const graph_type& graph) {
@@ -214,10 +286,11 @@ public:
             for (auto& val : graph[i]) {
                 int j = val.first;
                 int delay = val.second;
-                delay_matrix[i][j] = delay_matrix[j][i] = delay;
+                set_link(i, j, delay);
+                set_link(j, i, delay);
             }
         }
-        count_dist_matrix();
+        on_topology_changed();
     }
 
     void load_graph_from_file(const char* filename) {
@@ -234,29 +307,38 @@ public:
         while (in >> from >> to >> delay) {
             if (delay != -1) {
                 // assume graph is bidirectional
-                delay_matrix[from][to] = delay_matrix[to][from] = delay;
+                set_link(from, to, delay);
+                set_link(to, from, delay);
             }
         }
-        count_dist_matrix();
+        on_topology_changed();
     }
 
     void load_matrix_from_file(const char* filename) {
         ifstream in(filename);
         int instances;
         in >> instances;
-        init_runner_data(instances);
+        matrix_type matrix(instances, vector<int>(instances));
 
         for (int i = 0; i < instances; i++) {
             for (int j = 0; j < instances; j++) {
-                in >> delay_matrix[i][j];
+                in >> matrix[i][j];
             }
         }
-        count_dist_matrix();
+        load_matrix(matrix);
     }
 
     void load_matrix(const matrix_type& matrix) {
-        delay_matrix = matrix;
-        count_dist_matrix();
+        // TODO check that it's square matrix
+        init_runner_data(matrix.size());
+        for (uint32_t i = 0; i < matrix.size(); i++) {
+            for (uint32_t j = 0; j < matrix[i].size(); j++) {
+                if (i != j) {
+                    set_link(i, j, matrix[i][j]);
+                }
+            }
+        }
+        on_topology_changed();
     }
 
     fork_db_chain_type create_block(NodePtr node) {
@@ -264,14 +346,14 @@ public:
         stringstream ss;
         ss << "[Node] #" << node->id << " ";
         auto node_id = ss.str();
-        cout << node_id << "Generating block" << " at " << clock.now() << endl;
-        cout << node_id << "LIB " << db.last_irreversible_block_id() << endl;
+        SIM_LOG(this, LogLevel::INFO) << node_id << "Generating block" << " at " << node->get_clock().now() << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << node_id << "LIB " << db.last_irreversible_block_id() << endl;
         auto head = db.get_master_head();
         auto head_block_height = fc::endian_reverse_u32(head->block_id._hash[0]);
-        cout << node_id << "Head block height: " << head_block_height << endl;
-        cout << node_id << "Building on top of " << head->block_id << endl;
-        auto new_block_id = generate_block(head_block_height + 1);
-        cout << node_id << "New block: " << new_block_id << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << node_id << "Head block height: " << head_block_height << endl;
+        SIM_LOG(this, LogLevel::DEBUG) << node_id << "Building on top of " << head->block_id << endl;
+        auto new_block_id = generate_block(node, head_block_height + 1);
+        SIM_LOG(this, LogLevel::DEBUG) << node_id << "New block: " << new_block_id << endl;
         return {head->block_id, {{new_block_id, node->private_key.get_public_key()}}};
     }
 
@@ -306,8 +388,9 @@ public:
     }
 
     void update_delay(uint32_t row, uint32_t col, int delay) {
-        delay_matrix[row][col] = delay_matrix[col][row] = delay;
-        count_dist_matrix();
+        set_link(row, col, delay);
+        set_link(col, row, delay);
+        on_topology_changed();
     }
 
     void schedule_producer(uint32_t start_ms, uint32_t producer_id) {
@@ -317,6 +400,7 @@ public:
             task.to = producer_id;
             task.cb = [this](NodePtr node) {
                 auto block = create_block(node);
+                node->created_blocks.push_back({block.blocks[0].first, node->get_clock().now()});
                 relay_block(node, block);
                 node->db.insert(block);
                 node->on_accepted_block_event(block.blocks[0]);
@@ -327,13 +411,15 @@ public:
     }
 
     void schedule_producers() {
-        cout << "[TaskRunner] Scheduling PRODUCERS " << endl;
-        cout << "[TaskRunner] Ordering:  " << "[ " ;
         auto ordering = get_ordering();
-        for (auto x : ordering) {
-            cout << x << " ";
+        if (log_enabled(LogLevel::INFO)) {
+            cout << "[TaskRunner] Scheduling PRODUCERS " << endl;
+            cout << "[TaskRunner] Ordering:  " << "[ " ;
+            for (auto x : ordering) {
+                cout << x << " ";
+            }
+            cout << "]" << endl;
         }
-        cout << "]" << endl;
         auto now = clock.now();
         auto instances = get_instances();
 
@@ -347,19 +433,32 @@ public:
 
     void relay_block(NodePtr node, const fork_db_chain_type& chain) {
         uint32_t from = node->id;
+        const auto& dist = get_distances(from);
         for (uint32_t to = 0; to < get_instances(); to++) {
-            if (from != to && dist_matrix[from][to] != -1) {
-                Task task{from, to, clock.now() + dist_matrix[from][to]};
+            if (from != to && dist[to] != -1) {
+                Task task{from, to, node->get_clock().now() + dist[to]};
                 task.cb = [chain=chain](NodePtr node) {
                     node->apply_chain(chain);
                 };
                 task.type = Task::RELAY_BLOCK;
-                add_task(std::move(task));
+                task.size = get_message_size(chain);
+                add_node_task(from, std::move(task));
             }
         }
     }
 
+    // Sync request reaches the runner not earlier than any message could, which keeps
+    // peer selection out of the concurrently processed time window.
     void schedule_sync(NodePtr node) {
+        Task task{node->id, RUNNER_ID, node->get_clock().now() + get_lookahead_ms()};
+        auto node_id = node->id;
+        task.cb = [this, node_id](NodePtr) {
+            sync_with_best_peer(nodes[node_id]);
+        };
+        add_node_task(node_id, std::move(task));
+    }
+
+    void sync_with_best_peer(NodePtr node) {
         Task task{RUNNER_ID, node->id};
         // syncing with the best peer aka largest master block height
         NodePtr best_peer = node;
@@ -372,23 +471,24 @@ public:
                 best_peer_master_height = current_peer_master_height;
             }
         }
-        task.at = clock.now() + dist_matrix[node->id][best_peer->id];
-        task.cb = [best_peer](NodePtr node) {
-            cout << "[Node #" << node->id << "]" " Executing sync " << endl;
-            const auto& peer_db = best_peer->db;
+        task.at = clock.now() + get_distances(node->id)[best_peer->id];
+        auto best_peer_id = best_peer->id;
+        auto peer_root = deep_copy(best_peer->db.get_root());
+        task.cb = [best_peer_id, peer_root](NodePtr node) {
+            SIM_LOG(node, LogLevel::INFO) << "[Node #" << node->id << "]" " Executing sync " << endl;
             auto& node_db = node->db;
             // sync done
-            cout << "[Node #" << node->id << "]" " best_peer=" << best_peer->id << endl;
+            SIM_LOG(node, LogLevel::INFO) << "[Node #" << node->id << "]" " best_peer=" << best_peer_id << endl;
 
             // Copy fork_db and restart
-            node_db.set_root(deep_copy(peer_db.get_root()));
+            node_db.set_root(deep_copy(peer_root));
             node->restart();
 
             // insert chains that you failed to insert previously
             auto& pending_chains = node->pending_chains;
             while (!pending_chains.empty()) {
                 auto chain = pending_chains.front();
-                cout << "[Node #" << node->id << "]" " Applying chain " << chain << endl;
+                SIM_LOG(node, LogLevel::INFO) << "[Node #" << node->id << "]" " Applying chain " << chain << endl;
                 pending_chains.pop();
                 if (!node->apply_chain(chain)) {
                     break;
@@ -399,54 +499,225 @@ public:
         add_task(std::move(task));
     };
 
-    template <typename TNode = Node>
-    void run() {
-        init_nodes<TNode>(get_instances());
+    // Extra arguments are passed to the constructor of every node
+    template <typename TNode = Node, typename... Args>
+    void run(const Args&... args) {
+        init_nodes<TNode>(get_instances(), args...);
         init_connections();
         add_schedule_task(schedule_time);
         run_loop();
     }
 
     void run_loop() {
-        cout << "[TaskRunner] " << "Run loop " << endl;
+        SIM_LOG(this, LogLevel::INFO) << "[TaskRunner] " << "Run loop " << endl;
         should_stop = false;
         while (!should_stop) {
-            auto task = timeline.top();
-            cout << "[TaskRunner] " << "current_time=" << task.at << " schedule_time=" << schedule_time << endl;
+            const auto& next = timeline.top();
+            if (pool && next.to != RUNNER_ID && get_lookahead_ms() > 0) {
+                run_window();
+                continue;
+            }
+            auto task = next;
+            SIM_LOG(this, LogLevel::DEBUG) << "[TaskRunner] " << "current_time=" << task.at << " schedule_time=" << schedule_time << endl;
             timeline.pop();
             clock.set(task.at);
             if (task.to == RUNNER_ID) {
-                cout << "[TaskRunner] Executing task for " << "TaskRunner" << endl;
+                SIM_LOG(this, LogLevel::DEBUG) << "[TaskRunner] Executing task for " << "TaskRunner" << endl;
                 task.cb(nullptr);
             } else {
-                cout << "[TaskRunner] Gotta task for " << task.to << endl;
-                auto node = nodes[task.to];
-                if (node->should_sync() && task.type != Task::SYNC) {
-                    cout << "[TaskRunner] Skipping task cause node is not synchronized" << endl;
-                } else {
-                    cout << "[TaskRunner] Executing task " << endl;
-                    task.cb(node);
+                execute_node_task(task);
+            }
+            record_task(task);
+
+//            this_thread::sleep_for(chrono::milliseconds(1000));
+        }
+        if (trace) {
+            trace->flush();
+        }
+    }
+
+    // Conservative parallel mode: node tasks earlier than now + lookahead can not be affected
+    // by each other, because every message spends at least the minimal link delay in flight.
+    // Such a window is processed with one worker per node, and the results are the same as
+    // in the sequential mode.
+    void run_window() {
+        auto window_end = timeline.top().at + get_lookahead_ms();
+        vector<uint32_t> active_nodes;
+        while (!timeline.empty() && timeline.top().to != RUNNER_ID && timeline.top().at < window_end) {
+            auto& tasks = window_tasks[timeline.top().to];
+            if (tasks.empty()) {
+                active_nodes.push_back(timeline.top().to);
+            }
+            tasks.push_back(timeline.top());
+            timeline.pop();
+        }
+        SIM_LOG(this, LogLevel::DEBUG) << "[TaskRunner] " << "window=[" << window_tasks[active_nodes[0]].front().at << ", " << window_end << ")"
+             << " nodes=" << active_nodes.size() << endl;
+
+        in_window = true;
+        try {
+            pool->run(active_nodes.size(), [&](size_t i) {
+                for (auto& task : window_tasks[active_nodes[i]]) {
+                    execute_node_task(task);
                 }
-                if (node->should_sync()) {
-                    cout << "[TaskRunner] Scheduling sync for node " << node->id << endl;
-                    schedule_sync(node);
+            });
+        } catch (...) {
+            in_window = false;
+            throw;
+        }
+        in_window = false;
+
+        if (trace) {
+            // keep the trace in the same order as the sequential mode writes it
+            vector<const Task*> executed;
+            for (auto node_id : active_nodes) {
+                for (const auto& task : window_tasks[node_id]) {
+                    executed.push_back(&task);
                 }
             }
+            sort(executed.begin(), executed.end(), [](const Task* lhs, const Task* rhs) { return *rhs < *lhs; });
+            for (auto task : executed) {
+                record_task(*task);
+            }
+        } else {
+            for (auto node_id : active_nodes) {
+                for (const auto& task : window_tasks[node_id]) {
+                    record_task(task);
+                }
+            }
+        }
 
-//            this_thread::sleep_for(chrono::milliseconds(1000));
+        for (auto node_id : active_nodes) {
+            auto& tasks = window_tasks[node_id];
+            clock.set(max(clock.now(), tasks.back().at));
+            tasks.clear();
+            for (auto& task : nodes[node_id]->outbox) {
+                timeline.push(std::move(task));
+            }
+            nodes[node_id]->outbox.clear();
+        }
+    }
+
+    void execute_node_task(const Task& task) {
+        SIM_LOG(this, LogLevel::DEBUG) << "[TaskRunner] Gotta task for " << task.to << endl;
+        auto node = nodes[task.to];
+        node->clock.set(task.at);
+        if (node->should_sync() && task.type != Task::SYNC) {
+            SIM_LOG(this, LogLevel::DEBUG) << "[TaskRunner] Skipping task cause node is not synchronized" << endl;
+        } else {
+            SIM_LOG(this, LogLevel::DEBUG) << "[TaskRunner] Executing task " << endl;
+            task.cb(node);
+        }
+        node->track_finality();
+        if (node->should_sync()) {
+            SIM_LOG(this, LogLevel::INFO) << "[TaskRunner] Scheduling sync for node " << node->id << endl;
+            schedule_sync(node);
+        }
+    }
+
+    // Number of threads used by run_loop; 1 means plain sequential processing.
+    void set_threads(size_t threads) {
+        pool.reset(threads > 1 ? new WorkerPool(threads) : nullptr);
+    }
+
+    size_t get_threads() const {
+        return pool ? pool->size() : 1;
+    }
+
+    // Probability for a node to node message to get lost; block relay is not affected
+    void set_packet_loss(double probability) {
+        packet_loss = probability;
+    }
+
+    bool should_drop_message(uint32_t node_id) {
+        if (packet_loss <= 0) {
+            return false;
+        }
+        auto& node = nodes[node_id];
+        if (std::uniform_real_distribution<double>(0, 1)(node->rng) >= packet_loss) {
+            return false;
+        }
+        node->dropped_messages++;
+        return true;
+    }
+
+    void set_log_level(LogLevel level) {
+        log_level = level;
+    }
+
+    bool log_enabled(LogLevel level) const {
+        return level <= log_level;
+    }
+
+    // Writes every executed task to the file, see TraceWriter
+    void set_trace(const string& path, TraceWriter::Format format = TraceWriter::Format::CSV) {
+        trace.reset(new TraceWriter(path, format));
+    }
+
+    void reset_trace() {
+        trace.reset();
+    }
+
+    SimulationStats get_stats() const {
+        SimulationStats stats = counters;
+        stats.duration_ms = clock.now();
+
+        map<block_id_type, uint32_t> created_at;
+        for (const auto& node : nodes) {
+            for (const auto& block : node->created_blocks) {
+                created_at[block.first] = block.second;
+            }
         }
+        stats.produced_blocks = created_at.size();
+
+        uint32_t min_lib_height = nodes.empty() ? 0 : numeric_limits<uint32_t>::max();
+        for (const auto& node : nodes) {
+            stats.dropped_messages += node->dropped_messages;
+            for (const auto& block : node->finalized_blocks) {
+                auto it = created_at.find(block.first);
+                if (it != created_at.end()) {
+                    stats.finality_latencies_ms.push_back(block.second - it->second);
+                }
+            }
+            min_lib_height = min(min_lib_height, get_block_height(node->db.last_irreversible_block_id()));
+        }
+        stats.finalized_blocks = min_lib_height;
+        sort(stats.finality_latencies_ms.begin(), stats.finality_latencies_ms.end());
+        return stats;
     }
 
-    uint32_t get_instances() {
-        return delay_matrix.size();
+    uint32_t get_instances() const {
+        return links.size();
     }
 
-    const matrix_type& get_delay_matrix() const {
-        return delay_matrix;
+    const links_type& get_links(uint32_t node_id) const {
+        return links[node_id];
     }
 
-    const matrix_type& get_dist_matrix() const {
-        return dist_matrix;
+    // Delay of the direct link, -1 if nodes are not connected
+    int get_delay(uint32_t from, uint32_t to) const {
+        if (from == to) {
+            return 0;
+        }
+        const auto& node_links = links[from];
+        auto it = lower_bound(node_links.begin(), node_links.end(), make_pair(to, numeric_limits<int>::min()));
+        return it != node_links.end() && it->first == to ? it->second : -1;
+    }
+
+    // Shortest path delays from the node to every other one, -1 for unreachable nodes.
+    // Computed on first use and cached until the topology changes. The cache entry of
+    // a node is only filled by the node itself or by the runner, so it is safe to use
+    // from a parallel window.
+    const vector<int>& get_distances(uint32_t from) const {
+        auto& dist = dist_cache[from];
+        if (dist.empty()) {
+            dist = count_distances(from);
+        }
+        return dist;
+    }
+
+    int get_dist(uint32_t from, uint32_t to) const {
+        return get_distances(from)[to];
     }
 
     const vector<NodePtr> get_nodes() const {
@@ -465,8 +736,45 @@ public:
         return clock;
     }
 
+    const Clock& get_node_clock(size_t index) const {
+        return nodes[index]->clock;
+    }
+
     void add_task(Task && task) {
-        timeline.push(task);
+        task.owner = RUNNER_ID;
+        task.seq = task_seq++;
+        timeline.push(std::move(task));
+    }
+
+    // Tasks scheduled while executing a node task; buffered during a parallel window
+    void add_node_task(uint32_t node_id, Task && task) {
+        auto& node = nodes[node_id];
+        task.owner = node_id;
+        task.seq = node->task_seq++;
+        if (in_window) {
+            node->outbox.push_back(std::move(task));
+        } else {
+            timeline.push(std::move(task));
+        }
+    }
+
+    void record_task(const Task& task) {
+        counters.executed_tasks++;
+        if (task.type == Task::NETWORK_MSG) {
+            counters.messages++;
+            counters.message_bytes += task.size;
+        } else if (task.type == Task::RELAY_BLOCK) {
+            counters.relayed_blocks++;
+            counters.relay_bytes += task.size;
+        }
+        if (trace) {
+            trace->write(TraceEvent{task.at, task.to, task.from, task.size, static_cast<uint8_t>(task.type)});
+        }
+    }
+
+    // Minimal link delay, the time no message can travel faster than
+    uint32_t get_lookahead_ms() const {
+        return lookahead_ms;
     }
 
     size_t bft_threshold() {
@@ -477,7 +785,7 @@ public:
         return BLOCK_GEN_MS * blocks_per_slot;
     }
 
-    set<public_key_type> get_active_bp_keys() const {
+    const set<public_key_type>& get_active_bp_keys() const {
         return active_bp_keys;
     }
 
@@ -492,21 +800,23 @@ public:
 
 
 private:
-    block_id_type generate_block(uint32_t block_height) {
-        auto block_id = digest_type::hash(fc::crypto::private_key::generate());
+    block_id_type generate_block(NodePtr node, uint32_t block_height) {
+        auto block_id = digest_type::hash(std::to_string(node->id) + "_" + std::to_string(node->produced_blocks++));
         block_id._hash[0] = fc::endian_reverse_u32(block_height);
         return block_id;
     }
 
-    template <typename TNode>
-    void init_nodes(uint32_t count) {
+    template <typename TNode, typename... Args>
+    void init_nodes(uint32_t count, const Args&... args) {
         nodes.clear();
+        window_tasks.assign(count, {});
         for (auto i = 0; i < count; ++i) {
             // See https://bit.ly/2Wp3Nsf
             auto conf_number = 2 * blocks_per_slot * bft_threshold();
-            auto priv_key = get_priv_key();
+            auto priv_key = get_priv_key(i);
             auto node = std::make_shared<TNode>(i, Network(i, this), fork_db(genesys_block,
-                    conf_number), priv_key);
+                    conf_number), priv_key, args...);
+            node->rng.seed(i);
             nodes.push_back(std::static_pointer_cast<Node>(node));
             active_bp_keys.insert(priv_key.get_public_key());
         }
@@ -514,72 +824,118 @@ private:
 
     void init_connections() {
         for (uint32_t from = 0; from < get_instances(); from++) {
-            for (uint32_t to = 0; to < get_instances(); to++) {
-                int delay = delay_matrix[from][to];
-                if (from != to && delay != -1) {
-                    add_task(Task{from, to, static_cast<uint32_t>(0),
-                                       [from](NodePtr n){ n->on_new_peer_event(from); }});
-                }
+            for (const auto& link : links[from]) {
+                auto to = link.first;
+                add_task(Task{from, to, static_cast<uint32_t>(0),
+                                   [from](NodePtr n){ n->on_new_peer_event(from); }});
             }
         }
     }
 
     void init_runner_data(int instances) {
-        delay_matrix.resize(instances);
+        links.assign(instances, {});
+        on_topology_changed();
+    }
 
-        for (int i = 0; i < instances; i++) {
-            delay_matrix[i] = vector<int>(instances, -1);
-            delay_matrix[i][i] = 0;
+    // Adds, updates or removes (delay == -1) the directed link
+    void set_link(uint32_t from, uint32_t to, int delay) {
+        if (from == to) {
+            return;
+        }
+        auto& node_links = links[from];
+        auto it = lower_bound(node_links.begin(), node_links.end(), make_pair(to, numeric_limits<int>::min()));
+        bool exists = it != node_links.end() && it->first == to;
+        if (delay == -1) {
+            if (exists) {
+                node_links.erase(it);
+            }
+        } else if (exists) {
+            it->second = delay;
+        } else {
+            node_links.insert(it, {to, delay});
         }
-
-        dist_matrix = delay_matrix;
     }
 
-    void count_dist_matrix() {
-        int n = get_instances();
-        dist_matrix = delay_matrix;
+    void on_topology_changed() {
+        dist_cache.assign(get_instances(), {});
+        count_lookahead();
+    }
 
-        for (int k = 0; k < n; ++k) {
-            for (int i = 0; i < n; ++i) {
-                for (int j = 0; j < n; ++j) {
-                    if (dist_matrix[i][k] != -1 && dist_matrix[k][j] != -1) {
-                        auto new_dist = dist_matrix[i][k] + dist_matrix[k][j];
-                        auto& cur_dist = dist_matrix[i][j];
-                        if (cur_dist == -1) {
-                            cur_dist = new_dist;
-                        } else {
-                            cur_dist = min(cur_dist, new_dist);
-                        }
-                    }
+    void count_lookahead() {
+        auto min_delay = numeric_limits<int>::max();
+        for (const auto& node_links : links) {
+            for (const auto& link : node_links) {
+                min_delay = min(min_delay, link.second);
+            }
+        }
+        // without links there is nothing to wait for, one block interval is as good as any
+        lookahead_ms = min_delay == numeric_limits<int>::max() ? BLOCK_GEN_MS : min_delay;
+    }
+
+    vector<int> count_distances(uint32_t from) const {
+        vector<int> dist(get_instances(), -1);
+        using queue_item = pair<int, uint32_t>;
+        priority_queue<queue_item, vector<queue_item>, greater<queue_item>> queue;
+        dist[from] = 0;
+        queue.push({0, from});
+        while (!queue.empty()) {
+            auto item = queue.top();
+            queue.pop();
+            if (item.first != dist[item.second]) {
+                continue;
+            }
+            for (const auto& link : links[item.second]) {
+                auto new_dist = item.first + link.second;
+                auto& cur_dist = dist[link.first];
+                if (cur_dist == -1 || new_dist < cur_dist) {
+                    cur_dist = new_dist;
+                    queue.push({new_dist, link.first});
                 }
             }
         }
+        return dist;
     }
 
     vector<NodePtr> nodes;
-    matrix_type delay_matrix;
-    matrix_type dist_matrix;
+    vector<links_type> links;
+    mutable vector<vector<int>> dist_cache;
     priority_queue<Task> timeline;
     set<public_key_type> active_bp_keys;
     uint32_t schedule_time = DELAY_MS;
     Clock clock;
+    uint64_t task_seq = 0;
+    uint32_t lookahead_ms = BLOCK_GEN_MS;
+
+    unique_ptr<WorkerPool> pool;
+    vector<vector<Task>> window_tasks;
+    bool in_window = false;
+
+    double packet_loss = 0;
+    LogLevel log_level = LogLevel::INFO;
+    unique_ptr<TraceWriter> trace;
+    SimulationStats counters;
 };
 
 
 template <typename T>
 void Network::send(uint32_t to, const T& msg) {
-    auto matrix = runner->get_delay_matrix();
-    assert(matrix[node_id][to] != -1);
+    auto delay = runner->get_delay(node_id, to);
+    assert(delay != -1);
+    if (runner->should_drop_message(node_id)) {
+        return;
+    }
 
-    runner->add_task(Task {
+    Task task {
         node_id,
         to,
-        get_runner()->get_clock().now() + matrix[node_id][to],
+        runner->get_node_clock(node_id).now() + delay,
         [node_id = node_id, msg = msg](NodePtr n) {
             n->on_receive(node_id, (void*)&msg);
         },
         Task::NETWORK_MSG
-    });
+    };
+    task.size = get_message_size(msg);
+    runner->add_node_task(node_id, std::move(task));
 }
 
 template <typename T>
@@ -587,10 +943,10 @@ void Network::bcast(const T& msg) {
     //TODO bcast to all nodes with calculate routes
 }
 
-inline Clock Node::get_clock() const {
-    return get_runner()->get_clock();
+inline const set<public_key_type>& Node::get_active_bp_keys() const {
+    return get_runner()->get_active_bp_keys();
 }
 
-inline set<public_key_type> Node::get_active_bp_keys() const {
-    return get_runner()->get_active_bp_keys();
+inline bool Node::log_enabled(LogLevel level) const {
+    return get_runner()->log_enabled(level);
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <ostream>
+#include <cstdint>
+
+using std::vector;
+
+// Summary of a simulation run, see TestRunner::get_stats
+struct SimulationStats {
+    uint32_t duration_ms = 0;
+    uint64_t executed_tasks = 0;
+    uint64_t messages = 0;
+    uint64_t message_bytes = 0;
+    uint64_t dropped_messages = 0;
+    uint64_t relayed_blocks = 0;
+    uint64_t relay_bytes = 0;
+    uint32_t produced_blocks = 0;
+    // blocks which are irreversible on every node
+    uint32_t finalized_blocks = 0;
+    // time from block creation to its finalization, one sample per node and block; sorted
+    vector<uint32_t> finality_latencies_ms;
+
+    double messages_per_block() const {
+        return produced_blocks ? double(messages) / produced_blocks : 0;
+    }
+
+    double messages_per_finalized_block() const {
+        return finalized_blocks ? double(messages) / finalized_blocks : 0;
+    }
+
+    double bytes_per_finalized_block() const {
+        return finalized_blocks ? double(message_bytes) / finalized_blocks : 0;
+    }
+
+    // nearest-rank percentile, p in [0, 100]
+    uint32_t latency_percentile(double p) const {
+        if (finality_latencies_ms.empty()) {
+            return 0;
+        }
+        auto rank = static_cast<size_t>(p / 100 * finality_latencies_ms.size());
+        return finality_latencies_ms[std::min(rank, finality_latencies_ms.size() - 1)];
+    }
+
+    double mean_latency() const {
+        if (finality_latencies_ms.empty()) {
+            return 0;
+        }
+        return std::accumulate(finality_latencies_ms.begin(), finality_latencies_ms.end(), 0.0)
+             / finality_latencies_ms.size();
+    }
+
+    void print(std::ostream& os) const {
+        os << "duration_ms=" << duration_ms
+           << " tasks=" << executed_tasks
+           << " messages=" << messages
+           << " message_bytes=" << message_bytes
+           << " dropped_messages=" << dropped_messages
+           << " relayed_blocks=" << relayed_blocks
+           << " relay_bytes=" << relay_bytes
+           << " produced_blocks=" << produced_blocks
+           << " finalized_blocks=" << finalized_blocks
+           << " msgs_per_block=" << messages_per_block()
+           << " latency_mean_ms=" << mean_latency()
+           << " latency_p50_ms=" << latency_percentile(50)
+           << " latency_p90_ms=" << latency_percentile(90)
+           << " latency_p99_ms=" << latency_percentile(99)
+           << " latency_max_ms=" << latency_percentile(100)
+           << std::endl;
+    }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+#include <set>
+#include <random>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include <simulator.hpp>
+
+// Synthetic topologies for TestRunner::load_graph. Every edge is listed once,
+// load_graph makes it bidirectional.
+
+// Random graph where every node has exactly `degree` peers, link delays are uniform in
+// [min_delay, max_delay]. Stubs are paired one by one avoiding loops and multi-edges,
+// the pairing is restarted in the rare case it gets stuck.
+static graph_type make_random_regular_graph(uint32_t nodes, uint32_t degree, int min_delay, int max_delay,
+                                            std::mt19937& gen) {
+    if (degree >= nodes || (uint64_t(nodes) * degree) % 2) {
+        throw std::invalid_argument("random regular graph requires degree < nodes and even nodes * degree");
+    }
+    std::uniform_int_distribution<int> delays(min_delay, max_delay);
+    const uint32_t max_attempts = 100;
+
+    while (true) {
+        graph_type graph(nodes);
+        vector<set<uint32_t>> peers(nodes);
+        vector<uint32_t> stubs;
+        stubs.reserve(uint64_t(nodes) * degree);
+        for (uint32_t i = 0; i < nodes; i++) {
+            stubs.insert(stubs.end(), degree, i);
+        }
+
+        bool stuck = false;
+        while (!stubs.empty() && !stuck) {
+            stuck = true;
+            for (uint32_t attempt = 0; attempt < max_attempts; attempt++) {
+                std::uniform_int_distribution<size_t> pick(0, stubs.size() - 1);
+                auto i = pick(gen);
+                auto j = pick(gen);
+                auto u = stubs[i];
+                auto v = stubs[j];
+                if (u == v || peers[u].count(v)) {
+                    continue;
+                }
+                peers[u].insert(v);
+                peers[v].insert(u);
+                graph[u].push_back({v, delays(gen)});
+                // remove both stubs, the larger index goes first so the other one stays valid
+                for (auto idx : {max(i, j), min(i, j)}) {
+                    stubs[idx] = stubs.back();
+                    stubs.pop_back();
+                }
+                stuck = false;
+                break;
+            }
+        }
+        if (!stuck) {
+            return graph;
+        }
+    }
+}
+
+struct GeoClustersConfig {
+    uint32_t nodes = 100;
+    uint32_t clusters = 5;
+    // random peers of a node inside its cluster, in addition to the spanning chain
+    uint32_t intra_degree = 3;
+    // nodes of every cluster which connect to the gateways of all other clusters
+    uint32_t gateways = 2;
+    int min_local_delay = 5;
+    int max_local_delay = 20;
+    // delay between gateways is inter_delay_base + distance * inter_delay_per_unit,
+    // cluster centers are uniformly placed in the unit square
+    int inter_delay_base = 20;
+    int inter_delay_per_unit = 200;
+};
+
+// Nodes grouped in geographic clusters: cheap links inside a cluster, and gateway links
+// between clusters with delays growing with the distance between cluster centers.
+// Node i belongs to cluster i % clusters.
+static graph_type make_geo_clusters_graph(const GeoClustersConfig& config, std::mt19937& gen) {
+    if (config.clusters == 0 || config.clusters > config.nodes) {
+        throw std::invalid_argument("geo clusters graph requires 0 < clusters <= nodes");
+    }
+    graph_type graph(config.nodes);
+    std::uniform_real_distribution<double> coord(0, 1);
+    std::uniform_int_distribution<int> local_delays(config.min_local_delay, config.max_local_delay);
+
+    vector<pair<double, double>> centers(config.clusters);
+    for (auto& center : centers) {
+        center = {coord(gen), coord(gen)};
+    }
+
+    vector<vector<uint32_t>> members(config.clusters);
+    for (uint32_t i = 0; i < config.nodes; i++) {
+        members[i % config.clusters].push_back(i);
+    }
+
+    for (const auto& cluster : members) {
+        vector<set<uint32_t>> peers(cluster.size());
+        auto connect = [&](size_t a, size_t b) {
+            if (a == b || peers[a].count(b)) {
+                return;
+            }
+            peers[a].insert(b);
+            peers[b].insert(a);
+            graph[cluster[a]].push_back({cluster[b], local_delays(gen)});
+        };
+        // chain keeps the cluster connected
+        for (size_t i = 1; i < cluster.size(); i++) {
+            connect(i - 1, i);
+        }
+        std::uniform_int_distribution<size_t> pick(0, cluster.size() - 1);
+        for (size_t i = 0; i < cluster.size(); i++) {
+            for (uint32_t k = 0; k < config.intra_degree && peers[i].size() < cluster.size() - 1; k++) {
+                connect(i, pick(gen));
+            }
+        }
+    }
+
+    for (uint32_t a = 0; a < config.clusters; a++) {
+        for (uint32_t b = a + 1; b < config.clusters; b++) {
+            auto dx = centers[a].first - centers[b].first;
+            auto dy = centers[a].second - centers[b].second;
+            auto delay = config.inter_delay_base + static_cast<int>(std::sqrt(dx * dx + dy * dy) * config.inter_delay_per_unit);
+            auto gateways_a = min<size_t>(config.gateways, members[a].size());
+            auto gateways_b = min<size_t>(config.gateways, members[b].size());
+            for (size_t i = 0; i < gateways_a; i++) {
+                for (size_t j = 0; j < gateways_b; j++) {
+                    graph[members[a][i]].push_back({members[b][j], delay});
+                }
+            }
+        }
+    }
+    return graph;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+using std::string;
+using std::vector;
+
+struct TraceEvent {
+    uint32_t time;
+    uint32_t node;
+    uint32_t from;
+    uint32_t size;
+    uint8_t type;
+};
+
+// Buffered writer of executed tasks, one event per task.
+// CSV format has a "time,node,from,type,size" header, binary format is a sequence of
+// 17 byte records: time, node, from, size as little endian uint32 followed by uint8 type.
+class TraceWriter {
+public:
+    enum class Format {
+        CSV,
+        BINARY,
+    };
+
+    static constexpr size_t default_buffer_size = 1 << 20;
+    static constexpr size_t binary_record_size = 4 * sizeof(uint32_t) + sizeof(uint8_t);
+
+    TraceWriter(const string& path, Format format, size_t buffer_size = default_buffer_size):
+        out(path, std::ios::binary | std::ios::trunc),
+        format(format),
+        buffer_size(buffer_size)
+    {
+        if (!out) {
+            throw std::runtime_error("Failed to open trace file " + path);
+        }
+        buffer.reserve(buffer_size);
+        if (format == Format::CSV) {
+            append("time,node,from,type,size\n");
+        }
+    }
+
+    ~TraceWriter() {
+        flush();
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    void write(const TraceEvent& event) {
+        if (format == Format::CSV) {
+            append(std::to_string(event.time));
+            append(",");
+            append(std::to_string(event.node));
+            append(",");
+            append(std::to_string(event.from));
+            append(",");
+            append(std::to_string(event.type));
+            append(",");
+            append(std::to_string(event.size));
+            append("\n");
+        } else {
+            char record[binary_record_size];
+            write_u32(record, event.time);
+            write_u32(record + 4, event.node);
+            write_u32(record + 8, event.from);
+            write_u32(record + 12, event.size);
+            record[16] = static_cast<char>(event.type);
+            buffer.insert(buffer.end(), record, record + binary_record_size);
+        }
+        if (buffer.size() >= buffer_size) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (!buffer.empty()) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+        out.flush();
+    }
+
+private:
+    void append(const string& str) {
+        buffer.insert(buffer.end(), str.begin(), str.end());
+    }
+
+    static void write_u32(char* dest, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            dest[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    std::ofstream out;
+    Format format;
+    size_t buffer_size;
+    vector<char> buffer;
+};
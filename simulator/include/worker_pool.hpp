@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+using std::vector;
+using std::function;
+
+// Fixed set of threads executing indexed jobs in lockstep, used by TestRunner
+// to process one time window of the simulation in parallel.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads) {
+        for (size_t i = 1; i < threads; i++) {
+            workers.emplace_back([this]() { worker_loop(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            done = true;
+        }
+        start_cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const {
+        return workers.size() + 1;
+    }
+
+    // Calls job(i) for every i in [0, count) and returns when all calls finished.
+    // The calling thread takes part in the work. The first exception thrown by
+    // a job is rethrown here.
+    void run(size_t count, const function<void(size_t)>& job) {
+        if (count == 0) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            current_job = &job;
+            job_count = count;
+            next_index = 0;
+            active_workers = workers.size();
+            error = nullptr;
+            generation++;
+        }
+        start_cv.notify_all();
+
+        process();
+
+        std::unique_lock<std::mutex> lock(mtx);
+        finish_cv.wait(lock, [this]() { return active_workers == 0; });
+        current_job = nullptr;
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void worker_loop() {
+        uint64_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                start_cv.wait(lock, [&]() { return done || generation != seen_generation; });
+                if (done) {
+                    return;
+                }
+                seen_generation = generation;
+            }
+
+            process();
+
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--active_workers == 0) {
+                finish_cv.notify_one();
+            }
+        }
+    }
+
+    void process() {
+        size_t index;
+        while ((index = next_index.fetch_add(1)) < job_count) {
+            try {
+                (*current_job)(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable start_cv;
+    std::condition_variable finish_cv;
+
+    const function<void(size_t)>* current_job = nullptr;
+    size_t job_count = 0;
+    std::atomic<size_t> next_index { 0 };
+    size_t active_workers = 0;
+    uint64_t generation = 0;
+    bool done = false;
+    std::exception_ptr error;
+};
@@ -8,6 +8,7 @@
 #include <ctime>
 #include <random>
 #include <randpa.hpp>
+#include <topology.hpp>
 
 using namespace std;
 
@@ -170,3 +171,90 @@ TEST(randpa_finality, no_threshold) {
         EXPECT_EQ(get_block_height(runner.get_db(i).last_irreversible_block_id()), 0);
     }
 }
+
+TEST(randpa_finality, parallel_mode_matches_sequential) {
+    auto nodes_cnt = 21;
+    auto seed = 17;
+
+    graph_type g(nodes_cnt);
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> delays(10, 200);
+    for (auto i = 1; i < nodes_cnt; i++) {
+        g[i].push_back({ gen() % i, delays(gen) });
+        g[i].push_back({ gen() % i, delays(gen) });
+    }
+
+    auto run = [&](size_t threads) {
+        srand(seed);
+        auto runner = TestRunner(nodes_cnt);
+        runner.load_graph(g);
+        runner.set_threads(threads);
+        runner.set_log_level(LogLevel::NONE);
+        runner.add_stop_task(10 * runner.get_slot_ms());
+        runner.run<RandpaNode>();
+
+        vector<pair<block_id_type, block_id_type>> result;
+        for (auto i = 0; i < nodes_cnt; i++) {
+            const auto& db = runner.get_db(i);
+            result.push_back({ db.last_irreversible_block_id(), db.get_master_block_id() });
+        }
+        return make_pair(result, runner.get_stats());
+    };
+
+    vector<pair<block_id_type, block_id_type>> sequential, parallel;
+    SimulationStats sequential_stats, parallel_stats;
+    std::tie(sequential, sequential_stats) = run(1);
+    std::tie(parallel, parallel_stats) = run(4);
+    EXPECT_EQ(sequential_stats.messages, parallel_stats.messages);
+    EXPECT_EQ(sequential_stats.finality_latencies_ms, parallel_stats.finality_latencies_ms);
+
+    EXPECT_GT(get_block_height(sequential[0].first), 0);
+    for (auto i = 0; i < nodes_cnt; i++) {
+        EXPECT_EQ(sequential[i].first, parallel[i].first);
+        EXPECT_EQ(sequential[i].second, parallel[i].second);
+    }
+}
+
+TEST(randpa_finality, stats_and_trace) {
+    auto runner = TestRunner(3);
+    vector<pair<int, int> > v0{{1, 2}, {2, 10}};
+    graph_type g;
+    g.push_back(v0);
+    runner.load_graph(g);
+    runner.set_log_level(LogLevel::NONE);
+    auto trace_path = testing::TempDir() + "randpa_trace.csv";
+    runner.set_trace(trace_path);
+    runner.add_stop_task(6 * runner.get_slot_ms());
+    runner.run<RandpaNode>();
+
+    auto stats = runner.get_stats();
+    EXPECT_EQ(stats.finalized_blocks, get_block_height(runner.get_db(0).last_irreversible_block_id()));
+    EXPECT_GT(stats.finalized_blocks, 0);
+    EXPECT_GT(stats.messages, 0);
+    EXPECT_GT(stats.message_bytes, 0);
+    EXPECT_GE(stats.finality_latencies_ms.size(), 3 * stats.finalized_blocks);
+    EXPECT_LE(stats.latency_percentile(50), stats.latency_percentile(99));
+
+    runner.reset_trace();
+    ifstream trace(trace_path);
+    string line;
+    size_t lines = 0;
+    while (getline(trace, line)) {
+        lines++;
+    }
+    EXPECT_EQ(lines, stats.executed_tasks + 1);
+}
+
+TEST(randpa_finality, random_regular_graph) {
+    std::mt19937 gen(2);
+    auto nodes_cnt = 50;
+    auto runner = TestRunner(nodes_cnt);
+    runner.load_graph(make_random_regular_graph(nodes_cnt, 4, 10, 50, gen));
+    runner.set_log_level(LogLevel::NONE);
+    runner.add_stop_task(5 * runner.get_slot_ms());
+    runner.run<RandpaNode>();
+
+    for (auto i = 0; i < nodes_cnt; i++) {
+        EXPECT_GE(get_block_height(runner.get_db(i).last_irreversible_block_id()), 2);
+    }
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <simulator.hpp>
+#include <topology.hpp>
+
+using namespace std;
+
+static bool is_connected(const TestRunner& runner) {
+    const auto& dist = runner.get_distances(0);
+    return all_of(dist.begin(), dist.end(), [](int d) { return d != -1; });
+}
+
+TEST(topology, distances) {
+    auto runner = TestRunner(5);
+    graph_type g(5);
+    g[0] = {{1, 10}, {2, 50}};
+    g[1] = {{2, 10}};
+    g[2] = {{3, 5}};
+    runner.load_graph(g);
+
+    EXPECT_EQ(runner.get_delay(0, 2), 50);
+    EXPECT_EQ(runner.get_delay(2, 0), 50);
+    EXPECT_EQ(runner.get_delay(0, 3), -1);
+    EXPECT_EQ(runner.get_dist(0, 2), 20);
+    EXPECT_EQ(runner.get_dist(3, 0), 25);
+    EXPECT_EQ(runner.get_dist(0, 4), -1);
+    EXPECT_EQ(runner.get_lookahead_ms(), 5);
+
+    runner.update_delay(1, 2, -1);
+    EXPECT_EQ(runner.get_delay(1, 2), -1);
+    EXPECT_EQ(runner.get_dist(0, 2), 50);
+    EXPECT_EQ(runner.get_dist(3, 1), 65);
+}
+
+TEST(topology, random_regular_graph) {
+    std::mt19937 gen(1);
+    auto nodes_cnt = 1000;
+    auto degree = 6;
+    auto runner = TestRunner(nodes_cnt);
+    runner.load_graph(make_random_regular_graph(nodes_cnt, degree, 10, 100, gen));
+
+    for (auto i = 0; i < nodes_cnt; i++) {
+        EXPECT_EQ(runner.get_links(i).size(), degree);
+    }
+    EXPECT_TRUE(is_connected(runner));
+    EXPECT_GE(runner.get_lookahead_ms(), 10);
+}
+
+TEST(topology, geo_clusters_graph) {
+    std::mt19937 gen(1);
+    GeoClustersConfig config;
+    config.nodes = 1000;
+    config.clusters = 7;
+    auto runner = TestRunner(config.nodes);
+    runner.load_graph(make_geo_clusters_graph(config, gen));
+
+    EXPECT_TRUE(is_connected(runner));
+    // nodes of the same cluster are closer than gateways of different clusters
+    EXPECT_LE(runner.get_delay(0, 7), config.max_local_delay);
+    EXPECT_GE(runner.get_delay(0, 1), config.inter_delay_base);
+}
@@ -0,0 +1,125 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+// Merkle roots and action receipt digests, hashed one by one as before and in batches with
+// every SHA-256 kernel the CPU supports.
+//
+// Usage:
+//   merkle_benchmark [--log_level=nothing] -- [--ids 100,1000,10000] [--rounds 100]
+#include <eosio/chain/action_receipt.hpp>
+#include <eosio/chain/merkle.hpp>
+#include <eosio/chain/sha256_batch.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace eosio;
+using namespace eosio::chain;
+
+using bench_clock = std::chrono::steady_clock;
+
+struct benchmark_config {
+   std::vector<uint32_t> ids { 100, 1000, 10000 };
+   uint32_t rounds = 100;
+};
+
+static benchmark_config parse_args() {
+   benchmark_config config;
+   const auto& suite = boost::unit_test::framework::master_test_suite();
+   for( int i = 1; i + 1 < suite.argc; ++i ) {
+      const std::string key = suite.argv[i];
+      const std::string value = suite.argv[i + 1];
+      if( key == "--ids" ) {
+         config.ids.clear();
+         std::stringstream ss(value);
+         std::string item;
+         while( std::getline(ss, item, ',') )
+            config.ids.push_back( std::stoul(item) );
+      } else if( key == "--rounds" ) {
+         config.rounds = std::stoul(value);
+      }
+   }
+   return config;
+}
+
+// merkle() as it was before levels were hashed in batches
+static digest_type serial_merkle( vector<digest_type> ids ) {
+   if( 0 == ids.size() ) { return digest_type(); }
+   while( ids.size() > 1 ) {
+      if( ids.size() % 2 )
+         ids.push_back(ids.back());
+      for( size_t i = 0; i < ids.size() / 2; i++ )
+         ids[i] = digest_type::hash(make_canonical_pair(ids[2 * i], ids[(2 * i) + 1]));
+      ids.resize(ids.size() / 2);
+   }
+   return ids.front();
+}
+
+template<typename F>
+static double hashes_per_sec( uint32_t rounds, uint64_t hashes, F&& f ) {
+   const auto start = bench_clock::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      f();
+   const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( bench_clock::now() - start ).count();
+   return elapsed ? rounds * hashes * 1e6 / elapsed : 0;
+}
+
+BOOST_AUTO_TEST_CASE( merkle_throughput ) try {
+   const auto config = parse_args();
+
+   std::cout << "workload,kernel,ids,hashes_per_sec" << std::endl;
+   for( auto count : config.ids ) {
+      vector<digest_type> ids;
+      vector<action_receipt> receipts( count );
+      for( uint32_t i = 0; i < count; ++i ) {
+         ids.push_back( digest_type::hash( std::to_string(i) ) );
+         receipts[i].receiver = N(eosio.token);
+         receipts[i].act_digest = ids.back();
+         receipts[i].global_sequence = i;
+         receipts[i].recv_sequence = i;
+         receipts[i].auth_sequence[N(alice)] = i;
+      }
+      // a tree over count leaves takes about count parent hashes
+      const uint64_t merkle_hashes = count;
+
+      auto rate = hashes_per_sec( config.rounds, merkle_hashes, [&]() { serial_merkle( ids ); } );
+      std::cout << "merkle,serial," << count << "," << uint64_t(rate) << std::endl;
+      rate = hashes_per_sec( config.rounds, count, [&]() {
+         for( const auto& r : receipts )
+            r.digest();
+      } );
+      std::cout << "action_digests,serial," << count << "," << uint64_t(rate) << std::endl;
+
+      for( auto kernel : { sha256_kernel::scalar, sha256_kernel::avx2, sha256_kernel::shani } ) {
+         if( !sha256_kernel_supported(kernel) )
+            continue;
+         rate = hashes_per_sec( config.rounds, merkle_hashes, [&]() { merkle( ids, kernel ); } );
+         std::cout << "merkle," << sha256_kernel_name(kernel) << "," << count << "," << uint64_t(rate) << std::endl;
+
+         rate = hashes_per_sec( config.rounds, count, [&]() {
+            vector<char> packed;
+            vector<size_t> offsets;
+            for( const auto& r : receipts ) {
+               offsets.push_back( packed.size() );
+               const auto bytes = fc::raw::pack( r );
+               packed.insert( packed.end(), bytes.begin(), bytes.end() );
+            }
+            offsets.push_back( packed.size() );
+            vector<sha256_message> messages;
+            for( size_t i = 0; i < receipts.size(); ++i )
+               messages.push_back( { packed.data() + offsets[i], offsets[i + 1] - offsets[i] } );
+            vector<digest_type> digests( receipts.size() );
+            sha256_batch( messages.data(), messages.size(), digests.data(), kernel );
+         } );
+         std::cout << "action_digests," << sha256_kernel_name(kernel) << "," << count << "," << uint64_t(rate) << std::endl;
+      }
+   }
+} FC_LOG_AND_RETHROW()
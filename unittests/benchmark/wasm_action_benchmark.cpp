@@ -0,0 +1,117 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+// Action throughput of noop contracts with growing initial memory, where the per action
+// memory reset dominates the cost of the call.
+//
+// Usage:
+//   wasm_action_benchmark [--log_level=nothing] -- [--wavm|--wabt] [--pages 1,16,64,256] [--trxs 200]
+//                         [--actions 100]
+#include <eosio/testing/tester.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+using bench_clock = std::chrono::steady_clock;
+
+struct benchmark_config {
+   std::vector<uint32_t> pages { 1, 16, 64, 256 };
+   uint32_t trxs = 200;
+   uint32_t actions = 100;
+};
+
+static benchmark_config parse_args() {
+   benchmark_config config;
+   const auto& suite = boost::unit_test::framework::master_test_suite();
+   for( int i = 1; i + 1 < suite.argc; ++i ) {
+      const std::string key = suite.argv[i];
+      const std::string value = suite.argv[i + 1];
+      if( key == "--pages" ) {
+         config.pages.clear();
+         std::stringstream ss(value);
+         std::string item;
+         while( std::getline(ss, item, ',') )
+            config.pages.push_back( std::stoul(item) );
+      } else if( key == "--trxs" ) {
+         config.trxs = std::stoul(value);
+      } else if( key == "--actions" ) {
+         config.actions = std::stoul(value);
+      }
+   }
+   return config;
+}
+
+// noop apply with `pages` pages of initial memory and a data segment at its end
+static std::string noop_wast( uint32_t pages ) {
+   const uint32_t data_offset = pages * 64 * 1024 - 16;
+   return "(module"
+          " (memory $0 " + std::to_string(pages) + ")"
+          " (data (i32.const " + std::to_string(data_offset) + ") \"initial memory\")"
+          " (export \"memory\" (memory $0))"
+          " (export \"apply\" (func $apply))"
+          " (func $apply (param $0 i64) (param $1 i64) (param $2 i64)))";
+}
+
+static double run( tester& t, account_name account, const benchmark_config& config, uint32_t& nonce ) {
+   // the first transaction instantiates the contract and isn't measured
+   std::vector<signed_transaction> trxs;
+   for( uint32_t i = 0; i <= config.trxs; ++i ) {
+      signed_transaction trx;
+      for( uint32_t a = 0; a < config.actions; ++a ) {
+         action act;
+         act.account = account;
+         act.name = N();
+         act.authorization = vector<permission_level>{{account, config::active_name}};
+         act.data = fc::raw::pack(nonce++);
+         trx.actions.push_back(act);
+      }
+      t.set_transaction_headers(trx);
+      trx.sign( t.get_private_key( account, "active" ), t.control->get_chain_id() );
+      trxs.push_back( std::move(trx) );
+   }
+
+   t.push_transaction( trxs[0] );
+
+   const auto start = bench_clock::now();
+   for( uint32_t i = 1; i < trxs.size(); ++i ) {
+      t.push_transaction( trxs[i] );
+      if( t.control->pending_block_state()->block->transactions.size() >= 50 )
+         t.produce_block();
+   }
+   const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( bench_clock::now() - start ).count();
+   t.produce_block();
+   return elapsed ? uint64_t(config.trxs) * config.actions * 1e6 / elapsed : 0;
+}
+
+BOOST_AUTO_TEST_CASE( noop_action_throughput ) try {
+   fc::logger::get(DEFAULT_LOGGER).set_log_level(fc::log_level::off);
+   const auto config = parse_args();
+
+   tester t;
+   t.produce_blocks(2);
+
+   std::cout << "runtime,pages,actions,actions_per_sec" << std::endl;
+   uint32_t nonce = 0;
+   for( auto pages : config.pages ) {
+      const account_name account = string_to_name( ("noop" + std::to_string(pages)).c_str() );
+      t.create_accounts( {account} );
+      t.set_code( account, noop_wast(pages).c_str() );
+      t.produce_blocks(1);
+
+      const auto rate = run( t, account, config, nonce );
+      std::cout << fc::reflector<wasm_interface::vm_type>::to_string( t.get_config().wasm_runtime ) << ","
+                << pages << "," << uint64_t(config.trxs) * config.actions << "," << uint64_t(rate) << std::endl;
+   }
+} FC_LOG_AND_RETHROW()
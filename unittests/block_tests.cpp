@@ -4,6 +4,7 @@
  */
 #include <boost/test/unit_test.hpp>
 #include <eosio/testing/tester.hpp>
+#include <eosio/chain/block_log.hpp>
 
 using namespace eosio;
 using namespace testing;
@@ -163,4 +164,238 @@ BOOST_AUTO_TEST_CASE(untrusted_producer_test)
    }) ;
 }
 
+// the mapped reader returns the stored bytes of irreversible blocks and follows the log as it grows
+BOOST_AUTO_TEST_CASE(mapped_block_log_test) { try {
+   tester main;
+   main.produce_blocks(20);
+   const auto lib = main.control->last_irreversible_block_num();
+   BOOST_REQUIRE_GT( lib, 2u );
+
+   for( uint32_t n = 1; n <= lib; ++n ) {
+      auto mb = main.control->fetch_mapped_block_by_number( n );
+      BOOST_REQUIRE( mb );
+      const auto expected = fc::raw::pack( *main.control->fetch_block_by_number( n ) );
+      BOOST_REQUIRE_EQUAL( mb.size, expected.size() );
+      BOOST_CHECK( std::equal( expected.begin(), expected.end(), mb.data ) );
+   }
+   BOOST_CHECK( !main.control->fetch_mapped_block_by_number( lib + 1 ) );
+
+   fc::temp_directory tempdir;
+   block_log log( tempdir.path() );
+   log.reset( main.get_config().genesis, main.control->fetch_block_by_number( 1 ) );
+   auto first = log.read_mapped_block_by_num( 1 );
+   BOOST_REQUIRE( first );
+   for( uint32_t n = 2; n <= lib; ++n ) {
+      BOOST_CHECK( !log.read_mapped_block_by_num( n ) );
+      log.append( main.control->fetch_block_by_number( n ) );
+      auto mb = log.read_mapped_block_by_num( n );
+      BOOST_REQUIRE( mb );
+      BOOST_CHECK_EQUAL( log.read_block_by_num( n )->id().str(), main.control->fetch_block_by_number( n )->id().str() );
+   }
+   // a view taken before the log was remapped stays readable
+   const auto expected = fc::raw::pack( *main.control->fetch_block_by_number( 1 ) );
+   BOOST_REQUIRE_EQUAL( first.size, expected.size() );
+   BOOST_CHECK( std::equal( expected.begin(), expected.end(), first.data ) );
+} FC_LOG_AND_RETHROW() }
+
+// queued appends are readable right away and all of them are on disk once the log is closed
+BOOST_AUTO_TEST_CASE(block_log_group_commit_test) { try {
+   tester main;
+   main.produce_blocks(30);
+   const auto lib = main.control->last_irreversible_block_num();
+   BOOST_REQUIRE_GT( lib, 10u );
+
+   fc::temp_directory tempdir;
+   {
+      block_log log( tempdir.path() );
+      log.set_append_options( { 4, true } );
+      log.reset( main.get_config().genesis, main.control->fetch_block_by_number( 1 ) );
+      for( uint32_t n = 2; n <= lib; ++n ) {
+         log.append( main.control->fetch_block_by_number( n ), vector<char>() );
+         BOOST_REQUIRE_EQUAL( log.head()->block_num(), n );
+         BOOST_REQUIRE( log.read_block_by_num( n ) );
+      }
+      BOOST_CHECK_LE( log.last_written_block_num(), lib );
+      BOOST_CHECK_THROW( log.append( main.control->fetch_block_by_number( lib ), vector<char>() ), block_log_append_fail );
+      log.flush();
+      BOOST_CHECK_EQUAL( log.last_written_block_num(), lib );
+   }
+
+   block_log reopened( tempdir.path() );
+   BOOST_REQUIRE( reopened.head() );
+   BOOST_CHECK_EQUAL( reopened.head()->block_num(), lib );
+   for( uint32_t n = 1; n <= lib; ++n ) {
+      auto mb = reopened.read_mapped_block_by_num( n );
+      BOOST_REQUIRE( mb );
+      const auto expected = fc::raw::pack( *main.control->fetch_block_by_number( n ) );
+      BOOST_REQUIRE_EQUAL( mb.size, expected.size() );
+      BOOST_CHECK( std::equal( expected.begin(), expected.end(), mb.data ) );
+   }
+} FC_LOG_AND_RETHROW() }
+
+// a chunked log reads back every block, before and after its partial last chunk is reopened
+BOOST_AUTO_TEST_CASE(chunked_block_log_test) { try {
+   tester main;
+   main.produce_blocks(30);
+   const auto lib = main.control->last_irreversible_block_num();
+   BOOST_REQUIRE_GT( lib, 10u );
+   const uint32_t chunk_blocks = 4;
+   const uint32_t split = lib - 2;
+   BOOST_REQUIRE_NE( split % chunk_blocks, 0u );
+
+   auto check_blocks = [&]( const block_log& log, uint32_t last ) {
+      for( uint32_t n = last; n >= 1; --n ) {
+         auto mb = log.read_mapped_block_by_num( n );
+         BOOST_REQUIRE( mb );
+         const auto expected = fc::raw::pack( *main.control->fetch_block_by_number( n ) );
+         BOOST_REQUIRE_EQUAL( mb.size, expected.size() );
+         BOOST_CHECK( std::equal( expected.begin(), expected.end(), mb.data ) );
+      }
+      BOOST_CHECK( !log.read_mapped_block_by_num( last + 1 ) );
+   };
+
+   fc::temp_directory tempdir;
+   {
+      block_log log( tempdir.path() );
+      log.reset( main.get_config().genesis, main.control->fetch_block_by_number( 1 ), 1, chunk_blocks );
+      for( uint32_t n = 2; n <= split; ++n )
+         log.append( main.control->fetch_block_by_number( n ), vector<char>() );
+      BOOST_CHECK_EQUAL( log.head()->block_num(), split );
+      BOOST_CHECK_EQUAL( log.last_written_block_num(), split - split % chunk_blocks );
+      check_blocks( log, split );
+   }
+
+   {
+      block_log log( tempdir.path() );
+      BOOST_REQUIRE( log.head() );
+      BOOST_CHECK_EQUAL( log.head()->block_num(), split );
+      BOOST_CHECK_EQUAL( log.get_block_pos( 1 ), block_log::npos );
+      for( uint32_t n = split + 1; n <= lib; ++n )
+         log.append( main.control->fetch_block_by_number( n ), vector<char>() );
+      check_blocks( log, lib );
+   }
+
+   block_log reopened( tempdir.path() );
+   BOOST_CHECK_EQUAL( reopened.head()->block_num(), lib );
+   check_blocks( reopened, lib );
+   BOOST_CHECK_EQUAL( block_log::extract_genesis_state( tempdir.path() ).compute_chain_id().str(),
+                      main.get_config().genesis.compute_chain_id().str() );
+} FC_LOG_AND_RETHROW() }
+
+// opening a chunked log leaves it as it is, only a chunk cut short by a crash is truncated
+BOOST_AUTO_TEST_CASE(chunked_block_log_torn_chunk_test) { try {
+   tester main;
+   main.produce_blocks(30);
+   const auto lib = main.control->last_irreversible_block_num();
+   BOOST_REQUIRE_GT( lib, 10u );
+   const uint32_t chunk_blocks = 4;
+   const uint32_t split = lib - lib % chunk_blocks - 2;
+
+   auto check_blocks = [&]( const block_log& log, uint32_t last ) {
+      for( uint32_t n = 1; n <= last; ++n ) {
+         auto mb = log.read_mapped_block_by_num( n );
+         BOOST_REQUIRE( mb );
+         const auto expected = fc::raw::pack( *main.control->fetch_block_by_number( n ) );
+         BOOST_REQUIRE_EQUAL( mb.size, expected.size() );
+         BOOST_CHECK( std::equal( expected.begin(), expected.end(), mb.data ) );
+      }
+      BOOST_CHECK( !log.read_mapped_block_by_num( last + 1 ) );
+   };
+
+   fc::temp_directory tempdir;
+   const auto log_file = tempdir.path() / "blocks.log";
+   {
+      block_log log( tempdir.path() );
+      log.reset( main.get_config().genesis, main.control->fetch_block_by_number( 1 ), 1, chunk_blocks );
+      for( uint32_t n = 2; n <= split; ++n )
+         log.append( main.control->fetch_block_by_number( n ), vector<char>() );
+   }
+   const auto closed_size = fc::file_size( log_file );
+
+   // the partial last chunk stays on disk while the log is only read
+   {
+      block_log log( tempdir.path() );
+      BOOST_CHECK_EQUAL( log.head()->block_num(), split );
+      BOOST_CHECK_EQUAL( fc::file_size( log_file ), closed_size );
+   }
+   BOOST_CHECK_EQUAL( fc::file_size( log_file ), closed_size );
+
+   // fills the chunk, which is appended after the partial one
+   {
+      block_log log( tempdir.path() );
+      for( uint32_t n = split + 1; n <= split + 2; ++n )
+         log.append( main.control->fetch_block_by_number( n ), vector<char>() );
+      BOOST_CHECK_EQUAL( log.last_written_block_num(), split + 2 );
+   }
+   BOOST_REQUIRE_GT( fc::file_size( log_file ), closed_size );
+
+   // a crash in the middle of writing the full chunk leaves the partial one as the last
+   fc::resize_file( log_file, fc::file_size( log_file ) - 5 );
+   {
+      block_log log( tempdir.path() );
+      BOOST_REQUIRE( log.head() );
+      BOOST_CHECK_EQUAL( log.head()->block_num(), split );
+      BOOST_CHECK_EQUAL( log.last_written_block_num(), split - 2 );
+      BOOST_CHECK_EQUAL( fc::file_size( log_file ), closed_size );
+      check_blocks( log, split );
+      for( uint32_t n = split + 1; n <= lib; ++n )
+         log.append( main.control->fetch_block_by_number( n ), vector<char>() );
+   }
+
+   block_log reopened( tempdir.path() );
+   BOOST_CHECK_EQUAL( reopened.head()->block_num(), lib );
+   check_blocks( reopened, lib );
+} FC_LOG_AND_RETHROW() }
+
+// a replay with a short lookahead and all checks forced ends on the same head as the chain it replays
+BOOST_AUTO_TEST_CASE(pipelined_replay_test) { try {
+   tester main;
+   main.create_accounts( { N(alice), N(bob), N(carol) } );
+   main.produce_blocks(10);
+   main.create_accounts( { N(dave), N(erin) } );
+   main.produce_blocks(20);
+   const auto lib = main.control->last_irreversible_block_num();
+   BOOST_REQUIRE_GT( lib, 10u );
+
+   fc::temp_directory tempdir;
+   auto cfg = main.get_config();
+   cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+   cfg.state_dir = tempdir.path() / config::default_state_dir_name;
+   cfg.replay_lookahead_blocks = 3;
+   cfg.force_all_checks = true;
+   fc::create_directories( cfg.blocks_dir );
+   fc::copy( main.get_config().blocks_dir / "blocks.log", cfg.blocks_dir / "blocks.log" );
+
+   tester replayed( cfg );
+   BOOST_REQUIRE_EQUAL( replayed.control->head_block_num(), lib );
+   BOOST_CHECK_EQUAL( replayed.control->head_block_id().str(), main.control->fetch_block_by_number( lib )->id().str() );
+   BOOST_CHECK( replayed.control->db().find<account_object, by_name>( N(erin) ) );
+} FC_LOG_AND_RETHROW() }
+
+// blocks prefetched before their previous block is pushed end on the same head as blocks pushed one by one
+BOOST_AUTO_TEST_CASE(sync_lookahead_test) { try {
+   tester main;
+   main.create_accounts( { N(alice), N(bob) } );
+   main.produce_blocks(10);
+   main.create_accounts( { N(carol) } );
+   main.produce_blocks(10);
+   const auto last = main.control->head_block_num();
+
+   tester other;
+   const auto first = other.control->head_block_num() + 1;
+   for( uint32_t n = first; n <= last; ++n )
+      other.control->prefetch_block_state( main.control->fetch_block_by_number( n ) );
+   for( uint32_t n = first; n <= last; ++n )
+      other.push_block( main.control->fetch_block_by_number( n ) );
+   BOOST_CHECK_EQUAL( other.control->head_block_id().str(), main.control->head_block_id().str() );
+   BOOST_CHECK( other.control->db().find<account_object, by_name>( N(carol) ) );
+
+   // a signee verified ahead is still rejected when its block is pushed
+   auto forged = std::make_shared<signed_block>( main.produce_block()->clone() );
+   forged->producer_signature = main.get_private_key( N(alice), "active" ).sign( forged->digest() );
+   other.control->prefetch_block_state( forged );
+   BOOST_CHECK_THROW( other.push_block( forged ), fc::exception );
+   BOOST_CHECK_EQUAL( other.control->head_block_id().str(), main.control->fetch_block_by_number( last )->id().str() );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
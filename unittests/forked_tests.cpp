@@ -505,4 +505,75 @@ BOOST_AUTO_TEST_CASE( bft_finalize_dont_switch_fork ) try {
    BOOST_REQUIRE_EQUAL(73u, c.control->head_block_num());
 } FC_LOG_AND_RETHROW()
 
+// a finalized block is the bft irreversible block of the blocks built off of it without updating each of them
+BOOST_AUTO_TEST_CASE( bft_finalize_resolves_descendants ) try {
+   tester c;
+   c.produce_blocks(10);
+   c.create_accounts( {N(dan),N(sam),N(pam),N(scott)} );
+   c.set_producers( {N(dan),N(sam),N(pam),N(scott)} );
+   c.produce_blocks(50);
+
+   const auto head_num = c.control->head_block_num();
+   BOOST_REQUIRE_LT( c.control->last_irreversible_block_num() + 5, head_num );
+
+   auto finalized = c.control->fetch_block_by_number( head_num - 3 );
+   c.control->bft_finalize( finalized->id() );
+   BOOST_CHECK_EQUAL( c.control->fork_db().head()->bft_irreversible_blocknum, finalized->block_num() );
+   BOOST_CHECK_EQUAL( c.control->fetch_block_state_by_number( head_num - 1 )->bft_irreversible_blocknum, finalized->block_num() );
+   BOOST_CHECK_EQUAL( c.control->last_irreversible_block_num(), finalized->block_num() );
+
+   c.produce_block();
+   BOOST_CHECK_EQUAL( c.control->head_block_state()->bft_irreversible_blocknum, finalized->block_num() );
+   BOOST_CHECK_EQUAL( c.control->last_irreversible_block_num(), finalized->block_num() );
+} FC_LOG_AND_RETHROW()
+
+// a fork database reopened from its journals holds what it held before, a partially written record left behind
+BOOST_AUTO_TEST_CASE( fork_database_journal ) try {
+   tester c;
+   c.produce_blocks(2);
+
+   fc::temp_directory tempdir;
+   const auto dir = tempdir.path() / "forkdb";
+   const uint64_t compact_journal_size = 4096;
+
+   vector<block_id_type> ids;
+   block_id_type head_id;
+   {
+      fork_database db( dir, compact_journal_size );
+      db.set( std::make_shared<block_state>( *c.control->head_block_state() ) );
+      for( int i = 0; i < 30; ++i ) {
+         c.produce_block();
+         auto s = db.add( std::make_shared<block_state>( *c.control->head_block_state() ), false );
+         db.mark_in_current_chain( s, true );
+         db.set_validity( s, true );
+      }
+      head_id = db.head()->id;
+      for( auto s = db.head(); s; s = db.get_block( s->header.previous ) )
+         ids.push_back( s->id );
+   }
+   BOOST_REQUIRE_GT( ids.size(), 1u );
+   BOOST_CHECK( fc::exists( dir / config::forkdb_snapshot_filename ) );
+   BOOST_CHECK( !fc::exists( dir / config::forkdb_filename ) );
+
+   {
+      std::ofstream partial( (dir / "forkdb.1000000.log").generic_string().c_str(), std::ios::out | std::ios::binary );
+      fc::raw::pack( partial, uint32_t(100) );
+      partial.write( "partial", 7 );
+   }
+
+   fork_database db( dir, compact_journal_size );
+   BOOST_REQUIRE( db.head() );
+   BOOST_CHECK_EQUAL( db.head()->id.str(), head_id.str() );
+   for( const auto& id : ids ) {
+      auto s = db.get_block( id );
+      BOOST_REQUIRE( s );
+      BOOST_CHECK( s->validated );
+      BOOST_CHECK( s->in_current_chain );
+   }
+
+   c.produce_block();
+   db.add( std::make_shared<block_state>( *c.control->head_block_state() ), false );
+   BOOST_CHECK_EQUAL( db.head()->id.str(), c.control->head_block_id().str() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,8 @@
 #include <eosio/chain/authority.hpp>
 #include <eosio/chain/authority_checker.hpp>
 #include <eosio/chain/chain_config.hpp>
+#include <eosio/chain/merkle.hpp>
+#include <eosio/chain/sha256_batch.hpp>
 #include <eosio/chain/types.hpp>
 #include <eosio/testing/tester.hpp>
 
@@ -1067,6 +1069,68 @@ BOOST_AUTO_TEST_CASE(reflector_init_test) {
    } FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE(sha256_batch_test) { try {
+   boost::random::mt19937 gen;
+   boost::random::uniform_int_distribution<> byte( 0, 255 );
+   boost::random::uniform_int_distribution<> length( 0, 300 );
+
+   // padding boundaries first, then lengths spread over several blocks
+   vector<size_t> lengths = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 127, 128, 1000, 64, 64, 64 };
+   for( int i = 0; i < 50; ++i )
+      lengths.push_back( length(gen) );
+
+   vector<string> data;
+   vector<sha256_message> messages;
+   for( auto l : lengths ) {
+      string d( l, '\0' );
+      for( auto& c : d )
+         c = char( byte(gen) );
+      data.push_back( std::move(d) );
+   }
+   for( const auto& d : data )
+      messages.push_back( { d.data(), d.size() } );
+
+   for( auto kernel : { sha256_kernel::scalar, sha256_kernel::avx2, sha256_kernel::shani } ) {
+      BOOST_TEST_CONTEXT( sha256_kernel_name(kernel) ) {
+         if( !sha256_kernel_supported(kernel) )
+            continue;
+         // a single message, a partial group of lanes, a full group and several groups
+         for( size_t count : { size_t(1), size_t(5), size_t(8), messages.size() } ) {
+            vector<digest_type> digests( count );
+            sha256_batch( messages.data(), count, digests.data(), kernel );
+            for( size_t i = 0; i < count; ++i )
+               BOOST_CHECK_EQUAL( digests[i].str(), digest_type::hash( data[i].data(), data[i].size() ).str() );
+         }
+      }
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(merkle_batch_test) { try {
+   auto serial_merkle = []( vector<digest_type> ids ) {
+      if( ids.empty() ) return digest_type();
+      while( ids.size() > 1 ) {
+         if( ids.size() % 2 )
+            ids.push_back( ids.back() );
+         for( size_t i = 0; i < ids.size() / 2; ++i )
+            ids[i] = digest_type::hash( make_canonical_pair( ids[2 * i], ids[(2 * i) + 1] ) );
+         ids.resize( ids.size() / 2 );
+      }
+      return ids.front();
+   };
+
+   for( size_t count : { 0, 1, 2, 3, 7, 8, 9, 100, 1001 } ) {
+      vector<digest_type> ids;
+      for( size_t i = 0; i < count; ++i )
+         ids.push_back( digest_type::hash( std::to_string(i) ) );
+
+      const auto expected = serial_merkle( ids );
+      for( auto kernel : { sha256_kernel::scalar, sha256_kernel::avx2, sha256_kernel::shani } ) {
+         BOOST_TEST_CONTEXT( sha256_kernel_name(kernel) << " with " << count << " ids" ) {
+            BOOST_CHECK_EQUAL( merkle( ids, kernel ).str(), expected.str() );
+         }
+      }
+   }
+} FC_LOG_AND_RETHROW() }
 
 BOOST_AUTO_TEST_SUITE_END()
 
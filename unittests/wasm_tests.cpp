@@ -3,12 +3,14 @@
  *  @copyright defined in eos/LICENSE.txt
  */
 #include <array>
+#include <fstream>
 #include <utility>
 
 #include <eosio/chain/abi_serializer.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/wasm_eosio_constraints.hpp>
+#include <eosio/chain/wasm_disk_cache.hpp>
 #include <eosio/chain/wast_to_wasm.hpp>
 #include <eosio/testing/tester.hpp>
 
@@ -1852,4 +1854,194 @@ BOOST_FIXTURE_TEST_CASE(weighted_net_usage_tests, tester ) try {
 } FC_LOG_AND_RETHROW()
 #endif
 
+static std::string cache_test_wast( int n ) {
+   return "(module (export \"apply\" (func $apply)) (func $apply (param $0 i64) (param $1 i64) (param $2 i64) (drop (i32.const " + std::to_string(n) + "))))";
+}
+
+static signed_transaction cache_test_trx( TESTER& t, account_name account, uint32_t nonce ) {
+   signed_transaction trx;
+   action act;
+   act.account = account;
+   act.name = N();
+   act.authorization = vector<permission_level>{{account,config::active_name}};
+   act.data = fc::raw::pack(nonce);
+   trx.actions.push_back(act);
+
+   t.set_transaction_headers(trx);
+   trx.sign(t.get_private_key( account, "active" ), t.control->get_chain_id());
+   return trx;
+}
+
+static void push_cache_test_action( TESTER& t, account_name account, uint32_t nonce ) {
+   auto trx = cache_test_trx(t, account, nonce);
+   t.push_transaction(trx);
+}
+
+/**
+ * Least recently used modules are evicted when the instantiation cache is over its limits
+ */
+BOOST_FIXTURE_TEST_CASE( instantiation_cache_lru, TESTER ) try {
+   produce_blocks(2);
+   create_accounts( {N(cachea), N(cacheb), N(cachec)} );
+   produce_block();
+
+   set_code(N(cachea), cache_test_wast(1).c_str());
+   set_code(N(cacheb), cache_test_wast(2).c_str());
+   set_code(N(cachec), cache_test_wast(3).c_str());
+   produce_blocks(1);
+
+   uint32_t nonce = 0;
+   push_cache_test_action(*this, N(cachea), nonce++);
+   push_cache_test_action(*this, N(cacheb), nonce++);
+   push_cache_test_action(*this, N(cachec), nonce++);
+
+   // keeps cacheb and cachec
+   auto& wasmif = control->get_wasm_interface();
+   wasmif.set_cache_limits(2, 0);
+   const auto start = wasmif.get_cache_stats();
+   BOOST_REQUIRE_EQUAL(start.modules, 2u);
+
+   // misses go over the limits until the next irreversible block
+   push_cache_test_action(*this, N(cachea), nonce++);
+   push_cache_test_action(*this, N(cachec), nonce++);
+   BOOST_CHECK_EQUAL(wasmif.get_cache_stats().modules, 3u);
+   BOOST_CHECK_EQUAL(wasmif.get_cache_stats().evictions, start.evictions);
+
+   // evicts cacheb, cachec was used more recently
+   const auto lib = control->last_irreversible_block_num();
+   while( control->last_irreversible_block_num() == lib )
+      produce_blocks(1);
+   BOOST_CHECK_EQUAL(wasmif.get_cache_stats().modules, 2u);
+
+   push_cache_test_action(*this, N(cacheb), nonce++);
+   push_cache_test_action(*this, N(cachec), nonce++);
+
+   const auto stats = wasmif.get_cache_stats();
+   BOOST_CHECK_EQUAL(stats.misses - start.misses, 2u);
+   BOOST_CHECK_EQUAL(stats.hits - start.hits, 2u);
+   BOOST_CHECK_EQUAL(stats.evictions - start.evictions, 1u);
+} FC_LOG_AND_RETHROW()
+
+/**
+ * Code replaced by setcode is evicted once the replacement is irreversible
+ */
+BOOST_FIXTURE_TEST_CASE( instantiation_cache_retired_code, TESTER ) try {
+   produce_blocks(2);
+   create_accounts( {N(cachea)} );
+   produce_block();
+
+   set_code(N(cachea), cache_test_wast(1).c_str());
+   produce_blocks(1);
+   push_cache_test_action(*this, N(cachea), 0);
+   produce_blocks(1);
+
+   auto& wasmif = control->get_wasm_interface();
+   const auto start = wasmif.get_cache_stats();
+
+   set_code(N(cachea), cache_test_wast(2).c_str());
+   produce_blocks(1);
+   while( control->last_irreversible_block_num() < control->head_block_num() - 1 )
+      produce_blocks(1);
+   produce_blocks(2);
+
+   BOOST_CHECK_EQUAL(wasmif.get_cache_stats().evictions - start.evictions, 1u);
+} FC_LOG_AND_RETHROW()
+
+/**
+ * setcode compiles the code ahead of its first execution
+ */
+BOOST_FIXTURE_TEST_CASE( compile_on_setcode, TESTER ) try {
+   produce_blocks(2);
+   create_accounts( {N(cachea)} );
+   produce_block();
+
+   auto& wasmif = control->get_wasm_interface();
+   const auto start = wasmif.get_cache_stats();
+
+   set_code(N(cachea), cache_test_wast(1).c_str());
+   produce_blocks(1);
+   push_cache_test_action(*this, N(cachea), 0);
+
+   // either waited for the compilation or found it already moved to the cache
+   const auto stats = wasmif.get_cache_stats();
+   BOOST_CHECK_EQUAL((stats.compiled_ahead - start.compiled_ahead) + (stats.hits - start.hits), 1u);
+   BOOST_CHECK_EQUAL(stats.misses - start.misses, stats.compiled_ahead - start.compiled_ahead);
+} FC_LOG_AND_RETHROW()
+
+/**
+ * Contracts of a transaction are compiled ahead of pushing it when they are not cached and fit in the cache limits
+ */
+BOOST_FIXTURE_TEST_CASE( compile_transaction_contracts, TESTER ) try {
+   produce_blocks(2);
+   create_accounts( {N(cachea), N(cacheb), N(cachec)} );
+   produce_block();
+
+   set_code(N(cachea), cache_test_wast(1).c_str());
+   set_code(N(cacheb), cache_test_wast(2).c_str());
+   set_code(N(cachec), cache_test_wast(3).c_str());
+   produce_blocks(1);
+   push_cache_test_action(*this, N(cachea), 0);
+   push_cache_test_action(*this, N(cacheb), 1);
+   push_cache_test_action(*this, N(cachec), 2);
+
+   // evicts cachea and cacheb, leaves room for one compilation
+   auto& wasmif = control->get_wasm_interface();
+   wasmif.set_cache_limits(1, 0);
+   wasmif.set_cache_limits(2, 0);
+   const auto& code_id = control->get_account(N(cachea)).code_version;
+   const auto& other_id = control->get_account(N(cacheb)).code_version;
+   BOOST_REQUIRE(!wasmif.is_compiled_or_compiling(code_id));
+   BOOST_REQUIRE(!wasmif.is_compiled_or_compiling(other_id));
+   const auto start = wasmif.get_cache_stats();
+
+   auto trx = cache_test_trx(*this, N(cachea), 3);
+   BOOST_CHECK(control->compile_transaction_contracts(std::make_shared<transaction_metadata>(trx)));
+   BOOST_CHECK(wasmif.is_compiled_or_compiling(code_id));
+
+   // the compilation in flight takes the room that is left
+   BOOST_CHECK(!control->compile_transaction_contracts(std::make_shared<transaction_metadata>(cache_test_trx(*this, N(cacheb), 4))));
+   BOOST_CHECK(!wasmif.is_compiled_or_compiling(other_id));
+   push_transaction(trx);
+
+   const auto stats = wasmif.get_cache_stats();
+   BOOST_CHECK_EQUAL((stats.compiled_ahead - start.compiled_ahead) + (stats.hits - start.hits), 1u);
+   BOOST_CHECK_EQUAL(stats.misses - start.misses, stats.compiled_ahead - start.compiled_ahead);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( wasm_disk_cache_test ) try {
+   fc::temp_directory tempdir;
+   const auto cache_dir = tempdir.path() / "wasm-cache";
+   const auto code_id = digest_type::hash( std::string("code") );
+   const auto other_id = digest_type::hash( std::string("other") );
+
+   wasm_disk_cache::entry stored{ {0x00, 0x61, 0x73, 0x6d, 0x01}, {1, 2, 3} };
+   {
+      wasm_disk_cache cache( cache_dir );
+      cache.store( code_id, stored );
+   }
+
+   // entries survive restart
+   wasm_disk_cache cache( cache_dir );
+   wasm_disk_cache::entry loaded;
+   BOOST_REQUIRE( cache.load( code_id, loaded ) );
+   BOOST_CHECK( loaded.code == stored.code );
+   BOOST_CHECK( loaded.initial_memory == stored.initial_memory );
+   BOOST_CHECK( !cache.load( other_id, loaded ) );
+
+   // corrupted entry is rejected and removed
+   const auto file = cache_dir / (code_id.str() + ".wasm");
+   {
+      std::fstream f( file.generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+      f.seekp( -40, std::ios::end );
+      f.put( 0x7f );
+   }
+   BOOST_CHECK( !cache.load( code_id, loaded ) );
+   BOOST_CHECK( !fc::exists( file ) );
+
+   // entry stored under another code id is rejected
+   cache.store( other_id, stored );
+   fc::rename( cache_dir / (other_id.str() + ".wasm"), file );
+   BOOST_CHECK( !cache.load( code_id, loaded ) );
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()